@@ -0,0 +1,218 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+#ifdef _WIN32
+	#include <malloc.h>
+#endif
+
+namespace
+{
+	// Plain thread local data, accessing it never allocates
+	thread_local AllocationTracker::Counters t_counters;
+	thread_local AllocationScope* t_currentScope = nullptr;
+
+	std::atomic<std::uint64_t> g_allocations(0);
+	std::atomic<std::uint64_t> g_deallocations(0);
+	std::atomic<std::uint64_t> g_bytes(0);
+}
+
+std::atomic<AllocationSite*> AllocationTracker::s_firstSite(nullptr);
+
+AllocationSite::AllocationSite(const char* name)
+	: name(name)
+{
+	// Sites are static objects that are never destroyed before the end of the program
+	next = AllocationTracker::s_firstSite.load(std::memory_order_relaxed);
+	while (!AllocationTracker::s_firstSite.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+AllocationScope::AllocationScope(AllocationSite* site)
+	: m_site(site)
+	, m_parent(t_currentScope)
+{
+	t_currentScope = this;
+}
+
+AllocationScope::~AllocationScope()
+{
+	t_currentScope = m_parent;
+
+	if (m_site) {
+		const auto count = allocations();
+		m_site->calls.fetch_add(1, std::memory_order_relaxed);
+		m_site->allocations.fetch_add(count, std::memory_order_relaxed);
+		m_site->bytes.fetch_add(bytes(), std::memory_order_relaxed);
+		m_site->lastAllocations.store(count, std::memory_order_relaxed);
+
+		auto max = m_site->maxAllocations.load(std::memory_order_relaxed);
+		while (count > max && !m_site->maxAllocations.compare_exchange_weak(max, count, std::memory_order_relaxed)) {}
+	}
+}
+
+AllocationScope* AllocationScope::current()
+{
+	return t_currentScope;
+}
+
+AllocationScope::Binding::Binding(AllocationScope* scope)
+	: m_previous(t_currentScope)
+{
+	t_currentScope = scope;
+}
+
+AllocationScope::Binding::~Binding()
+{
+	t_currentScope = m_previous;
+}
+
+AllocationTracker::Counters AllocationTracker::globalCounters()
+{
+	Counters counters;
+	counters.allocations = g_allocations.load(std::memory_order_relaxed);
+	counters.deallocations = g_deallocations.load(std::memory_order_relaxed);
+	counters.bytes = g_bytes.load(std::memory_order_relaxed);
+	return counters;
+}
+
+AllocationTracker::Counters AllocationTracker::threadCounters()
+{
+	return t_counters;
+}
+
+const AllocationSite* AllocationTracker::firstSite()
+{
+	return s_firstSite.load(std::memory_order_acquire);
+}
+
+void AllocationTracker::writeReport(std::ostream& out)
+{
+	const auto global = globalCounters();
+	out << "Allocations: " << global.allocations << " (" << global.bytes << " bytes), deallocations: " << global.deallocations << "\n";
+	out << std::left << std::setw(40) << "Site" << std::right
+		<< std::setw(12) << "Calls" << std::setw(14) << "Allocations" << std::setw(12) << "Per call"
+		<< std::setw(10) << "Max" << std::setw(10) << "Last" << std::setw(16) << "Bytes" << "\n";
+
+	for (auto site = firstSite(); site; site = site->next) {
+		const auto calls = site->calls.load(std::memory_order_relaxed);
+		const auto allocations = site->allocations.load(std::memory_order_relaxed);
+		out << std::left << std::setw(40) << site->name << std::right
+			<< std::setw(12) << calls << std::setw(14) << allocations
+			<< std::setw(12) << std::fixed << std::setprecision(2) << (calls > 0 ? double(allocations) / calls : 0.0)
+			<< std::setw(10) << site->maxAllocations.load(std::memory_order_relaxed)
+			<< std::setw(10) << site->lastAllocations.load(std::memory_order_relaxed)
+			<< std::setw(16) << site->bytes.load(std::memory_order_relaxed) << "\n";
+	}
+}
+
+void AllocationTracker::countAllocation(std::size_t size)
+{
+	t_counters.allocations++;
+	t_counters.bytes += size;
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	g_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	for (auto scope = t_currentScope; scope; scope = scope->m_parent) {
+		scope->m_allocations.fetch_add(1, std::memory_order_relaxed);
+		scope->m_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+}
+
+void AllocationTracker::countDeallocation()
+{
+	t_counters.deallocations++;
+	g_deallocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef PHYANI_ALLOCATION_TRACKING
+
+namespace
+{
+	void* allocate(std::size_t size)
+	{
+		AllocationTracker::countAllocation(size);
+		return std::malloc(size == 0 ? 1 : size);
+	}
+
+	void* allocateAligned(std::size_t size, std::size_t alignment)
+	{
+		AllocationTracker::countAllocation(size);
+		size = (size == 0) ? alignment : (size + alignment - 1) / alignment*alignment;
+#ifdef _WIN32
+		return _aligned_malloc(size, alignment);
+#else
+		void* pointer = nullptr;
+		return (posix_memalign(&pointer, std::max(alignment, sizeof(void*)), size) == 0) ? pointer : nullptr;
+#endif
+	}
+
+	void deallocate(void* pointer)
+	{
+		if (!pointer) return;
+		AllocationTracker::countDeallocation();
+		std::free(pointer);
+	}
+
+	void deallocateAligned(void* pointer)
+	{
+		if (!pointer) return;
+		AllocationTracker::countDeallocation();
+#ifdef _WIN32
+		_aligned_free(pointer);
+#else
+		std::free(pointer);
+#endif
+	}
+
+	template <typename AllocateT>
+	void* allocateOrThrow(AllocateT&& allocate)
+	{
+		for (;;) {
+			if (void* pointer = allocate()) return pointer;
+			const auto handler = std::get_new_handler();
+			if (!handler) throw std::bad_alloc();
+			handler();
+		}
+	}
+}
+
+void* operator new(std::size_t size) { return allocateOrThrow([&]() { return allocate(size); }); }
+void* operator new[](std::size_t size) { return allocateOrThrow([&]() { return allocate(size); }); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow([&]() { return allocateAligned(size, static_cast<std::size_t>(alignment)); });
+}
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return allocateOrThrow([&]() { return allocateAligned(size, static_cast<std::size_t>(alignment)); });
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocateAligned(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return allocateAligned(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+
+void operator delete(void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(pointer); }
+
+#endif
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+//! Named code location whose allocations are accumulated over all executions of its scopes.
+struct AllocationSite
+{
+	explicit AllocationSite(const char* name);
+
+	AllocationSite(const AllocationSite&) = delete;
+	AllocationSite& operator=(const AllocationSite&) = delete;
+
+	const char* name;
+	//! Number of completed scopes of the site.
+	std::atomic<std::uint64_t> calls{0};
+	std::atomic<std::uint64_t> allocations{0};
+	std::atomic<std::uint64_t> bytes{0};
+	//! Number of allocations of the scope with the most allocations and of the last completed scope.
+	std::atomic<std::uint64_t> maxAllocations{0};
+	std::atomic<std::uint64_t> lastAllocations{0};
+
+	//! Next site in the list of all sites, see AllocationTracker::firstSite().
+	AllocationSite* next = nullptr;
+};
+
+//! Counts the allocations made during its lifetime by its thread and by worker pool tasks started from it.
+/*
+ * Scopes are nested, every allocation is counted by all enclosing scopes of the allocating thread. Tasks
+ * of the WorkerPool are executed in the scope that was active when the tasks were started, so the
+ * allocations of a parallel loop are attributed to the scope of the calling thread.
+ */
+class AllocationScope
+{
+public:
+	//! Starts a scope, the allocations are added to the site at the end of the scope if a site is specified.
+	explicit AllocationScope(AllocationSite* site = nullptr);
+	~AllocationScope();
+
+	AllocationScope(const AllocationScope&) = delete;
+	AllocationScope& operator=(const AllocationScope&) = delete;
+
+	//! Returns the number of allocations and allocated bytes since the start of the scope.
+	std::uint64_t allocations() const { return m_allocations.load(std::memory_order_relaxed); }
+	std::uint64_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+	//! Returns the innermost scope of the calling thread, null if there is none.
+	static AllocationScope* current();
+
+	//! Makes a scope of another thread the current scope of the calling thread during its lifetime.
+	class Binding
+	{
+	public:
+		explicit Binding(AllocationScope* scope);
+		~Binding();
+
+		Binding(const Binding&) = delete;
+		Binding& operator=(const Binding&) = delete;
+
+	private:
+		AllocationScope* m_previous;
+	};
+
+private:
+	friend class AllocationTracker;
+
+	AllocationSite* m_site;
+	AllocationScope* m_parent;
+	std::atomic<std::uint64_t> m_allocations{0};
+	std::atomic<std::uint64_t> m_bytes{0};
+};
+
+//! Global allocation counters, available if the global operator new is replaced (PHYANI_ALLOCATION_TRACKING).
+/*
+ * Only allocations through operator new are counted. Memory allocated with malloc directly, e.g. by the
+ * aligned allocator of Eigen, is not visible to the tracker.
+ */
+class AllocationTracker
+{
+public:
+	struct Counters
+	{
+		std::uint64_t allocations = 0;
+		std::uint64_t deallocations = 0;
+		std::uint64_t bytes = 0;
+	};
+
+	//! Returns whether the global operator new was replaced, otherwise all counters stay zero.
+	static constexpr bool isEnabled()
+	{
+#ifdef PHYANI_ALLOCATION_TRACKING
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	//! Returns the counters of all threads since the start of the program.
+	static Counters globalCounters();
+	//! Returns the counters of the calling thread since its start.
+	static Counters threadCounters();
+
+	//! Returns the first site of the list of all sites that were entered at least once.
+	static const AllocationSite* firstSite();
+	//! Writes a table of the allocations of all sites.
+	static void writeReport(std::ostream& out);
+
+	//! Counts an allocation of the calling thread, called by the replaced operator new.
+	static void countAllocation(std::size_t size);
+	//! Counts a deallocation of the calling thread, called by the replaced operator delete.
+	static void countDeallocation();
+
+private:
+	friend struct AllocationSite;
+	static std::atomic<AllocationSite*> s_firstSite;
+};
+
+#define PHYANI_ALLOCATION_CONCAT_IMPL(a, b) a##b
+#define PHYANI_ALLOCATION_CONCAT(a, b) PHYANI_ALLOCATION_CONCAT_IMPL(a, b)
+
+#ifdef PHYANI_ALLOCATION_TRACKING
+	//! Attributes the allocations of the remainder of the enclosing scope to the site with the specified name (a string literal).
+	#define ALLOCATION_SCOPE(name) \
+		static AllocationSite PHYANI_ALLOCATION_CONCAT(allocationSite, __LINE__)(name); \
+		AllocationScope PHYANI_ALLOCATION_CONCAT(allocationScope, __LINE__)(&PHYANI_ALLOCATION_CONCAT(allocationSite, __LINE__))
+#else
+	#define ALLOCATION_SCOPE(name) ((void)0)
+#endif
@@ -1,6 +1,11 @@
 #include "AnimationLoop.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <thread>
+
+#include "Trace.h"
 
 AnimationLoop::AnimationLoop(AnimationSystem& animationSystem)
 	: m_animationSystem(animationSystem)
@@ -9,27 +14,75 @@ AnimationLoop::AnimationLoop(AnimationSystem& animationSystem)
 	, m_timeStretch(1.0)
 	, m_lastComputationTime(0.0)
 	, m_lastTimestepDt(0.0)
+	, m_fixedTimestep(false)
+	, m_fixedDt(1.0 / 120.0)
+	, m_maxStepsPerInterval(8)
+	, m_accumulator(0.0)
+	, m_stepRate(defaultStepRate)
+	, m_spinDuration(defaultSpinDuration)
 {
+	// Coalescing more requests than this into a single batch allocates
+	m_timestepBatch.promises.reserve(64);
 }
 
 std::future<void> AnimationLoop::stopEventLoop()
 {
-	return m_eventQueue.postEvent(StopEventLoopRequest());
+	return m_eventQueue.postEvent(StopEventLoopRequest(), EventPriority::High);
 }
 
 std::future<void> AnimationLoop::requestTimestep(double dt)
 {
-	return m_eventQueue.postEvent(ComputeTimestepRequest{ dt });
+	return requestTimesteps(1, dt);
+}
+
+std::future<void> AnimationLoop::requestTimesteps(std::size_t count, double dt)
+{
+	return m_eventQueue.postEvent(ComputeTimestepRequest{ dt, count });
+}
+
+void AnimationLoop::requestTimestepDetached(double dt)
+{
+	m_eventQueue.postEventDetached(ComputeTimestepRequest{ dt, 1 });
 }
 
 std::future<bool> AnimationLoop::toggleAutomaticTimestepping()
 {
-	return m_eventQueue.postEvent(ToggleAutomaticTimesteppingRequest{ 1.0 });
+	return m_eventQueue.postEvent(ToggleAutomaticTimesteppingRequest{ 1.0 }, EventPriority::High);
 }
 
 std::future<bool> AnimationLoop::toggleAutomaticTimestepping(double timeStretch)
 {
-	return m_eventQueue.postEvent(ToggleAutomaticTimesteppingRequest{ timeStretch });
+	return m_eventQueue.postEvent(ToggleAutomaticTimesteppingRequest{ timeStretch }, EventPriority::High);
+}
+
+std::future<void> AnimationLoop::setIntegrator(IntegrationScheme scheme, std::size_t substepCount)
+{
+	return m_eventQueue.postEvent(SetIntegratorRequest{ scheme, substepCount });
+}
+
+std::future<void> AnimationLoop::setFixedTimestep(bool enabled, double dt, std::size_t maxStepsPerInterval)
+{
+	return m_eventQueue.postEvent(SetFixedTimestepRequest{ enabled, dt, maxStepsPerInterval });
+}
+
+std::future<void> AnimationLoop::setPacing(double stepRate, double spinDuration)
+{
+	return m_eventQueue.postEvent(SetPacingRequest{ stepRate, spinDuration });
+}
+
+std::future<bool> AnimationLoop::setScheduling(const ThreadScheduling::Settings& settings)
+{
+	return m_eventQueue.postEvent(SetSchedulingRequest{ settings });
+}
+
+std::future<void> AnimationLoop::saveSnapshot()
+{
+	return m_eventQueue.postEvent(SaveSnapshotRequest());
+}
+
+std::future<bool> AnimationLoop::restoreSnapshot()
+{
+	return m_eventQueue.postEvent(RestoreSnapshotRequest());
 }
 
 void AnimationLoop::executeTimestepLoop()
@@ -37,71 +90,282 @@ void AnimationLoop::executeTimestepLoop()
 	if (m_continueEventLoop) return;
 
 	std::cout << "(sim) Timestep loop started." << "\n";
+#ifdef PHYANI_TRACING
+	Trace::setThreadName("Simulation");
+#endif
 	m_continueEventLoop = true;
 	while(m_continueEventLoop) {
 		if (!m_automaticTimestepping) {
 			m_eventQueue.waitForEvent();
+		} else if (m_stepRate > 0.0) {
+			waitForNextIteration();
 		}
+		// Waiting for events is not part of the zone
+		TRACE_ZONE("AnimationLoop::executeTimestepLoop");
 
 		processEvents();
+		computeQueuedTimesteps();
 		if (m_automaticTimestepping) {
 			processEvents();
 			const auto currentTime = std::chrono::high_resolution_clock::now();
-			m_lastComputationTime = static_cast<std::chrono::duration<double>>(currentTime - m_lastRender).count();
-			m_lastTimestepDt = m_timeStretch*m_lastComputationTime;
-			m_animationSystem.computeTimestep(m_lastTimestepDt);
+			const double elapsed = static_cast<std::chrono::duration<double>>(currentTime - m_lastRender).count();
+			if (m_fixedTimestep) {
+				computeFixedTimesteps(m_timeStretch*elapsed);
+			} else {
+				m_lastComputationTime = elapsed;
+				m_lastTimestepDt = m_timeStretch*m_lastComputationTime;
+				computeTimestep(m_lastTimestepDt);
+			}
 			m_lastRender = currentTime;
 		}
 	}
+	// Timesteps that were queued behind the stop request are not computed anymore
+	clearQueuedTimesteps(false);
 	std::cout << "(sim) Timestep loop stopped." << "\n";
 }
 
-void AnimationLoop::processEvents()
+void AnimationLoop::waitForNextIteration()
 {
-	// Define the visitor which processes all possible event types
-	const struct
-	{
-		AnimationLoop* simulation;
+	using Clock = std::chrono::steady_clock;
+	const auto toDuration = [](double seconds) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)); };
+
+	// The pacing may be changed by the events processed while waiting
+	while (m_continueEventLoop && m_automaticTimestepping && m_stepRate > 0.0) {
+		const auto now = Clock::now();
+		if (now >= m_nextDeadline) break;
 
-		void operator()(StopEventLoopEvent& event) const
-		{
-			// Change the flag to break event loop
-			simulation->m_continueEventLoop = false;
-			event.promise.set_value();
+		const auto spinDuration = toDuration(m_spinDuration);
+		if (m_nextDeadline - now > spinDuration) {
+			// Events wake up the thread before the deadline
+			if (m_eventQueue.waitForEventUntil(m_nextDeadline - spinDuration)) processEvents();
+		} else {
+			std::this_thread::yield();
 		}
+	}
+	if (!m_continueEventLoop || !m_automaticTimestepping || m_stepRate <= 0.0) return;
 
-		void operator()(ComputeTimestepEvent& event) const
-		{
+	const auto start = Clock::now();
+	const double delay = std::chrono::duration<double>(start - m_nextDeadline).count();
+	m_pacingJitter.add(delay);
+	m_pacingJitterHistogram.add(delay);
+
+	// Keep the phase of the deadlines unless a whole period was missed
+	const auto period = toDuration(1.0 / m_stepRate);
+	m_nextDeadline += period;
+	if (m_nextDeadline <= start) m_nextDeadline = start + period;
+}
+
+void AnimationLoop::computeFixedTimesteps(double elapsed)
+{
+	m_accumulator += elapsed;
+
+	std::size_t stepCount = static_cast<std::size_t>(m_accumulator / m_fixedDt);
+	if (stepCount > m_maxStepsPerInterval) {
+		// Drop the time that cannot be caught up, otherwise slow steps would require more and more steps
+		stepCount = m_maxStepsPerInterval;
+		m_accumulator = stepCount*m_fixedDt + std::fmod(m_accumulator, m_fixedDt);
+	}
+
+	if (stepCount > 0) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (std::size_t step = 0; step < stepCount; step++) {
+			m_animationSystem.computeTimestep(m_fixedDt);
+			m_statistics.add(m_animationSystem.lastTimestepTimings());
+			// Only the last two states of the interval can be interpolated
+			if (step + 2 >= stepCount) m_renderState.capture(m_animationSystem.renderComponents());
+			m_accumulator -= m_fixedDt;
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		m_lastComputationTime = static_cast<std::chrono::duration<double>>(end - start).count() / stepCount;
+		m_lastTimestepDt = m_fixedDt;
+	}
+
+	m_renderState.publish(m_accumulator / m_fixedDt);
+}
+
+void AnimationLoop::computeTimestep(double dt)
+{
+	m_animationSystem.computeTimestep(dt);
+	m_statistics.add(m_animationSystem.lastTimestepTimings());
+}
+
+void AnimationLoop::saveInitialSnapshot()
+{
+	if (m_snapshot.empty()) m_animationSystem.saveSnapshot(m_snapshot);
+}
+
+//! Visitor which processes all possible event types
+struct AnimationLoop::EventVisitor
+{
+	AnimationLoop* simulation;
+
+	void operator()(StopEventLoopEvent& event) const
+	{
+		// Change the flag to break event loop
+		simulation->m_continueEventLoop = false;
+		event.promise.set_value();
+	}
+
+	void operator()(ComputeTimestepEvent& event) const
+	{
+		// The steps are computed after the adjacent requests were coalesced
+		simulation->queueTimesteps(event.request, std::move(event.promise));
+	}
+
+	void operator()(ToggleAutomaticTimesteppingEvent& event) const
+	{
+		if(!simulation->m_automaticTimestepping) {
 			auto& request = event.request;
-			if (!simulation->m_automaticTimestepping) {
-				simulation->m_lastRender = std::chrono::high_resolution_clock::now();
-				simulation->m_lastTimestepDt = request.dt;
-				simulation->m_animationSystem.computeTimestep(request.dt);
-				const auto currentTime = std::chrono::high_resolution_clock::now();
-				simulation->m_lastComputationTime = static_cast<std::chrono::duration<double>>(currentTime - simulation->m_lastRender).count();
-			}
-			event.promise.set_value();
+			simulation->m_automaticTimestepping = true;
+			simulation->m_timeStretch = request.timeStretch;
+			simulation->m_accumulator = 0.0;
+			simulation->saveInitialSnapshot();
+			simulation->m_lastRender = std::chrono::high_resolution_clock::now();
+			simulation->m_nextDeadline = std::chrono::steady_clock::now();
+			event.promise.set_value(true);
+		} else {
+			simulation->m_automaticTimestepping = false;
+			event.promise.set_value(false);
 		}
+	}
 
-		void operator()(ToggleAutomaticTimesteppingEvent& event) const
-		{
-			if(!simulation->m_automaticTimestepping) {
-				auto& request = event.request;
-				simulation->m_automaticTimestepping = true;
-				simulation->m_timeStretch = request.timeStretch;
-				simulation->m_lastRender = std::chrono::high_resolution_clock::now();
-				event.promise.set_value(true);
-			} else {
-				simulation->m_automaticTimestepping = false;
-				event.promise.set_value(false);
-			}
+	void operator()(SetIntegratorEvent& event) const
+	{
+		// Applied between timesteps, the integrator is only recreated if the scheme changes
+		simulation->computeQueuedTimesteps();
+		auto& request = event.request;
+		simulation->m_animationSystem.setIntegrationScheme(request.scheme);
+		simulation->m_animationSystem.setSubstepCount(request.substepCount);
+		event.promise.set_value();
+	}
+
+	void operator()(SetFixedTimestepEvent& event) const
+	{
+		simulation->computeQueuedTimesteps();
+		auto& request = event.request;
+		simulation->m_fixedTimestep = request.enabled && request.dt > 0;
+		if (request.dt > 0) simulation->m_fixedDt = request.dt;
+		simulation->m_maxStepsPerInterval = std::max<std::size_t>(request.maxStepsPerInterval, 1);
+		simulation->m_accumulator = 0.0;
+		// The render states are only captured in fixed timestep mode, old states must not be interpolated after switching back
+		simulation->m_renderState.clear();
+		event.promise.set_value();
+	}
+
+	void operator()(SetPacingEvent& event) const
+	{
+		auto& request = event.request;
+		simulation->m_stepRate = std::max(request.stepRate, 0.0);
+		simulation->m_spinDuration = std::max(request.spinDuration, 0.0);
+		simulation->m_nextDeadline = std::chrono::steady_clock::now();
+		event.promise.set_value();
+	}
+
+	void operator()(SetSchedulingEvent& event) const
+	{
+		// Applied to the calling thread, i.e. the thread running the timestep loop
+		const auto& settings = event.request.settings;
+		std::string error;
+		const bool applied = ThreadScheduling::applyToCurrentThread(settings, error);
+		if (!applied) std::cerr << "(sim) Scheduling " << ThreadScheduling::policyName(settings.policy) << " not fully applied: " << error << "\n";
+		event.promise.set_value(applied);
+	}
+
+	void operator()(SaveSnapshotEvent& event) const
+	{
+		simulation->computeQueuedTimesteps();
+		simulation->m_animationSystem.saveSnapshot(simulation->m_snapshot);
+		event.promise.set_value();
+	}
+
+	void operator()(RestoreSnapshotEvent& event) const
+	{
+		simulation->computeQueuedTimesteps();
+		if (simulation->m_snapshot.empty() || !simulation->m_animationSystem.loadSnapshot(simulation->m_snapshot)) {
+			event.promise.set_value(false);
+			return;
+		}
+
+		// The restored state replaces both interpolated states
+		simulation->m_accumulator = 0.0;
+		simulation->m_renderState.clear();
+		if (simulation->m_fixedTimestep) {
+			simulation->m_renderState.capture(simulation->m_animationSystem.renderComponents());
+			simulation->m_renderState.publish(1.0);
+		}
+		event.promise.set_value(true);
+	}
+};
+
+void AnimationLoop::queueTimesteps(ComputeTimestepRequest request, EventPromise<void>&& promise)
+{
+	// Only requests with the same timestep are coalesced, otherwise the steps are computed in order
+	auto& batch = m_timestepBatch;
+	if (batch.computedSteps < batch.stepCount && request.dt != batch.dt) computeQueuedTimesteps();
+
+	// Manual timesteps are ignored during automatic timestepping
+	if (m_automaticTimestepping || request.count == 0) {
+		promise.set_value();
+		return;
+	}
+
+	batch.dt = request.dt;
+	batch.stepCount += request.count;
+	batch.promises.emplace_back(batch.stepCount, std::move(promise));
+}
+
+void AnimationLoop::computeQueuedTimesteps()
+{
+	auto& batch = m_timestepBatch;
+	if (batch.computedSteps == batch.stepCount) return;
+
+	saveInitialSnapshot();
+	while (batch.computedSteps < batch.stepCount) {
+		const auto start = std::chrono::high_resolution_clock::now();
+		m_lastRender = start;
+		m_lastTimestepDt = batch.dt;
+		computeTimestep(batch.dt);
+		m_lastComputationTime = static_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count();
+
+		batch.computedSteps++;
+		while (batch.fulfilledPromises < batch.promises.size() && batch.promises[batch.fulfilledPromises].first <= batch.computedSteps) {
+			batch.promises[batch.fulfilledPromises++].second.set_value();
 		}
-	} eventVisitor{ this };
 
-	while (m_continueEventLoop && !m_eventQueue.empty()) {
-		// The event queue ensures thread safety
-		m_eventQueue.processOldestEvent(eventVisitor);
+		// Control events overtake the remaining steps of the batch
+		while (m_continueEventLoop && m_eventQueue.processHighPriorityEvent(EventVisitor{ this })) {}
+		if (!m_continueEventLoop) {
+			clearQueuedTimesteps(false);
+			return;
+		}
+		if (m_automaticTimestepping) {
+			clearQueuedTimesteps(true);
+			return;
+		}
 	}
+
+	clearQueuedTimesteps(true);
+}
+
+void AnimationLoop::clearQueuedTimesteps(bool fulfillPromises)
+{
+	auto& batch = m_timestepBatch;
+	if (fulfillPromises) {
+		for (std::size_t i = batch.fulfilledPromises; i < batch.promises.size(); i++) batch.promises[i].second.set_value();
+	}
+
+	// Discarded promises report a broken promise to their futures, the vector keeps its capacity
+	batch.promises.clear();
+	batch.fulfilledPromises = 0;
+	batch.stepCount = 0;
+	batch.computedSteps = 0;
+}
+
+void AnimationLoop::processEvents()
+{
+	// The event queue ensures thread safety, processing stops when the queue is empty
+	while (m_continueEventLoop && m_eventQueue.processOldestEvent(EventVisitor{ this })) {}
 }
 
 bool AnimationLoop::isEventLoopRunning() const
@@ -118,3 +382,28 @@ std::pair<double, double> AnimationLoop::lastTimestepStats() const
 {
 	return { m_lastComputationTime , m_lastTimestepDt };
 }
+
+TimestepStatistics::Summary AnimationLoop::timestepStatistics() const
+{
+	return m_statistics.summary();
+}
+
+RollingStatistics::Percentiles AnimationLoop::pacingJitter() const
+{
+	return m_pacingJitter.percentiles();
+}
+
+const DurationHistogram& AnimationLoop::pacingJitterHistogram() const
+{
+	return m_pacingJitterHistogram;
+}
+
+void AnimationLoop::resetPacingJitterHistogram()
+{
+	m_pacingJitterHistogram.clear();
+}
+
+const RenderStateBuffer& AnimationLoop::renderState() const
+{
+	return m_renderState;
+}
@@ -4,39 +4,128 @@
 #include <future>
 #include <chrono>
 #include <utility>
+#include <vector>
 
 #include "EventQueue.h"
 #include "AnimationSystem.h"
+#include "DurationHistogram.h"
+#include "RenderStateBuffer.h"
+#include "RollingStatistics.h"
+#include "ThreadScheduling.h"
+#include "TimestepStatistics.h"
 
 class AnimationLoop
 {
 	struct StopEventLoopRequest {};
-	struct ComputeTimestepRequest { double dt; };
+	struct ComputeTimestepRequest { double dt; std::size_t count; };
 	struct ToggleAutomaticTimesteppingRequest { double timeStretch; };
+	struct SetIntegratorRequest { IntegrationScheme scheme; std::size_t substepCount; };
+	struct SetFixedTimestepRequest { bool enabled; double dt; std::size_t maxStepsPerInterval; };
+	struct SaveSnapshotRequest {};
+	struct RestoreSnapshotRequest {};
+	struct SetPacingRequest { double stepRate; double spinDuration; };
+	struct SetSchedulingRequest { ThreadScheduling::Settings settings; };
 
 	using StopEventLoopEvent = VoidEvent<StopEventLoopRequest>;
 	using ComputeTimestepEvent = VoidEvent<ComputeTimestepRequest>;
 	using ToggleAutomaticTimesteppingEvent = Event<ToggleAutomaticTimesteppingRequest, bool>;
+	using SetIntegratorEvent = VoidEvent<SetIntegratorRequest>;
+	using SetFixedTimestepEvent = VoidEvent<SetFixedTimestepRequest>;
+	using SaveSnapshotEvent = VoidEvent<SaveSnapshotRequest>;
+	using RestoreSnapshotEvent = Event<RestoreSnapshotRequest, bool>;
+	using SetPacingEvent = VoidEvent<SetPacingRequest>;
+	using SetSchedulingEvent = Event<SetSchedulingRequest, bool>;
 
 	using event_queue_type = EventQueue<StopEventLoopEvent, 
 										ComputeTimestepEvent, 
-										ToggleAutomaticTimesteppingEvent>;
+										ToggleAutomaticTimesteppingEvent,
+										SetIntegratorEvent,
+										SetFixedTimestepEvent,
+										SaveSnapshotEvent,
+										RestoreSnapshotEvent,
+										SetPacingEvent,
+										SetSchedulingEvent>;
 	event_queue_type m_eventQueue;
 
+	struct EventVisitor;
+
 public:
 	AnimationLoop(AnimationSystem& animationSystem);
 	void executeTimestepLoop();
 	void processEvents();
 
+	//! Stops the loop before the next timestep, overtakes all queued requests. Queued timesteps are discarded.
+	/*
+	 * The promises of discarded timesteps are destroyed without a value, so their futures throw a
+	 * std::future_error with the code std::future_errc::broken_promise. This includes the remaining steps of
+	 * a running batch and the requests that are still queued when the loop stops.
+	 */
 	std::future<void> stopEventLoop();
 	std::future<void> requestTimestep(double dt);
+	//! Requests 'count' manual timesteps of size 'dt', the future is ready after the last of them.
+	/*
+	 * Adjacent timestep requests of the same size are coalesced into a single batch that is computed without
+	 * returning to the event loop. Stop and toggle requests are processed between the steps of a batch.
+	 * If the loop is stopped before the last step, get() of the future throws a std::future_error with the
+	 * code std::future_errc::broken_promise, see stopEventLoop(). Starting automatic timestepping fulfills
+	 * the future without computing the remaining steps.
+	 */
+	std::future<void> requestTimesteps(std::size_t count, double dt);
+	//! Requests a manual timestep of size 'dt' without a future, e.g. for UI actions that do not wait for the step. Posting does not allocate.
+	void requestTimestepDetached(double dt);
+	//! Starts or stops automatic timestepping, overtakes all queued requests. Queued manual timesteps are skipped when it starts.
 	std::future<bool> toggleAutomaticTimestepping();
 	std::future<bool> toggleAutomaticTimestepping(double timeStretch);
+	std::future<void> setIntegrator(IntegrationScheme scheme, std::size_t substepCount);
+	//! Switches automatic timestepping between steps of the elapsed wall clock time and a fixed timestep.
+	/*
+	 * With a fixed timestep, the elapsed (stretched) wall clock time is accumulated and an integer number of
+	 * steps of size 'dt' is computed per loop iteration. At most 'maxStepsPerInterval' steps are computed per
+	 * iteration, time that cannot be caught up is dropped instead of delaying the following iterations.
+	 */
+	std::future<void> setFixedTimestep(bool enabled, double dt, std::size_t maxStepsPerInterval = 8);
+	//! Sets the number of iterations per second of the automatic timestepping loop, zero runs the loop as fast as possible.
+	/*
+	 * Between two iterations the simulation thread sleeps until 'spinDuration' seconds before the deadline of
+	 * the next iteration and spins for the remaining time, posted events are processed while it sleeps. If an
+	 * iteration misses its deadline by more than a period, the following deadlines are shifted instead of
+	 * running the missed iterations back to back.
+	 */
+	std::future<void> setPacing(double stepRate, double spinDuration = defaultSpinDuration);
+	//! Applies the scheduling settings to the thread running the timestep loop, returns false if a part of them could not be applied.
+	/*
+	 * Opt-in for demos where the jitter of the step times matters more than throughput, see ThreadScheduling.
+	 * The reasons of failures are written to the error output.
+	 */
+	std::future<bool> setScheduling(const ThreadScheduling::Settings& settings);
+	//! Stores a snapshot of the current state, replaces the snapshot taken automatically before the first timestep.
+	std::future<void> saveSnapshot();
+	//! Restores the last stored snapshot, returns false if no snapshot was stored.
+	std::future<bool> restoreSnapshot();
 
 	bool isEventLoopRunning() const;
 	bool isAutomaticTimesteppingActive() const;
 
 	std::pair<double, double> lastTimestepStats() const;
+	//! Returns the percentiles of the phase timings of the last timesteps, may be called from any thread without blocking the simulation.
+	TimestepStatistics::Summary timestepStatistics() const;
+	//! Returns the percentiles of the delays in seconds between the deadlines of the paced iterations and their actual start.
+	RollingStatistics::Percentiles pacingJitter() const;
+	//! Returns the histogram of the same delays since the start of the loop or the last reset.
+	const DurationHistogram& pacingJitterHistogram() const;
+	//! Clears the histogram of the delays, may be called by any thread.
+	void resetPacingJitterHistogram();
+
+	//! Iteration rate of the automatic timestepping loop if not set otherwise.
+	static constexpr double defaultStepRate = 120.0;
+	//! Final part of the wait for a deadline in seconds that is spent spinning, sleeping is less precise.
+	static constexpr double defaultSpinDuration = 0.5e-3;
+	//! Returns the render data of the last two timesteps for interpolation, the interpolation factor is the unsimulated fraction of the fixed timestep.
+	/*
+	 * The states are only captured by the automatic timestepping loop in fixed timestep mode, otherwise the
+	 * renderer reads the RenderData components of the last timestep and nothing is published.
+	 */
+	const RenderStateBuffer& renderState() const;
 
 private:
 	AnimationSystem& m_animationSystem;
@@ -47,5 +136,47 @@ private:
 	std::atomic<double> m_lastComputationTime;
 	std::atomic<double> m_lastTimestepDt;
 
+	bool m_fixedTimestep;
+	double m_fixedDt;
+	std::size_t m_maxStepsPerInterval;
+	//! Elapsed simulation time that was not simulated yet in fixed timestep mode.
+	double m_accumulator;
+
+	double m_stepRate;
+	double m_spinDuration;
+	//! Deadline of the next paced iteration of the automatic timestepping loop.
+	std::chrono::steady_clock::time_point m_nextDeadline;
+	RollingStatistics m_pacingJitter;
+	DurationHistogram m_pacingJitterHistogram;
+
+	//! Queued manual timesteps, adjacent requests with the same dt are coalesced into the batch.
+	struct TimestepBatch
+	{
+		double dt = 0.0;
+		std::size_t stepCount = 0;
+		std::size_t computedSteps = 0;
+		//! Promises of the coalesced requests with the number of steps of the batch after which they are fulfilled.
+		std::vector<std::pair<std::size_t, EventPromise<void>>> promises;
+		std::size_t fulfilledPromises = 0;
+	};
+	TimestepBatch m_timestepBatch;
+
+	RenderStateBuffer m_renderState;
+	TimestepStatistics m_statistics;
+	std::vector<char> m_snapshot;
+
 	std::chrono::time_point<std::chrono::high_resolution_clock> m_lastRender;
+
+	//! Sleeps and spins until the deadline of the next iteration, processes events in the meantime.
+	void waitForNextIteration();
+	void computeFixedTimesteps(double elapsed);
+	void computeTimestep(double dt);
+	//! Adds the steps of the request to the batch, computes the current batch first if the request has a different dt.
+	void queueTimesteps(ComputeTimestepRequest request, EventPromise<void>&& promise);
+	//! Computes the queued manual timesteps, processes high priority events between the steps.
+	void computeQueuedTimesteps();
+	//! Discards the queued manual timesteps, fulfills their promises if requested.
+	void clearQueuedTimesteps(bool fulfillPromises);
+	//! Stores the state before the first timestep, so that the scene can be reset.
+	void saveInitialSnapshot();
 };
\ No newline at end of file
@@ -1,205 +1,674 @@
 ﻿#include "AnimationSystem.h"
 
-#include <cassert>
+#include <algorithm>
 
+#include "AllocationTracker.h"
 #include "Common.h"
+#include "RotationKernels.h"
+#include "Snapshot.h"
+#include "Trace.h"
 
 AnimationSystem::AnimationSystem(EntityComponentSystem& ecs)
 	: m_ecs(ecs)
-	, m_time(0.0) {}
+	, m_stateStorage(StateStorage::Registry)
+	, m_storeValid(false)
+	, m_parallelJointForces(true)
+	, m_integrator(Integrator::create(IntegrationScheme::SymplecticEuler))
+	, m_substepCount(1)
+	, m_trajectoryRecorder(nullptr)
+	, m_time(0.0)
+	, m_phase(TimestepPhase::Synchronize)
+{
+	buildTaskGraphs();
+}
 
 void AnimationSystem::initialize()
 {
-	prepareNextTimestep();
+	rebuildStore();
+
+	updateDerivedState();
+	detectCollisions(0.0);
+	m_islands.build(m_store, m_narrowPhase.manifolds());
+	updateRenderData();
+
+	if (m_stateStorage == StateStorage::Registry) m_store.scatter(m_ecs);
 }
 
 void AnimationSystem::computeTimestep(double dt)
 {
-	// TODO: Different integration schemes with sub steps
-	// TODO: Ensure that enough space for sub steps is available
-	// TODO: Make bodies sleep when velocity goes to zero
-	// TODO: Change color of sleeping bodies
-
-	// Apply a force to a connected body, accumulates -> not thread safe
-	static const auto applyForce = [this](Connector& connector, const Eigen::Vector3d& force)
-	{
-		if (m_ecs.has<TranslationalAnimatedBody>(connector.parentEntity)) {
-			auto& translatedBody = m_ecs.get<TranslationalAnimatedBody>(connector.parentEntity);
-			translatedBody.externalForce += force;
-		} 
-
-		if (m_ecs.has<RotationalAnimatedBody>(connector.parentEntity)) {
-			auto& rotatedBody = m_ecs.get<RotationalAnimatedBody>(connector.parentEntity);
-			rotatedBody.externalTorque += (rotatedBody.rotationMatrix*connector.localPosition).cross(force);
-		} 
-	};
+	TRACE_ZONE("AnimationSystem::computeTimestep");
+	ALLOCATION_SCOPE("AnimationSystem::computeTimestep");
+
+	const auto stepStart = Clock::now();
+	m_timings = TimestepTimings();
+	m_phase = TimestepPhase::Synchronize;
+	m_phaseStart = stepStart;
+#ifdef PHYANI_TRACING
+	m_tracePhaseStart = Trace::isEnabled() ? Trace::now() : 0;
+#endif
+
+	synchronizeStore();
+
+	// Islands with awake bodies have to be woken up completely before the integration
+	m_sleepController.wakeUp(m_store, m_islands, workerPool());
+	m_islands.updateSleeping(m_store);
+
+	// Force evaluations and derived state updates of the integrator switch to their own phases
+	const double substepDt = dt / m_substepCount;
+	for (std::size_t substep = 0; substep < m_substepCount; substep++) {
+		switchPhase(TimestepPhase::Integration);
+		m_integrator->step(*this, substepDt);
+		switchPhase(TimestepPhase::Collisions);
+		detectCollisions(substepDt);
+		switchPhase(TimestepPhase::Contacts);
+		solveContacts(substepDt);
+	}
 
-	for (auto jointEntity : m_ecs.view<Joint>()) {
-		auto& joint = m_ecs.get<Joint>(jointEntity);
+	switchPhase(TimestepPhase::Sleeping);
+	m_sleepController.update(m_store, m_islands, workerPool());
 
-		if (auto dampedSpring = common::variant::get_if<Joint::DampedSpring>(&joint.jointProperties)) {
-			Eigen::Vector3d distance = joint.connectors.first.globalPosition - joint.connectors.second.globalPosition;
-			Eigen::Vector3d velocityDifference = joint.connectors.first.globalVelocity - joint.connectors.second.globalVelocity;
-			Eigen::Vector3d firstForce = -(dampedSpring->elasticity*(distance.norm() - dampedSpring->restLength)
-										   + dampedSpring->damping*(velocityDifference.dot(distance)))*distance.normalized();
+	// The render data, the write back and the recording only read the store and run concurrently
+	switchPhase(TimestepPhase::Output);
+	m_time += dt;
+	m_outputGraph.run(workerPool());
 
-			applyForce(joint.connectors.first, firstForce);
-			applyForce(joint.connectors.second, -firstForce);
-		}
-	}
+	switchPhase(TimestepPhase::Output);
+	m_timings.total = std::chrono::duration<double>(m_phaseStart - stepStart).count();
+	m_lastTimings = m_timings;
+}
+
+double AnimationSystem::time() const
+{
+	return m_time;
+}
 
-	// Integrate equations of linear motion
-	for (auto translatedEntity : m_ecs.view<TranslationalAnimatedBody>()) {
-		auto& translatedBody = m_ecs.get<TranslationalAnimatedBody>(translatedEntity);
+const TimestepTimings& AnimationSystem::lastTimestepTimings() const
+{
+	return m_lastTimings;
+}
 
-		if (!translatedBody.sleeping) {
-			if (translatedBody.mass > 0) {
-				const auto linearAcceleration = (1 / translatedBody.mass)*translatedBody.externalForce;
-				translatedBody.state.linearVelocity += dt*linearAcceleration;
-			}
+void AnimationSystem::saveSnapshot(std::vector<char>& snapshot)
+{
+	// The registry is not up to date in SoA mode
+	if (m_stateStorage == StateStorage::StructureOfArrays) synchronizeRegistry();
+	Snapshot::write(m_ecs, m_time, snapshot);
+}
 
-			translatedBody.state.position += dt*translatedBody.state.linearVelocity;
-		}
-	}
+bool AnimationSystem::loadSnapshot(const std::vector<char>& snapshot)
+{
+	if (!Snapshot::read(m_ecs, snapshot, m_time)) return false;
+
+	// Contacts and cached impulses belong to the replaced state, everything else is rebuilt from the components
+	m_narrowPhase.clear();
+	initialize();
+	return true;
+}
+
+void AnimationSystem::setTrajectoryRecorder(TrajectoryRecorder* recorder)
+{
+	m_trajectoryRecorder = recorder;
+}
+
+void AnimationSystem::setStateStorage(StateStorage storage)
+{
+	if (storage == m_stateStorage) return;
+
+	// Leaving the SoA mode makes the registry authoritative again
+	if (m_stateStorage == StateStorage::StructureOfArrays) synchronizeRegistry();
+	m_stateStorage = storage;
+}
+
+AnimationSystem::StateStorage AnimationSystem::stateStorage() const
+{
+	return m_stateStorage;
+}
+
+void AnimationSystem::synchronizeRegistry()
+{
+	if (m_storeValid && m_store.isConsistentWith(m_ecs)) m_store.scatter(m_ecs);
+}
+
+void AnimationSystem::invalidateStateStore()
+{
+	m_storeValid = false;
+}
+
+const EntityComponentSystem& AnimationSystem::entityComponentSystem() const
+{
+	return m_ecs;
+}
+
+const std::vector<RenderData*>& AnimationSystem::renderComponents() const
+{
+	return m_store.render.components;
+}
+
+WorkerPool& AnimationSystem::workerPool()
+{
+	return m_ecs.workerPool();
+}
+
+void AnimationSystem::setIntegrationScheme(IntegrationScheme scheme)
+{
+	if (scheme != m_integrator->scheme()) setIntegrator(Integrator::create(scheme));
+}
+
+IntegrationScheme AnimationSystem::integrationScheme() const
+{
+	return m_integrator->scheme();
+}
+
+void AnimationSystem::setIntegrator(std::unique_ptr<Integrator> integrator)
+{
+	m_integrator = std::move(integrator);
+	if (m_storeValid) m_integrator->resize(m_store);
+}
+
+Integrator& AnimationSystem::integrator()
+{
+	return *m_integrator;
+}
+
+void AnimationSystem::setSubstepCount(std::size_t substepCount)
+{
+	m_substepCount = std::max<std::size_t>(substepCount, 1);
+}
+
+std::size_t AnimationSystem::substepCount() const
+{
+	return m_substepCount;
+}
+
+void AnimationSystem::setSleepSettings(const SleepController::Settings& settings)
+{
+	m_sleepController.setSettings(settings);
+}
+
+const SleepController::Settings& AnimationSystem::sleepSettings() const
+{
+	return m_sleepController.settings();
+}
+
+const SleepController& AnimationSystem::sleepController() const
+{
+	return m_sleepController;
+}
+
+void AnimationSystem::wakeUp(EntityType entity)
+{
+	// Clearing the flag of a single body wakes up its whole island before the next timestep
+	const auto body = m_store.bodyIndex(entity);
+	if (body.translational != BodyStateStore::invalidIndex) m_store.translational.sleeping[body.translational] = 0;
+	if (body.rotational != BodyStateStore::invalidIndex) m_store.rotational.sleeping[body.rotational] = 0;
+
+	if (m_ecs.has<TranslationalAnimatedBody>(entity)) m_ecs.get<TranslationalAnimatedBody>(entity).sleeping = false;
+	if (m_ecs.has<RotationalAnimatedBody>(entity)) m_ecs.get<RotationalAnimatedBody>(entity).sleeping = false;
+}
+
+void AnimationSystem::setBroadPhaseSettings(const BroadPhase::Settings& settings)
+{
+	m_broadPhase.setSettings(settings);
+}
+
+const BroadPhase& AnimationSystem::broadPhase() const
+{
+	return m_broadPhase;
+}
+
+void AnimationSystem::setNarrowPhaseSettings(const NarrowPhase::Settings& settings)
+{
+	m_narrowPhase.setSettings(settings);
+}
+
+const NarrowPhase& AnimationSystem::narrowPhase() const
+{
+	return m_narrowPhase;
+}
+
+void AnimationSystem::setContactSolverSettings(const ContactSolver::Settings& settings)
+{
+	m_contactSolver.setSettings(settings);
+}
+
+const ContactSolver::Settings& AnimationSystem::contactSolverSettings() const
+{
+	return m_contactSolver.settings();
+}
+
+const ContactSolver& AnimationSystem::contactSolver() const
+{
+	return m_contactSolver;
+}
+
+void AnimationSystem::setIslandSettings(const SimulationIslands::Settings& settings)
+{
+	m_islands.setSettings(settings);
+}
+
+const SimulationIslands::Settings& AnimationSystem::islandSettings() const
+{
+	return m_islands.settings();
+}
+
+const SimulationIslands& AnimationSystem::islands() const
+{
+	return m_islands;
+}
+
+void AnimationSystem::setParallelJointForces(bool enabled)
+{
+	m_parallelJointForces = enabled;
+}
+
+bool AnimationSystem::parallelJointForces() const
+{
+	return m_parallelJointForces;
+}
 
-	// Integrate equations of angular motion
-	for (auto rotationalEntity : m_ecs.view<RotationalAnimatedBody>()) {
-		auto& rotatedBody = m_ecs.get<RotationalAnimatedBody>(rotationalEntity);
-
-		if (!rotatedBody.sleeping) {
-			if (rotatedBody.prinicipalInertia.sum() > 0) {
-				const auto angularAcceleration = rotatedBody.globalInverseInertiaMatrix
-													* (rotatedBody.externalTorque 
-														- (rotatedBody.state.angularVelocity.cross(rotatedBody.globalInertiaMatrix
-																								   * rotatedBody.state.angularVelocity)
-														   )
-													   );
-				rotatedBody.state.angularVelocity += dt*angularAcceleration;
+void AnimationSystem::buildTaskGraphs()
+{
+	// Tasks are added in the order of the former serial phases, the graph only reorders tasks without conflicts
+	const auto translationalCount = [this]() { return m_store.translational.size(); };
+	const auto rotationalCount = [this]() { return m_store.rotational.size(); };
+	const auto jointCount = [this]() { return m_store.joints.size(); };
+
+	// Reset forces for particles, the state of sleeping bodies does not change
+	m_derivedStateGraph.addParallelTask<Eigen::Vector3d>("Reset forces",
+		TranslationalState | SleepingFlags, TranslationalForces, translationalCount,
+		[this](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				if (!m_store.translational.sleeping[i]) updateStaticExternalForces(i);
+			}
+		});
+
+	// Update the quaternions and rotation matrices of rigid bodies and reset torques
+	m_derivedStateGraph.addParallelTask<Eigen::Matrix3d>("Update rotations",
+		SleepingFlags, RotationalState | RotationalDerivedState | RotationalTorques, rotationalCount,
+		[this](std::size_t begin, std::size_t end) {
+			// The batched kernels are called for each run of awake bodies
+			const auto& sleeping = m_store.rotational.sleeping;
+			std::size_t first = begin;
+			while (first < end) {
+				if (sleeping[first]) {
+					first++;
+					continue;
+				}
+
+				std::size_t last = first + 1;
+				while (last < end && !sleeping[last]) last++;
+
+				updateRotations(first, last);
+				updateInertias(first, last);
+				for (std::size_t i = first; i < last; i++) updateStaticExternalTorque(i);
+				first = last;
 			}
+		});
+
+	// Connector positions/velocities depend on the rotation matrices, but not on the forces
+	m_derivedStateGraph.addParallelTask<std::pair<Connector, Connector>>("Update connectors",
+		TranslationalState | RotationalState | RotationalDerivedState | SleepingFlags, Connectors, jointCount,
+		[this](std::size_t begin, std::size_t end) {
+			auto& joints = m_store.joints;
+			for (std::size_t j = begin; j < end; j++) {
+				if (joints.sleeping[j]) continue;
+				updateConnectorPositionVelocity(joints.parents[j].first, joints.connectors[j].first);
+				updateConnectorPositionVelocity(joints.parents[j].second, joints.connectors[j].second);
+			}
+		});
+
+	constexpr TaskGraph::Access bodyState = TranslationalState | TranslationalForces | RotationalState
+		| RotationalDerivedState | RotationalTorques | SleepingFlags | Connectors;
+
+	m_outputGraph.addParallelTask<RenderData>("Update render data",
+		bodyState, RenderComponents, [this]() { return m_store.render.size(); },
+		[this](std::size_t begin, std::size_t end) { updateRenderData(begin, end); });
+
+	// The registry is only written back if it is authoritative
+	const auto scatterCount = [this](std::size_t count) { return (m_stateStorage == StateStorage::Registry) ? count : 0; };
+	m_outputGraph.addParallelTask<TranslationalAnimatedBody>("Write back translational bodies",
+		bodyState, RegistryTranslationalBodies, [=]() { return scatterCount(translationalCount()); },
+		[this](std::size_t begin, std::size_t end) { m_store.scatterTranslational(m_ecs, begin, end); });
+	m_outputGraph.addParallelTask<RotationalAnimatedBody>("Write back rotational bodies",
+		bodyState, RegistryRotationalBodies, [=]() { return scatterCount(rotationalCount()); },
+		[this](std::size_t begin, std::size_t end) { m_store.scatterRotational(m_ecs, begin, end); });
+	m_outputGraph.addParallelTask<Joint>("Write back joints",
+		bodyState, RegistryJoints, [=]() { return scatterCount(jointCount()); },
+		[this](std::size_t begin, std::size_t end) { m_store.scatterJoints(m_ecs, begin, end); });
+
+	m_outputGraph.addTask("Record trajectory", bodyState, TrajectoryFrames, [this]() {
+		if (m_trajectoryRecorder) m_trajectoryRecorder->onTimestep(m_store, m_time);
+	});
+}
 
-			const auto& quat = rotatedBody.state.rotation;
-			const auto halfAngularVelocity = 0.5*rotatedBody.state.angularVelocity;
-			const auto quatChange = Eigen::Quaterniond(0, 
-													   halfAngularVelocity.x(), 
-													   halfAngularVelocity.y(), 
-													   halfAngularVelocity.z())*quat;
-
-			rotatedBody.state.rotation = Eigen::Quaterniond(
-				quat.w() + dt*quatChange.w(),
-				quat.x() + dt*quatChange.x(),
-				quat.y() + dt*quatChange.y(),
-				quat.z() + dt*quatChange.z()
-			);
-		}
+void AnimationSystem::rebuildStore()
+{
+	m_store.rebuild(m_ecs);
+	m_storeValid = true;
+
+	// Scratch state of the integrator, the islands and the collision phases only change with the bodies, joints and colliders
+	m_integrator->resize(m_store);
+	m_sleepController.resize(m_store);
+	m_broadPhase.resize(m_store);
+	m_narrowPhase.resize(m_store);
+	m_contactSolver.resize(m_store);
+	m_islands.resize(m_store);
+	buildConnectorRows();
+}
+
+void AnimationSystem::synchronizeStore()
+{
+	if (!m_storeValid || !m_store.isConsistentWith(m_ecs)) {
+		rebuildStore();
+	} else if (m_stateStorage == StateStorage::Registry && !m_store.gather(m_ecs)) {
+		// Edited connector parents or collider shapes invalidate the data derived from them
+		rebuildStore();
 	}
+}
 
-	prepareNextTimestep();
+BodyStateStore& AnimationSystem::bodyState()
+{
+	return m_store;
+}
 
-	m_time += dt;
+void AnimationSystem::computeForces()
+{
+	const auto previousPhase = switchPhase(TimestepPhase::JointForces);
+	computeJointForces();
+	switchPhase(previousPhase);
 }
 
-void AnimationSystem::prepareNextTimestep()
+void AnimationSystem::buildConnectorRows()
 {
-	// Reset forces for particles
-	for (auto translatedEntity : m_ecs.view<TranslationalAnimatedBody>()) {
-		auto& translatedBody = m_ecs.get<TranslationalAnimatedBody>(translatedEntity);
-		updateStaticExternalForces(translatedBody);
-	}
+	const auto& parents = m_store.joints.parents;
+	m_jointForces.resize(parents.size());
+
+	// Count the connectors of every body, then fill the rows in joint order
+	const auto build = [&](ConnectorRows& rows, std::size_t bodyCount, std::uint32_t BodyStateStore::BodyIndex::* index) {
+		rows.offsets.assign(bodyCount + 1, 0);
+		for (const auto& joint : parents) {
+			if (joint.first.*index != BodyStateStore::invalidIndex) rows.offsets[joint.first.*index + 1]++;
+			if (joint.second.*index != BodyStateStore::invalidIndex) rows.offsets[joint.second.*index + 1]++;
+		}
+		for (std::size_t i = 0; i < bodyCount; i++) rows.offsets[i + 1] += rows.offsets[i];
+
+		rows.connectors.resize(rows.offsets.back());
+		std::vector<std::uint32_t> fill(rows.offsets.begin(), rows.offsets.end() - 1);
+		for (std::size_t j = 0; j < parents.size(); j++) {
+			const auto connector = static_cast<std::uint32_t>(2*j);
+			if (parents[j].first.*index != BodyStateStore::invalidIndex) rows.connectors[fill[parents[j].first.*index]++] = connector;
+			if (parents[j].second.*index != BodyStateStore::invalidIndex) rows.connectors[fill[parents[j].second.*index]++] = connector + 1;
+		}
+	};
 
-	// Update the quaternions and rotation matrices of rigid bodies and reset forces
-	for (auto rotatedBodyEntity : m_ecs.view<RotationalAnimatedBody>()) {
-		auto& rotatedBody = m_ecs.get<RotationalAnimatedBody>(rotatedBodyEntity);
+	build(m_translationalConnectors, m_store.translational.size(), &BodyStateStore::BodyIndex::translational);
+	build(m_rotationalConnectors, m_store.rotational.size(), &BodyStateStore::BodyIndex::rotational);
+}
 
-		updateRotation(rotatedBody);
-		updateInertia(rotatedBody);
-		updateStaticExternalTorque(rotatedBody);
+void AnimationSystem::computeJointForces()
+{
+	if (useIslandJointForces()) {
+		computeIslandJointForces();
+		return;
 	}
+	if (m_parallelJointForces && m_store.joints.size() >= minParallelJointCount) {
+		computeParallelJointForces();
+		return;
+	}
+
+	// Serial accumulation in joint order, the other paths produce the same sums for the dynamic bodies
+	for (std::size_t j = 0; j < m_store.joints.size(); j++) accumulateJointForce(j, false);
+}
 
-	// Loop over all joints to update connector positions/velocities
-	for (auto jointEntity : m_ecs.view<Joint>()) {
-		auto& joint = m_ecs.get<Joint>(jointEntity);
-		updateConnectorPositionVelocity(m_ecs, joint.connectors.first);
-		updateConnectorPositionVelocity(m_ecs, joint.connectors.second);
+bool AnimationSystem::useIslandJointForces() const
+{
+	const auto& islands = m_islands.solverIslands();
+	if (!m_islands.settings().enabled || islands.size() < 2) return false;
+
+	// A dominating island would serialize the accumulation, the per body reduction scales better in this case
+	std::size_t jointCount = 0;
+	std::size_t largestJointCount = 0;
+	for (const auto island : islands) {
+		const auto islandJointCount = static_cast<std::size_t>(m_islands.jointsEnd(island) - m_islands.jointsBegin(island));
+		jointCount += islandJointCount;
+		largestJointCount = std::max(largestJointCount, islandJointCount);
 	}
+	return 2*largestJointCount <= jointCount;
+}
+
+void AnimationSystem::computeIslandJointForces()
+{
+	// Every island accumulates directly into the store in joint order, so the forces do not depend on the number of threads
+	const auto& islands = m_islands.solverIslands();
+	workerPool().run(islands.size(), [&](std::size_t i) {
+		for (auto j = m_islands.jointsBegin(islands[i]); j != m_islands.jointsEnd(islands[i]); ++j) accumulateJointForce(*j, true);
+	});
+}
+
+void AnimationSystem::computeParallelJointForces()
+{
+	auto& pool = workerPool();
+	const auto& joints = m_store.joints;
+
+	pool.parallelFor<Eigen::Vector3d>(0, joints.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t j = begin; j < end; j++) {
+			if (!joints.sleeping[j]) m_jointForces[j] = jointForce(j);
+		}
+	});
+
+	// Every body adds the forces of its connectors in joint order, i.e. in the order of the serial accumulation
+	const auto connectorForce = [&](std::uint32_t connector) {
+		const auto& force = m_jointForces[connector / 2];
+		return ((connector % 2 == 0) ? force : (-force).eval());
+	};
+
+	const auto& translationalRows = m_translationalConnectors;
+	pool.parallelFor<Eigen::Vector3d>(0, m_store.translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		auto& forces = m_store.translational.externalForce;
+		for (std::size_t i = begin; i < end; i++) {
+			for (std::uint32_t c = translationalRows.offsets[i]; c < translationalRows.offsets[i + 1]; c++) {
+				const auto connector = translationalRows.connectors[c];
+				if (!joints.sleeping[connector / 2]) forces[i] += connectorForce(connector);
+			}
+		}
+	});
+
+	const auto& rotationalRows = m_rotationalConnectors;
+	pool.parallelFor<Eigen::Vector3d>(0, m_store.rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		auto& torques = m_store.rotational.externalTorque;
+		for (std::size_t i = begin; i < end; i++) {
+			const auto& rotationMatrix = m_store.rotational.rotationMatrix[i];
+			for (std::uint32_t c = rotationalRows.offsets[i]; c < rotationalRows.offsets[i + 1]; c++) {
+				const auto connector = rotationalRows.connectors[c];
+				if (joints.sleeping[connector / 2]) continue;
+
+				const auto& connectors = joints.connectors[connector / 2];
+				const auto& localPosition = ((connector % 2 == 0) ? connectors.first : connectors.second).localPosition;
+				torques[i] += (rotationMatrix*localPosition).cross(connectorForce(connector));
+			}
+		}
+	});
+}
 
-	// Update render data (i.e. positions) of entities
-	for (auto renderEntity : m_ecs.view<RenderData>()) {
-		auto& renderData = m_ecs.get<RenderData>(renderEntity);
-		updateRenderData(m_ecs, renderEntity, renderData);
+Eigen::Vector3d AnimationSystem::jointForce(std::size_t j) const
+{
+	const auto& joints = m_store.joints;
+	const auto& connectors = joints.connectors[j];
+
+	if (auto dampedSpring = common::variant::get_if<Joint::DampedSpring>(&joints.properties[j])) {
+		Eigen::Vector3d distance = connectors.first.globalPosition - connectors.second.globalPosition;
+		Eigen::Vector3d velocityDifference = connectors.first.globalVelocity - connectors.second.globalVelocity;
+		return -(dampedSpring->elasticity*(distance.norm() - dampedSpring->restLength)
+				 + dampedSpring->damping*(velocityDifference.dot(distance)))*distance.normalized();
 	}
+
+	return Eigen::Vector3d::Zero();
+}
+
+void AnimationSystem::accumulateJointForce(std::size_t j, bool dynamicOnly)
+{
+	auto& joints = m_store.joints;
+	if (joints.sleeping[j]) return;
+
+	const auto& connectors = joints.connectors[j];
+	const auto& parents = joints.parents[j];
+
+	const Eigen::Vector3d firstForce = jointForce(j);
+	applyForce(parents.first, connectors.first, firstForce, dynamicOnly);
+	applyForce(parents.second, connectors.second, -firstForce, dynamicOnly);
 }
 
-void AnimationSystem::updateRotation(RotationalAnimatedBody& rotatedBody)
+void AnimationSystem::updateDerivedState()
 {
-	// Normalize quaternion and update rotation matrix
-	rotatedBody.state.rotation.normalize();
-	rotatedBody.rotationMatrix = rotatedBody.state.rotation.matrix();
+	const auto previousPhase = switchPhase(TimestepPhase::DerivedState);
+	m_derivedStateGraph.run(workerPool());
+	switchPhase(previousPhase);
 }
 
-void AnimationSystem::updateInertia(RotationalAnimatedBody& rotatedBody)
+void AnimationSystem::updateRotations(std::size_t begin, std::size_t end)
+{
+	// Normalize quaternions and update rotation matrices
+	auto& bodies = m_store.rotational;
+	RotationKernels::updateRotationMatrices(end - begin, &bodies.rotation[begin], &bodies.rotationMatrix[begin]);
+}
+
+void AnimationSystem::updateInertias(std::size_t begin, std::size_t end)
 {
 	// Compute transformed inertia matrices
-	if (rotatedBody.prinicipalInertia.sum() > 0) {
-		rotatedBody.globalInertiaMatrix =
-			(rotatedBody.rotationMatrix * rotatedBody.prinicipalInertia.asDiagonal()) * rotatedBody.rotationMatrix.transpose();
-		rotatedBody.globalInverseInertiaMatrix =
-			(rotatedBody.rotationMatrix * rotatedBody.prinicipalInertia.cwiseInverse().asDiagonal()) * rotatedBody.rotationMatrix.transpose();
+	auto& bodies = m_store.rotational;
+	RotationKernels::updateInertiaMatrices(end - begin, &bodies.prinicipalInertia[begin], &bodies.rotationMatrix[begin],
+										   &bodies.globalInertiaMatrix[begin], &bodies.globalInverseInertiaMatrix[begin]);
+}
+
+void AnimationSystem::updateStaticExternalForces(std::size_t i)
+{
+	auto& bodies = m_store.translational;
+	bodies.externalForce[i] = Eigen::Vector3d(0.0, -9.81 * bodies.mass[i], 0.0);
+}
+
+void AnimationSystem::updateStaticExternalTorque(std::size_t i)
+{
+	m_store.rotational.externalTorque[i] = Eigen::Vector3d(0.0, 0.0, 0.0);
+}
+
+TimestepPhase AnimationSystem::switchPhase(TimestepPhase phase)
+{
+	const auto now = Clock::now();
+	m_timings[m_phase] += std::chrono::duration<double>(now - m_phaseStart).count();
+	m_phaseStart = now;
+
+#ifdef PHYANI_TRACING
+	// Every continuous run of a phase is a zone, tracing enabled during a timestep starts with the next one
+	if (m_tracePhaseStart != 0) {
+		const auto ticks = Trace::now();
+		Trace::record(TimestepTimings::phaseName(m_phase), m_tracePhaseStart, ticks);
+		m_tracePhaseStart = ticks;
 	}
+#endif
+
+	const auto previousPhase = m_phase;
+	m_phase = phase;
+	return previousPhase;
 }
 
-void AnimationSystem::updateStaticExternalForces(TranslationalAnimatedBody& body)
+void AnimationSystem::detectCollisions(double dt)
 {
-	body.externalForce = Eigen::Vector3d(0.0, -9.81 * body.mass, 0.0);
+	m_broadPhase.update(m_store, workerPool(), dt);
+	m_narrowPhase.update(m_store, workerPool(), m_broadPhase.pairs());
 }
 
-void AnimationSystem::updateStaticExternalTorque(RotationalAnimatedBody& body)
+void AnimationSystem::solveContacts(double dt)
 {
-	body.externalTorque = Eigen::Vector3d(0.0, 0.0, 0.0);
+	m_islands.build(m_store, m_narrowPhase.manifolds());
+
+	// The velocities and positions changed, so the connectors and rotation matrices have to be updated
+	if (m_contactSolver.solve(m_store, m_narrowPhase.manifolds(), m_islands, workerPool(), dt)) updateDerivedState();
+
+	// Sleeping bodies at contacts that still move after the solve take part in the next timestep
+	m_sleepController.wakeUpContacts(m_store, m_narrowPhase.manifolds());
 }
 
-void AnimationSystem::updateConnectorPositionVelocity(const EntityComponentSystem& ecs, Connector& connector)
+void AnimationSystem::updateConnectorPositionVelocity(const BodyStateStore::BodyIndex& parent, Connector& connector)
 {
 	connector.globalPosition = Eigen::Vector3d(0, 0, 0);
 	connector.globalVelocity = Eigen::Vector3d(0, 0, 0);
 
-	if (ecs.has<TranslationalAnimatedBody>(connector.parentEntity)) {
-		const auto& translatedBody = ecs.get<TranslationalAnimatedBody>(connector.parentEntity);
-		connector.globalPosition += translatedBody.state.position;
-		connector.globalVelocity += translatedBody.state.linearVelocity;
-	} 
+	if (parent.translational != BodyStateStore::invalidIndex) {
+		connector.globalPosition += m_store.translational.position[parent.translational];
+		connector.globalVelocity += m_store.translational.linearVelocity[parent.translational];
+	}
+
+	if (parent.rotational != BodyStateStore::invalidIndex) {
+		const auto& rotationMatrix = m_store.rotational.rotationMatrix[parent.rotational];
+		connector.globalPosition += rotationMatrix*connector.localPosition;
+		connector.globalVelocity += m_store.rotational.angularVelocity[parent.rotational].cross(rotationMatrix*connector.localPosition);
+	}
+}
+
+void AnimationSystem::applyForce(const BodyStateStore::BodyIndex& parent, const Connector& connector, const Eigen::Vector3d& force, bool dynamicOnly)
+{
+	// Accumulates the force of a connector into the store -> only thread safe for joints acting on disjoint bodies
+	if (parent.translational != BodyStateStore::invalidIndex
+		&& !(dynamicOnly && !m_islands.isDynamicTranslational(parent.translational))) {
+		m_store.translational.externalForce[parent.translational] += force;
+	}
 
-	if (ecs.has<RotationalAnimatedBody>(connector.parentEntity)) {
-		const auto& rotatedBody = ecs.get<RotationalAnimatedBody>(connector.parentEntity);
-		connector.globalPosition += rotatedBody.rotationMatrix*connector.localPosition;
-		connector.globalVelocity += rotatedBody.state.angularVelocity.cross(rotatedBody.rotationMatrix*connector.localPosition);
+	if (parent.rotational != BodyStateStore::invalidIndex
+		&& !(dynamicOnly && !m_islands.isDynamicRotational(parent.rotational))) {
+		const auto& rotationMatrix = m_store.rotational.rotationMatrix[parent.rotational];
+		m_store.rotational.externalTorque[parent.rotational] += (rotationMatrix*connector.localPosition).cross(force);
 	}
 }
 
-void AnimationSystem::updateRenderData(const EntityComponentSystem& ecs, EntityType entity, RenderData& renderData)
+void AnimationSystem::updateRenderData()
 {
-	if (ecs.has<TranslationalAnimatedBody>(entity)) updateRenderData(renderData, ecs.get<TranslationalAnimatedBody>(entity));
-	if (ecs.has<RotationalAnimatedBody>(entity)) updateRenderData(renderData, ecs.get<RotationalAnimatedBody>(entity));
-	if (ecs.has<Joint>(entity)) updateRenderData(renderData, ecs.get<Joint>(entity));
+	workerPool().parallelFor<RenderData>(0, m_store.render.size(), 0, [this](std::size_t begin, std::size_t end) {
+		updateRenderData(begin, end);
+	});
 }
 
-void AnimationSystem::updateRenderData(RenderData& renderData, const TranslationalAnimatedBody& body)
+void AnimationSystem::updateRenderData(std::size_t begin, std::size_t end)
 {
-	if (auto cuboidData = common::variant::get_if<RenderData::Cuboid>(&renderData.properties)) {
-		cuboidData->position = body.state.position.cast<float>();
+	// The store is consistent with the registry during the timestep, so the component addresses are valid
+	for (std::size_t i = begin; i < end; i++) {
+		auto& renderData = *m_store.render.components[i];
+
+		// Render data of bodies and joints that were already sleeping during the last update is still valid
+		const bool sleeping = isRenderDataSleeping(i);
+		if (!(sleeping && renderData.sleeping)) updateRenderData(renderData, i);
+		renderData.sleeping = sleeping;
 	}
 }
 
-void AnimationSystem::updateRenderData(RenderData& renderData, const RotationalAnimatedBody& body)
+bool AnimationSystem::isRenderDataSleeping(std::size_t i) const
 {
-	if (auto cuboidData = common::variant::get_if<RenderData::Cuboid>(&renderData.properties)) {
-		cuboidData->rotation = body.state.rotation.cast<float>();
-	}
+	// An entity is sleeping if all of its bodies and its joint are sleeping
+	const auto& body = m_store.render.bodies[i];
+	const auto joint = m_store.render.joints[i];
+	constexpr auto invalidIndex = BodyStateStore::invalidIndex;
+
+	if (body.translational == invalidIndex && body.rotational == invalidIndex && joint == invalidIndex) return false;
+	return (body.translational == invalidIndex || m_store.translational.sleeping[body.translational])
+		&& (body.rotational == invalidIndex || m_store.rotational.sleeping[body.rotational])
+		&& (joint == invalidIndex || m_store.joints.sleeping[joint]);
 }
 
-void AnimationSystem::updateRenderData(RenderData& renderData, const Joint& joint)
+void AnimationSystem::updateRenderData(RenderData& renderData, std::size_t i)
 {
+	const auto& body = m_store.render.bodies[i];
+	const auto joint = m_store.render.joints[i];
+
+	if (auto cuboidData = common::variant::get_if<RenderData::Cuboid>(&renderData.properties)) {
+		if (body.translational != BodyStateStore::invalidIndex)
+			cuboidData->position = m_store.translational.position[body.translational].cast<float>();
+		if (body.rotational != BodyStateStore::invalidIndex)
+			cuboidData->rotation = m_store.rotational.rotation[body.rotational].cast<float>();
+	}
+
 	if (auto jointData = common::variant::get_if<RenderData::Joint>(&renderData.properties)) {
-		jointData->connectorPositions.first = joint.connectors.first.globalPosition.cast<float>();
-		jointData->connectorPositions.second = joint.connectors.second.globalPosition.cast<float>();
+		if (joint != BodyStateStore::invalidIndex) {
+			const auto& connectors = m_store.joints.connectors[joint];
+			jointData->connectorPositions.first = connectors.first.globalPosition.cast<float>();
+			jointData->connectorPositions.second = connectors.second.globalPosition.cast<float>();
+		}
 	}
 }
@@ -1,32 +1,226 @@
 ﻿#pragma once
 
+#include <chrono>
+#include <memory>
+
 #include "EntityComponentSystem.h"
+#include "BodyStateStore.h"
+#include "BroadPhase.h"
+#include "ContactSolver.h"
+#include "Integrator.h"
+#include "NarrowPhase.h"
+#include "SimulationIslands.h"
+#include "SleepController.h"
+#include "TaskGraph.h"
+#include "TimestepStatistics.h"
+#include "Trajectory.h"
 
 // TODO: Check usage of chrono data type for time
 
-class AnimationSystem
+class AnimationSystem : private IntegrationTarget
 {
 public:
+	//! Selects which data is authoritative for the body state during timestepping.
+	enum class StateStorage
+	{
+		//! The registry components are authoritative, the state is gathered from and scattered to them every timestep.
+		Registry,
+		//! The structure-of-arrays store is authoritative, the registry components are only updated on request.
+		StructureOfArrays
+	};
+
 	AnimationSystem(EntityComponentSystem& ecs);
 
 	void initialize();
 	void computeTimestep(double dt);
+	//! Returns the simulated time since the start of the simulation.
+	double time() const;
+	//! Returns the durations of the phases of the last timestep.
+	const TimestepTimings& lastTimestepTimings() const;
+
+	//! Writes all bodies, joints, render data and the simulation time to a binary snapshot, see Snapshot.
+	void saveSnapshot(std::vector<char>& snapshot);
+	//! Restores the state of a snapshot and reinitializes the system, returns false if the snapshot is not compatible.
+	/*
+	 * The snapshot contains the components only. The contact manifolds with their warm starting impulses and
+	 * the resting counters of the sleep controller are reset, so a restored simulation continues exactly like
+	 * the original one only if no contacts were active and no bodies were about to fall asleep.
+	 */
+	bool loadSnapshot(const std::vector<char>& snapshot);
+
+	//! Sets the state storage backend, switching to the registry writes the current state back to the components.
+	void setStateStorage(StateStorage storage);
+	StateStorage stateStorage() const;
+
+	//! Writes the state of the structure-of-arrays store back to the components in the registry.
+	void synchronizeRegistry();
+	//! Forces a rebuild of the store from the registry, required after external changes to body components in SoA mode.
+	void invalidateStateStore();
+
+	//! Sets a recorder that is passed the state of the bodies after every timestep, may be null. The recorder is not owned.
+	void setTrajectoryRecorder(TrajectoryRecorder* recorder);
+
+	//! Returns the registry of the animated entities.
+	const EntityComponentSystem& entityComponentSystem() const;
+	//! Returns the RenderData components updated by the timesteps in the order of the registry view.
+	/*
+	 * The addresses are cached by the state store, they are valid after a timestep or initialize() until the
+	 * entities of the registry are changed.
+	 */
+	const std::vector<RenderData*>& renderComponents() const;
+	//! Returns the worker pool used for the parallel phases of the timestep, owned by the EntityComponentSystem.
+	WorkerPool& workerPool() override;
+
+	//! Replaces the integrator by one implementing the specified scheme.
+	void setIntegrationScheme(IntegrationScheme scheme);
+	IntegrationScheme integrationScheme() const;
+	//! Replaces the integrator, e.g. by a custom implementation.
+	void setIntegrator(std::unique_ptr<Integrator> integrator);
+	Integrator& integrator();
+
+	//! Sets the number of sub steps every timestep is split into, the scratch state of the integrator is allocated once per store rebuild.
+	void setSubstepCount(std::size_t substepCount);
+	std::size_t substepCount() const;
+
+	//! Sets the thresholds for the automatic deactivation of resting islands of bodies.
+	void setSleepSettings(const SleepController::Settings& settings);
+	const SleepController::Settings& sleepSettings() const;
+	const SleepController& sleepController() const;
+	//! Wakes up the island of the entity before the next timestep.
+	void wakeUp(EntityType entity);
+
+	//! Sets the margins of the enlarged boxes of the collision broad-phase.
+	void setBroadPhaseSettings(const BroadPhase::Settings& settings);
+	//! Returns the broad-phase with the overlapping pairs of colliders of the last (sub) step.
+	const BroadPhase& broadPhase() const;
+	//! Selects the algorithms of the collision narrow-phase.
+	void setNarrowPhaseSettings(const NarrowPhase::Settings& settings);
+	//! Returns the narrow-phase with the contact manifolds of the last (sub) step.
+	const NarrowPhase& narrowPhase() const;
+	//! Sets the iteration counts, position correction and friction of the contact solver.
+	void setContactSolverSettings(const ContactSolver::Settings& settings);
+	const ContactSolver::Settings& contactSolverSettings() const;
+	const ContactSolver& contactSolver() const;
+
+	//! Enables the splitting of the joints and contacts into islands that are solved in parallel.
+	void setIslandSettings(const SimulationIslands::Settings& settings);
+	const SimulationIslands::Settings& islandSettings() const;
+	//! Returns the islands of the joints and contacts of the last (sub) step.
+	const SimulationIslands& islands() const;
+
+	//! Enables the parallel accumulation of the joint forces, enabled by default.
+	/*
+	 * The forces of all joints are evaluated in parallel into a buffer, afterwards every body adds the forces
+	 * of its connectors in joint order. The sums are bit-identical to the serial accumulation in joint order
+	 * for any number of worker threads, disabling the parallel accumulation is only useful as a reference.
+	 */
+	void setParallelJointForces(bool enabled);
+	bool parallelJointForces() const;
 
 private:
+	//! Minimum number of joints for the parallel force accumulation, smaller counts are accumulated serially.
+	static constexpr std::size_t minParallelJointCount = 256;
+
+	//! Data read and written by the tasks of the task graphs of the timestep.
+	enum SimulationData : TaskGraph::Access
+	{
+		//! Masses, positions and linear velocities.
+		TranslationalState = 1 << 0,
+		TranslationalForces = 1 << 1,
+		//! Rotations, angular velocities and principal inertias.
+		RotationalState = 1 << 2,
+		//! Rotation and global inertia matrices.
+		RotationalDerivedState = 1 << 3,
+		RotationalTorques = 1 << 4,
+		SleepingFlags = 1 << 5,
+		Connectors = 1 << 6,
+		RenderComponents = 1 << 7,
+		//! Body and joint components in the registry.
+		RegistryTranslationalBodies = 1 << 8,
+		RegistryRotationalBodies = 1 << 9,
+		RegistryJoints = 1 << 10,
+		TrajectoryFrames = 1 << 11
+	};
+
+	//! Connectors attached to the bodies in compressed row format, ordered by joint. Connectors are encoded as 2*joint + side.
+	struct ConnectorRows
+	{
+		std::vector<std::uint32_t> offsets;
+		std::vector<std::uint32_t> connectors;
+	};
+
 	EntityComponentSystem& m_ecs;
+	BodyStateStore m_store;
+
+	StateStorage m_stateStorage;
+	bool m_storeValid;
+
+	bool m_parallelJointForces;
+	//! Force of every joint on its first connector, the second connector receives the negated force.
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_jointForces;
+	ConnectorRows m_translationalConnectors;
+	ConnectorRows m_rotationalConnectors;
+
+	std::unique_ptr<Integrator> m_integrator;
+	std::size_t m_substepCount;
+
+	SleepController m_sleepController;
+	BroadPhase m_broadPhase;
+	NarrowPhase m_narrowPhase;
+	ContactSolver m_contactSolver;
+	SimulationIslands m_islands;
+
+	TrajectoryRecorder* m_trajectoryRecorder;
+
+	//! Update of the derived state after every integrator stage and contact solve.
+	TaskGraph m_derivedStateGraph;
+	//! Render data, write back and trajectory recording at the end of the timestep.
+	TaskGraph m_outputGraph;
 
 	double m_time;
 
-	void prepareNextTimestep();
+	using Clock = std::chrono::steady_clock;
+	//! Timings of the current and of the last completed timestep.
+	TimestepTimings m_timings;
+	TimestepTimings m_lastTimings;
+	TimestepPhase m_phase;
+	Clock::time_point m_phaseStart;
+	//! Trace clock ticks at the start of the current phase, zero if tracing was disabled at the start of the timestep.
+	std::uint64_t m_tracePhaseStart = 0;
+
+	//! Adds the time since the last switch to the current phase and starts the specified phase, returns the previous phase.
+	TimestepPhase switchPhase(TimestepPhase phase);
+
+	void buildTaskGraphs();
+	void rebuildStore();
+	void synchronizeStore();
+
+	BodyStateStore& bodyState() override;
+	void computeForces() override;
+	void updateDerivedState() override;
+
+	void detectCollisions(double dt);
+	void solveContacts(double dt);
+
+	void buildConnectorRows();
+	void computeJointForces();
+	bool useIslandJointForces() const;
+	void computeIslandJointForces();
+	void computeParallelJointForces();
+	//! Returns the force of the joint on its first connector.
+	Eigen::Vector3d jointForce(std::size_t joint) const;
+	//! Adds the forces of the joint to its parents, forces on bodies without mass or inertia are dropped if 'dynamicOnly' is set.
+	void accumulateJointForce(std::size_t joint, bool dynamicOnly);
 
-	static void updateRotation(RotationalAnimatedBody& rigidBody);
-	static void updateInertia(RotationalAnimatedBody& rigidBody);
-	static void updateStaticExternalForces(TranslationalAnimatedBody& body);
-	static void updateStaticExternalTorque(RotationalAnimatedBody& body);
-	static void updateConnectorPositionVelocity(const EntityComponentSystem& ecs, Connector& connector);
+	void updateRotations(std::size_t rotationalBegin, std::size_t rotationalEnd);
+	void updateInertias(std::size_t rotationalBegin, std::size_t rotationalEnd);
+	void updateStaticExternalForces(std::size_t translationalIndex);
+	void updateStaticExternalTorque(std::size_t rotationalIndex);
+	void updateConnectorPositionVelocity(const BodyStateStore::BodyIndex& parent, Connector& connector);
+	void applyForce(const BodyStateStore::BodyIndex& parent, const Connector& connector, const Eigen::Vector3d& force, bool dynamicOnly);
 
-	static void updateRenderData(const EntityComponentSystem& ecs, EntityType entity, RenderData& renderData);
-	static void updateRenderData(RenderData& renderData, const TranslationalAnimatedBody& rigidBody);
-	static void updateRenderData(RenderData& renderData, const RotationalAnimatedBody& particle);
-	static void updateRenderData(RenderData& renderData, const Joint& joint);
+	void updateRenderData();
+	void updateRenderData(std::size_t renderBegin, std::size_t renderEnd);
+	bool isRenderDataSleeping(std::size_t renderIndex) const;
+	void updateRenderData(RenderData& renderData, std::size_t renderIndex);
 };
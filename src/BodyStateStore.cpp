@@ -0,0 +1,248 @@
+#include "BodyStateStore.h"
+
+#include <algorithm>
+#include <atomic>
+
+void BodyStateStore::rebuild(EntityComponentSystem& ecs)
+{
+	m_entityToBody.clear();
+
+	// Translational bodies
+	{
+		const auto view = ecs.view<TranslationalAnimatedBody>();
+		const std::size_t count = view.size();
+
+		translational.entities.clear();
+		translational.entities.reserve(count);
+
+		for (auto entity : view) {
+			m_entityToBody[entity].translational = static_cast<std::uint32_t>(translational.entities.size());
+			translational.entities.push_back(entity);
+		}
+
+		translational.sleeping.resize(count);
+		translational.mass.resize(count);
+		translational.externalForce.resize(count);
+		translational.position.resize(count);
+		translational.linearVelocity.resize(count);
+	}
+
+	// Rotational bodies
+	{
+		const auto view = ecs.view<RotationalAnimatedBody>();
+		const std::size_t count = view.size();
+
+		rotational.entities.clear();
+		rotational.entities.reserve(count);
+
+		for (auto entity : view) {
+			m_entityToBody[entity].rotational = static_cast<std::uint32_t>(rotational.entities.size());
+			rotational.entities.push_back(entity);
+		}
+
+		rotational.sleeping.resize(count);
+		rotational.prinicipalInertia.resize(count);
+		rotational.externalTorque.resize(count);
+		rotational.rotation.resize(count);
+		rotational.angularVelocity.resize(count);
+		rotational.rotationMatrix.resize(count);
+		rotational.globalInertiaMatrix.resize(count);
+		rotational.globalInverseInertiaMatrix.resize(count);
+	}
+
+	// Joints, the connectors are resolved to body indices once
+	{
+		const auto view = ecs.view<Joint>();
+		const std::size_t count = view.size();
+
+		joints.entities.clear();
+		joints.entities.reserve(count);
+		joints.parents.clear();
+		joints.parents.reserve(count);
+
+		for (auto entity : view) {
+			const auto& joint = ecs.get<Joint>(entity);
+			joints.entities.push_back(entity);
+			joints.parents.emplace_back(bodyIndex(joint.connectors.first.parentEntity),
+										bodyIndex(joint.connectors.second.parentEntity));
+		}
+
+		joints.sleeping.assign(count, 0);
+		joints.connectors.resize(count);
+		joints.properties.resize(count);
+	}
+
+	// Render data, stores the indices of the arrays that are used to update the render data
+	{
+		const auto view = ecs.view<RenderData>();
+		const std::size_t count = view.size();
+
+		render.entities.clear();
+		render.entities.reserve(count);
+		render.components.clear();
+		render.components.reserve(count);
+		render.bodies.clear();
+		render.bodies.reserve(count);
+		render.joints.clear();
+		render.joints.reserve(count);
+
+		std::unordered_map<EntityType, std::uint32_t> jointIndices;
+		for (std::size_t j = 0; j < joints.size(); j++) {
+			jointIndices[joints.entities[j]] = static_cast<std::uint32_t>(j);
+		}
+
+		colliders.entities.clear();
+		colliders.bodies.clear();
+		colliders.halfExtents.clear();
+
+		for (auto entity : view) {
+			const auto jointIndex = jointIndices.find(entity);
+			const auto body = bodyIndex(entity);
+			auto& renderData = ecs.get<RenderData>(entity);
+			render.entities.push_back(entity);
+			render.components.push_back(&renderData);
+			render.bodies.push_back(body);
+			render.joints.push_back((jointIndex != jointIndices.end()) ? jointIndex->second : invalidIndex);
+
+			// Cuboids with a rotational and translational body are colliders, particles are not
+			const auto cuboid = common::variant::get_if<RenderData::Cuboid>(&renderData.properties);
+			if (cuboid && body.translational != invalidIndex && body.rotational != invalidIndex) {
+				colliders.entities.push_back(entity);
+				colliders.bodies.push_back(body);
+				colliders.halfExtents.push_back(0.5*cuboid->edges.cast<double>());
+			}
+		}
+	}
+
+	gather(ecs);
+}
+
+namespace
+{
+	template <typename ComponentT>
+	bool matchesView(const EntityComponentSystem& ecs, const std::vector<EntityType>& entities)
+	{
+		// Equal counts are not sufficient, an entity may have been destroyed and another one created since the rebuild
+		const auto view = ecs.view<ComponentT>();
+		return view.size() == entities.size() && std::equal(view.begin(), view.end(), entities.begin());
+	}
+}
+
+bool BodyStateStore::isConsistentWith(const EntityComponentSystem& ecs) const
+{
+	return matchesView<TranslationalAnimatedBody>(ecs, translational.entities)
+		&& matchesView<RotationalAnimatedBody>(ecs, rotational.entities)
+		&& matchesView<Joint>(ecs, joints.entities)
+		&& matchesView<RenderData>(ecs, render.entities);
+}
+
+bool BodyStateStore::gather(const EntityComponentSystem& ecs)
+{
+	// The entity arrays are ordered like the views, iterating them avoids collecting the entities of the views in every step
+	auto& pool = ecs.workerPool();
+	pool.parallelFor<std::uint8_t, double, Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto& body = ecs.get<TranslationalAnimatedBody>(translational.entities[i]);
+			translational.sleeping[i] = body.sleeping;
+			translational.mass[i] = body.mass;
+			translational.externalForce[i] = body.externalForce;
+			translational.position[i] = body.state.position;
+			translational.linearVelocity[i] = body.state.linearVelocity;
+		}
+	});
+
+	pool.parallelFor<std::uint8_t, Eigen::Vector3d, Eigen::Quaterniond, Eigen::Matrix3d>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto& body = ecs.get<RotationalAnimatedBody>(rotational.entities[i]);
+			rotational.sleeping[i] = body.sleeping;
+			rotational.prinicipalInertia[i] = body.prinicipalInertia;
+			rotational.externalTorque[i] = body.externalTorque;
+			rotational.rotation[i] = body.state.rotation;
+			rotational.angularVelocity[i] = body.state.angularVelocity;
+			rotational.rotationMatrix[i] = body.rotationMatrix;
+			rotational.globalInertiaMatrix[i] = body.globalInertiaMatrix;
+			rotational.globalInverseInertiaMatrix[i] = body.globalInverseInertiaMatrix;
+		}
+	});
+
+	// The parents and half extents are resolved again, as the components may have been edited since the rebuild
+	std::atomic<bool> parentsChanged(false);
+	pool.parallelFor<std::pair<Connector, Connector>, decltype(Joint::jointProperties)>(0, joints.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto& joint = ecs.get<Joint>(joints.entities[i]);
+			joints.connectors[i] = joint.connectors;
+			joints.properties[i] = joint.jointProperties;
+
+			const std::pair<BodyIndex, BodyIndex> parents(bodyIndex(joint.connectors.first.parentEntity),
+														   bodyIndex(joint.connectors.second.parentEntity));
+			if (parents != joints.parents[i]) {
+				joints.parents[i] = parents;
+				parentsChanged.store(true, std::memory_order_relaxed);
+			}
+		}
+	});
+
+	std::atomic<bool> collidersChanged(false);
+	pool.parallelFor(0, colliders.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto cuboid = common::variant::get_if<RenderData::Cuboid>(&ecs.get<RenderData>(colliders.entities[i]).properties);
+			if (cuboid) {
+				colliders.halfExtents[i] = 0.5*cuboid->edges.cast<double>();
+			} else {
+				collidersChanged.store(true, std::memory_order_relaxed);
+			}
+		}
+	});
+
+	return !parentsChanged.load(std::memory_order_relaxed) && !collidersChanged.load(std::memory_order_relaxed);
+}
+
+void BodyStateStore::scatter(EntityComponentSystem& ecs) const
+{
+	auto& pool = ecs.workerPool();
+	pool.parallelFor<TranslationalAnimatedBody>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		scatterTranslational(ecs, begin, end);
+	});
+	pool.parallelFor<RotationalAnimatedBody>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		scatterRotational(ecs, begin, end);
+	});
+	pool.parallelFor<Joint>(0, joints.size(), 0, [&](std::size_t begin, std::size_t end) {
+		scatterJoints(ecs, begin, end);
+	});
+}
+
+void BodyStateStore::scatterTranslational(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const
+{
+	for (std::size_t i = begin; i < end; i++) {
+		auto& body = ecs.get<TranslationalAnimatedBody>(translational.entities[i]);
+		body.sleeping = translational.sleeping[i];
+		body.externalForce = translational.externalForce[i];
+		body.state.position = translational.position[i];
+		body.state.linearVelocity = translational.linearVelocity[i];
+	}
+}
+
+void BodyStateStore::scatterRotational(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const
+{
+	for (std::size_t i = begin; i < end; i++) {
+		auto& body = ecs.get<RotationalAnimatedBody>(rotational.entities[i]);
+		body.sleeping = rotational.sleeping[i];
+		body.externalTorque = rotational.externalTorque[i];
+		body.state.rotation = rotational.rotation[i];
+		body.state.angularVelocity = rotational.angularVelocity[i];
+		body.rotationMatrix = rotational.rotationMatrix[i];
+		body.globalInertiaMatrix = rotational.globalInertiaMatrix[i];
+		body.globalInverseInertiaMatrix = rotational.globalInverseInertiaMatrix[i];
+	}
+}
+
+void BodyStateStore::scatterJoints(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const
+{
+	for (std::size_t i = begin; i < end; i++) ecs.get<Joint>(joints.entities[i]).connectors = joints.connectors[i];
+}
+
+BodyStateStore::BodyIndex BodyStateStore::bodyIndex(EntityType entity) const
+{
+	const auto it = m_entityToBody.find(entity);
+	return (it != m_entityToBody.end()) ? it->second : BodyIndex();
+}
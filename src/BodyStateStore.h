@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include "EntityComponentSystem.h"
+#include "WorkerPool.h"
+
+//! Structure-of-arrays mirror of the animated bodies, joints and render data of an EntityComponentSystem.
+/*
+ * Every array of a group is indexed by the same dense index. The order of the indices corresponds to the
+ * iteration order of the respective component view of the registry at the time of the last rebuild,
+ * which allows gathering and scattering to stream linearly over both the arrays and the component pools.
+ * The hot per step state (positions, velocities, forces) is stored separately from static and cold data.
+ */
+class BodyStateStore
+{
+public:
+	//! Marker for a missing index, e.g. a connector parent without rotational body.
+	static constexpr std::uint32_t invalidIndex = std::numeric_limits<std::uint32_t>::max();
+
+	//! Indices of the body arrays associated to a single entity.
+	struct BodyIndex
+	{
+		std::uint32_t translational = invalidIndex;
+		std::uint32_t rotational = invalidIndex;
+
+		bool operator==(const BodyIndex& other) const { return translational == other.translational && rotational == other.rotational; }
+		bool operator!=(const BodyIndex& other) const { return !(*this == other); }
+	};
+
+	//! Arrays start at a cache line border, so the chunks of the parallel loops writing them do not share cache lines.
+	template <typename T>
+	using aligned_vector = std::vector<T, CacheAlignedAllocator<T>>;
+
+	//! Arrays mirroring all TranslationalAnimatedBody components.
+	struct TranslationalArrays
+	{
+		std::vector<EntityType> entities;
+		aligned_vector<std::uint8_t> sleeping;
+		aligned_vector<double> mass;
+
+		aligned_vector<Eigen::Vector3d> externalForce;
+		aligned_vector<Eigen::Vector3d> position;
+		aligned_vector<Eigen::Vector3d> linearVelocity;
+
+		std::size_t size() const { return entities.size(); }
+	};
+
+	//! Arrays mirroring all RotationalAnimatedBody components.
+	struct RotationalArrays
+	{
+		std::vector<EntityType> entities;
+		aligned_vector<std::uint8_t> sleeping;
+		aligned_vector<Eigen::Vector3d> prinicipalInertia;
+
+		aligned_vector<Eigen::Vector3d> externalTorque;
+		aligned_vector<Eigen::Quaterniond> rotation;
+		aligned_vector<Eigen::Vector3d> angularVelocity;
+
+		aligned_vector<Eigen::Matrix3d> rotationMatrix;
+		aligned_vector<Eigen::Matrix3d> globalInertiaMatrix;
+		aligned_vector<Eigen::Matrix3d> globalInverseInertiaMatrix;
+
+		std::size_t size() const { return entities.size(); }
+	};
+
+	//! Arrays mirroring all Joint components.
+	struct JointArrays
+	{
+		std::vector<EntityType> entities;
+		//! Set for joints of sleeping islands, maintained by the SleepController and not mirrored to the components.
+		aligned_vector<std::uint8_t> sleeping;
+		std::vector<std::pair<BodyIndex, BodyIndex>> parents;
+		aligned_vector<std::pair<Connector, Connector>> connectors;
+		aligned_vector<decltype(Joint::jointProperties)> properties;
+
+		std::size_t size() const { return entities.size(); }
+	};
+
+	//! Collision shapes of all cuboid bodies, i.e. entities with a rotational body and cuboid render data.
+	struct ColliderArrays
+	{
+		std::vector<EntityType> entities;
+		std::vector<BodyIndex> bodies;
+		std::vector<Eigen::Vector3d> halfExtents;
+
+		std::size_t size() const { return entities.size(); }
+	};
+
+	//! Source indices of all RenderData components.
+	struct RenderArrays
+	{
+		std::vector<EntityType> entities;
+		//! Addresses of the components, the pool of the components only changes together with the view of the entities.
+		std::vector<RenderData*> components;
+		std::vector<BodyIndex> bodies;
+		std::vector<std::uint32_t> joints;
+
+		std::size_t size() const { return entities.size(); }
+	};
+
+	TranslationalArrays translational;
+	RotationalArrays rotational;
+	JointArrays joints;
+	ColliderArrays colliders;
+	RenderArrays render;
+
+	//! Rebuilds all index tables and copies the complete component data from the registry.
+	void rebuild(EntityComponentSystem& ecs);
+	//! Returns whether the bodies, joints and render entities are still the entities of the registry views in the same order.
+	/*
+	 * Compares the entity lists of all views, which is linear in the number of entities but much cheaper
+	 * than a gather. The index tables and component addresses are only valid if this returns true.
+	 */
+	bool isConsistentWith(const EntityComponentSystem& ecs) const;
+	//! Copies the component data of all bodies and joints from the registry into the arrays, requires a consistent store.
+	/*
+	 * The connector parents of the joints and the half extents of the colliders are resolved again, so edits of
+	 * the joint and render components are picked up. Returns false if a connector was attached to another body
+	 * or a collider is no cuboid anymore, data derived from the joint parents and colliders (e.g. of the
+	 * integrator or the islands) has to be rebuilt in this case.
+	 */
+	bool gather(const EntityComponentSystem& ecs);
+	//! Writes the per step state of all bodies and joints back to the components in the registry.
+	void scatter(EntityComponentSystem& ecs) const;
+	//! Writes the state of the bodies or joints in [begin, end) back to their components, ranges may be written in parallel.
+	void scatterTranslational(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const;
+	void scatterRotational(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const;
+	void scatterJoints(EntityComponentSystem& ecs, std::size_t begin, std::size_t end) const;
+
+	//! Returns the body indices of the specified entity.
+	BodyIndex bodyIndex(EntityType entity) const;
+
+private:
+	//! Body indices of all entities with at least one animated body component.
+	std::unordered_map<EntityType, BodyIndex> m_entityToBody;
+};
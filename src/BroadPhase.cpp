@@ -0,0 +1,132 @@
+#include "BroadPhase.h"
+
+#include <algorithm>
+#include <iterator>
+
+void BroadPhase::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+}
+
+const BroadPhase::Settings& BroadPhase::settings() const
+{
+	return m_settings;
+}
+
+void BroadPhase::resize(const BodyStateStore& store)
+{
+	const std::size_t colliderCount = store.colliders.size();
+
+	// The proxies are created by the next update
+	m_tree.clear();
+	m_proxies.assign(colliderCount, DynamicAabbTree::nullNode);
+	m_aabbs.resize(colliderCount);
+	m_fatAabbs.resize(colliderCount);
+	m_moved.assign(colliderCount, 0);
+	m_pairs.clear();
+
+	const std::size_t pairCount = colliderCount*reservedPairsPerCollider;
+	m_movedColliders.reserve(colliderCount);
+	m_pairs.reserve(pairCount);
+	m_mergedPairs.reserve(pairCount);
+	m_taskPairs.resize((colliderCount + pairSearchGrainSize - 1) / pairSearchGrainSize);
+	for (auto& taskPairs : m_taskPairs) taskPairs.reserve(pairSearchGrainSize*reservedPairsPerCollider);
+}
+
+void BroadPhase::update(const BodyStateStore& store, WorkerPool& pool, double dt)
+{
+	const std::size_t colliderCount = store.colliders.size();
+	if (colliderCount == 0) return;
+
+	// Compute the tight boxes and check which colliders left their enlarged box
+	pool.parallelFor<Aabb>(0, colliderCount, 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t c = begin; c < end; c++) {
+			m_aabbs[c] = colliderAabb(store, c);
+			const bool moved = (m_proxies[c] == DynamicAabbTree::nullNode) || !m_fatAabbs[c].contains(m_aabbs[c]);
+			if (moved) m_fatAabbs[c] = fatAabb(store, c, m_aabbs[c], dt);
+			m_moved[c] = moved ? 1 : 0;
+		}
+	});
+
+	// The tree is modified serially
+	m_movedColliders.clear();
+	for (std::size_t c = 0; c < colliderCount; c++) {
+		if (!m_moved[c]) continue;
+
+		if (m_proxies[c] == DynamicAabbTree::nullNode) {
+			m_proxies[c] = m_tree.createProxy(m_fatAabbs[c], static_cast<std::uint32_t>(c));
+		} else {
+			m_tree.moveProxy(m_proxies[c], m_fatAabbs[c]);
+		}
+		m_movedColliders.push_back(static_cast<std::uint32_t>(c));
+	}
+
+	// Search new pairs of the moved proxies in parallel, pairs of two moved proxies are reported by the smaller index
+	const auto& translational = store.translational;
+	const auto isStatic = [&](std::uint32_t collider) {
+		return !(translational.mass[store.colliders.bodies[collider].translational] > 0);
+	};
+
+	const std::size_t taskCount = (m_movedColliders.size() + pairSearchGrainSize - 1) / pairSearchGrainSize;
+	if (m_taskPairs.size() < taskCount) m_taskPairs.resize(taskCount);
+	pool.run(taskCount, [&](std::size_t task) {
+		auto& taskPairs = m_taskPairs[task];
+		taskPairs.clear();
+
+		const std::size_t begin = task*pairSearchGrainSize;
+		const std::size_t end = std::min(begin + pairSearchGrainSize, m_movedColliders.size());
+		for (std::size_t m = begin; m < end; m++) {
+			const std::uint32_t collider = m_movedColliders[m];
+			m_tree.query(m_fatAabbs[collider], [&](std::uint32_t proxy) {
+				const std::uint32_t other = m_tree.userData(proxy);
+				if (other == collider || (m_moved[other] && other < collider)) return true;
+				if (isStatic(collider) && isStatic(other)) return true;
+
+				taskPairs.push_back({ std::min(collider, other), std::max(collider, other) });
+				return true;
+			});
+		}
+	});
+
+	// Remove pairs that stopped overlapping and merge the new pairs
+	m_pairs.erase(std::remove_if(m_pairs.begin(), m_pairs.end(), [this](const Pair& pair) {
+		return !m_fatAabbs[pair.first].overlaps(m_fatAabbs[pair.second]);
+	}), m_pairs.end());
+
+	const std::size_t existingCount = m_pairs.size();
+	for (std::size_t task = 0; task < taskCount; task++) {
+		m_pairs.insert(m_pairs.end(), m_taskPairs[task].begin(), m_taskPairs[task].end());
+	}
+	std::sort(m_pairs.begin() + existingCount, m_pairs.end());
+
+	m_mergedPairs.clear();
+	m_mergedPairs.reserve(m_pairs.size());
+	std::merge(m_pairs.begin(), m_pairs.begin() + existingCount, m_pairs.begin() + existingCount, m_pairs.end(),
+			   std::back_inserter(m_mergedPairs));
+	m_mergedPairs.erase(std::unique(m_mergedPairs.begin(), m_mergedPairs.end()), m_mergedPairs.end());
+	std::swap(m_pairs, m_mergedPairs);
+}
+
+Aabb BroadPhase::colliderAabb(const BodyStateStore& store, std::size_t collider)
+{
+	const auto& body = store.colliders.bodies[collider];
+	const auto& position = store.translational.position[body.translational];
+	const auto& rotationMatrix = store.rotational.rotationMatrix[body.rotational];
+
+	// Extents of the rotated box along the world axes
+	const Eigen::Vector3d extents = rotationMatrix.cwiseAbs()*store.colliders.halfExtents[collider];
+	return { position - extents, position + extents };
+}
+
+Aabb BroadPhase::fatAabb(const BodyStateStore& store, std::size_t collider, const Aabb& aabb, double dt) const
+{
+	const Eigen::Vector3d margin = Eigen::Vector3d::Constant(m_settings.margin);
+	Aabb fat = { aabb.min - margin, aabb.max + margin };
+
+	// Extend the box in the direction of the predicted displacement
+	const auto& body = store.colliders.bodies[collider];
+	const Eigen::Vector3d displacement = (m_settings.displacementMultiplier*dt)*store.translational.linearVelocity[body.translational];
+	fat.min += displacement.cwiseMin(0.0);
+	fat.max += displacement.cwiseMax(0.0);
+	return fat;
+}
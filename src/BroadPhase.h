@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BodyStateStore.h"
+#include "DynamicAabbTree.h"
+#include "WorkerPool.h"
+
+//! Broad-phase collision detection of the colliders of a BodyStateStore with a dynamic AABB tree.
+/*
+ * Every collider has a proxy in the tree with a box that is enlarged by a margin and the predicted
+ * displacement of the body. A proxy is only reinserted when the tight box of its collider leaves the
+ * enlarged box, new pairs are searched for the reinserted proxies only. The pair list is persistent,
+ * pairs are removed when the enlarged boxes stop overlapping. The pairs are sorted, so the output does
+ * not depend on the number of threads.
+ */
+class BroadPhase
+{
+public:
+	//! Pair of collider indices with overlapping enlarged boxes, 'first' < 'second'.
+	struct Pair
+	{
+		std::uint32_t first;
+		std::uint32_t second;
+
+		bool operator<(const Pair& other) const { return (first != other.first) ? first < other.first : second < other.second; }
+		bool operator==(const Pair& other) const { return first == other.first && second == other.second; }
+	};
+
+	struct Settings
+	{
+		//! Distance by which the boxes of the proxies are enlarged in every direction.
+		double margin = 0.05;
+		//! Factor of the displacement of the last step by which the boxes are extended in the direction of motion.
+		double displacementMultiplier = 2.0;
+	};
+
+	//! Number of pairs per collider for which the pair and contact buffers are reserved when the colliders change.
+	/*
+	 * Piles of boxes rarely exceed it, so the steps after a rebuild of the store do not allocate while
+	 * contacts are created. Larger counts are still handled, the buffers grow on demand.
+	 */
+	static constexpr std::size_t reservedPairsPerCollider = 4;
+
+	void setSettings(const Settings& settings);
+	const Settings& settings() const;
+
+	//! Recreates the proxies of all colliders of the store and reserves the pair buffers.
+	void resize(const BodyStateStore& store);
+	//! Updates the boxes of all colliders and the pair list, 'dt' is used to predict the displacement.
+	void update(const BodyStateStore& store, WorkerPool& pool, double dt);
+
+	//! Returns the current pairs, sorted by collider indices.
+	const std::vector<Pair>& pairs() const { return m_pairs; }
+	//! Returns the tight box of the collider at the last update.
+	const Aabb& aabb(std::size_t collider) const { return m_aabbs[collider]; }
+	const DynamicAabbTree& tree() const { return m_tree; }
+
+	//! Calls 'callback(collider)' for every collider whose enlarged box overlaps the box, stops if the callback returns false.
+	template <typename CallbackT>
+	void query(const Aabb& aabb, CallbackT&& callback) const
+	{
+		m_tree.query(aabb, [&](std::uint32_t proxy) { return callback(m_tree.userData(proxy)); });
+	}
+
+	//! Computes the tight box of a collider from its position, rotation matrix and half extents.
+	static Aabb colliderAabb(const BodyStateStore& store, std::size_t collider);
+
+private:
+	//! Number of moved proxies per task of the pair search.
+	static constexpr std::size_t pairSearchGrainSize = 256;
+
+	Settings m_settings;
+	DynamicAabbTree m_tree;
+
+	std::vector<std::uint32_t> m_proxies;
+	BodyStateStore::aligned_vector<Aabb> m_aabbs;
+	BodyStateStore::aligned_vector<Aabb> m_fatAabbs;
+	BodyStateStore::aligned_vector<std::uint8_t> m_moved;
+
+	std::vector<std::uint32_t> m_movedColliders;
+	std::vector<std::vector<Pair>> m_taskPairs;
+	std::vector<Pair> m_pairs;
+	std::vector<Pair> m_mergedPairs;
+
+	Aabb fatAabb(const BodyStateStore& store, std::size_t collider, const Aabb& aabb, double dt) const;
+};
@@ -0,0 +1,375 @@
+#include "ContactSolver.h"
+
+#include <algorithm>
+
+namespace
+{
+	//! Returns the inverse effective mass of the rotational body for an impulse along 'direction' at 'offset'.
+	double angularInverseMass(const Eigen::Matrix3d& inverseInertia, const Eigen::Vector3d& offset, const Eigen::Vector3d& direction)
+	{
+		return direction.dot((inverseInertia*offset.cross(direction)).cross(offset));
+	}
+}
+
+void ContactSolver::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+}
+
+const ContactSolver::Settings& ContactSolver::settings() const
+{
+	return m_settings;
+}
+
+void ContactSolver::resize(const BodyStateStore& store)
+{
+	m_initialLinearVelocity.assign(store.translational.size(), Eigen::Vector3d::Zero());
+	m_initialAngularVelocity.assign(store.rotational.size(), Eigen::Vector3d::Zero());
+	m_pseudoLinearVelocity.assign(store.translational.size(), Eigen::Vector3d::Zero());
+	m_pseudoAngularVelocity.assign(store.rotational.size(), Eigen::Vector3d::Zero());
+	m_translationalSolved.assign(store.translational.size(), 0);
+	m_rotationalSolved.assign(store.rotational.size(), 0);
+	m_solvedTranslational.clear();
+	m_solvedTranslational.reserve(store.translational.size());
+	m_solvedRotational.clear();
+	m_solvedRotational.reserve(store.rotational.size());
+	m_constraints.clear();
+	m_constraints.reserve(store.colliders.size()*BroadPhase::reservedPairsPerCollider);
+	m_islandOffsets.clear();
+	m_islandOffsets.reserve(store.rotational.size() + 1);
+	m_pointCount = 0;
+}
+
+bool ContactSolver::solve(BodyStateStore& store, std::vector<ContactManifold>& manifolds, const SimulationIslands& islands, WorkerPool& pool, double dt)
+{
+	if (!(dt > 0)) return false;
+
+	prepare(store, manifolds, islands, dt);
+	if (m_constraints.empty()) return false;
+
+	// The islands do not share movable bodies, so they are solved independently
+	pool.run(m_islandOffsets.size() - 1, [&](std::size_t island) {
+		solveIsland(store, m_islandOffsets[island], m_islandOffsets[island + 1]);
+	});
+	applyCorrections(store, pool, dt);
+
+	storeImpulses(manifolds);
+	return true;
+}
+
+std::size_t ContactSolver::constraintCount() const
+{
+	return m_pointCount;
+}
+
+void ContactSolver::prepare(const BodyStateStore& store, const std::vector<ContactManifold>& manifolds, const SimulationIslands& islands, double dt)
+{
+	const auto& translational = store.translational;
+	const auto& rotational = store.rotational;
+	const bool splitImpulse = m_settings.positionCorrection == PositionCorrection::SplitImpulse;
+	const double correctionRate = m_settings.correctionFactor/dt;
+
+	const auto inverseMass = [&](std::uint32_t i) {
+		return (!translational.sleeping[i] && translational.mass[i] > 0) ? 1.0/translational.mass[i] : 0.0;
+	};
+	const auto inverseInertia = [&](std::uint32_t i) {
+		return (!rotational.sleeping[i] && rotational.prinicipalInertia[i].sum() > 0) ? rotational.globalInverseInertiaMatrix[i]
+																					  : Eigen::Matrix3d::Zero().eval();
+	};
+	const auto markSolved = [&](std::uint32_t t, std::uint32_t r) {
+		if (!m_translationalSolved[t]) {
+			m_translationalSolved[t] = 1;
+			m_solvedTranslational.push_back(t);
+			m_initialLinearVelocity[t] = translational.linearVelocity[t];
+		}
+		if (!m_rotationalSolved[r]) {
+			m_rotationalSolved[r] = 1;
+			m_solvedRotational.push_back(r);
+			m_initialAngularVelocity[r] = rotational.angularVelocity[r];
+		}
+	};
+
+	m_constraints.resize(manifolds.size());
+	std::size_t constraintCount = 0;
+	m_pointCount = 0;
+
+	const auto prepareManifold = [&](std::uint32_t m) {
+		const auto& manifold = manifolds[m];
+		const auto& bodyA = store.colliders.bodies[manifold.colliderA];
+		const auto& bodyB = store.colliders.bodies[manifold.colliderB];
+
+		auto& constraint = m_constraints[constraintCount];
+		constraint.inverseMassA = inverseMass(bodyA.translational);
+		constraint.inverseMassB = inverseMass(bodyB.translational);
+		constraint.inverseInertiaA = inverseInertia(bodyA.rotational);
+		constraint.inverseInertiaB = inverseInertia(bodyB.rotational);
+		constraint.movableA = constraint.inverseMassA > 0 || !constraint.inverseInertiaA.isZero(0.0);
+		constraint.movableB = constraint.inverseMassB > 0 || !constraint.inverseInertiaB.isZero(0.0);
+
+		// Contacts between immovable bodies are skipped
+		if (!constraint.movableA && !constraint.movableB) return;
+		constraintCount++;
+
+		constraint.manifold = m;
+		constraint.translationalA = bodyA.translational;
+		constraint.rotationalA = bodyA.rotational;
+		constraint.translationalB = bodyB.translational;
+		constraint.rotationalB = bodyB.rotational;
+		if (constraint.movableA) markSolved(bodyA.translational, bodyA.rotational);
+		if (constraint.movableB) markSolved(bodyB.translational, bodyB.rotational);
+
+		constraint.normal = manifold.normal;
+		constraint.tangents[0] = manifold.normal.unitOrthogonal();
+		constraint.tangents[1] = manifold.normal.cross(constraint.tangents[0]);
+
+		const double linearInverseMass = constraint.inverseMassA + constraint.inverseMassB;
+		const auto effectiveMass = [&](const Eigen::Vector3d& offsetA, const Eigen::Vector3d& offsetB, const Eigen::Vector3d& direction) {
+			const double inverse = linearInverseMass
+								   + angularInverseMass(constraint.inverseInertiaA, offsetA, direction)
+								   + angularInverseMass(constraint.inverseInertiaB, offsetB, direction);
+			return (inverse > 0) ? 1.0/inverse : 0.0;
+		};
+
+		const bool warmStart = m_settings.warmStarting;
+		constraint.pointCount = manifold.pointCount;
+		constraint.centerOffsetA.setZero();
+		constraint.centerOffsetB.setZero();
+		for (std::uint32_t p = 0; p < manifold.pointCount; p++) {
+			const auto& contact = manifold.points[p];
+			auto& point = constraint.points[p];
+
+			point.offsetA = rotational.rotationMatrix[bodyA.rotational]*contact.localPositionA;
+			point.offsetB = rotational.rotationMatrix[bodyB.rotational]*contact.localPositionB;
+			point.normalMass = effectiveMass(point.offsetA, point.offsetB, constraint.normal);
+			constraint.centerOffsetA += point.offsetA;
+			constraint.centerOffsetB += point.offsetB;
+
+			// Restitution of fast approaching contacts, the Baumgarte bias is added to the same target velocity
+			const Eigen::Vector3d relativeVelocity = translational.linearVelocity[bodyB.translational]
+													 + rotational.angularVelocity[bodyB.rotational].cross(point.offsetB)
+													 - translational.linearVelocity[bodyA.translational]
+													 - rotational.angularVelocity[bodyA.rotational].cross(point.offsetA);
+			const double normalVelocity = relativeVelocity.dot(constraint.normal);
+			const double correctionVelocity = correctionRate*std::max(contact.penetration - m_settings.allowedPenetration, 0.0);
+
+			point.velocityBias = (normalVelocity < -m_settings.restitutionThreshold) ? -m_settings.restitution*normalVelocity : 0.0;
+			if (!splitImpulse) point.velocityBias = std::max(point.velocityBias, correctionVelocity);
+			point.positionBias = splitImpulse ? correctionVelocity : 0.0;
+
+			point.normalImpulse = warmStart ? contact.normalImpulse : 0.0;
+			point.pseudoImpulse = 0.0;
+		}
+		m_pointCount += manifold.pointCount;
+
+		// The friction acts at the center of the points and around the normal
+		const double pointWeight = 1.0/manifold.pointCount;
+		constraint.centerOffsetA *= pointWeight;
+		constraint.centerOffsetB *= pointWeight;
+		constraint.frictionRadius = 0.0;
+		for (std::uint32_t p = 0; p < manifold.pointCount; p++) {
+			constraint.frictionRadius += pointWeight*(constraint.points[p].offsetA - constraint.centerOffsetA).norm();
+		}
+		constraint.tangentMass[0] = effectiveMass(constraint.centerOffsetA, constraint.centerOffsetB, constraint.tangents[0]);
+		constraint.tangentMass[1] = effectiveMass(constraint.centerOffsetA, constraint.centerOffsetB, constraint.tangents[1]);
+		const double twistInverseMass = constraint.normal.dot((constraint.inverseInertiaA + constraint.inverseInertiaB)*constraint.normal);
+		constraint.twistMass = (twistInverseMass > 0) ? 1.0/twistInverseMass : 0.0;
+
+		constraint.tangentImpulse[0] = warmStart ? manifold.tangentImpulse[0] : 0.0;
+		constraint.tangentImpulse[1] = warmStart ? manifold.tangentImpulse[1] : 0.0;
+		constraint.twistImpulse = warmStart ? manifold.twistImpulse : 0.0;
+	};
+
+	// The constraints are ordered by solver island, manifolds of sleeping islands are not solved
+	m_islandOffsets.assign(1, 0);
+	for (const auto island : islands.solverIslands()) {
+		for (auto m = islands.manifoldsBegin(island); m != islands.manifoldsEnd(island); ++m) prepareManifold(*m);
+		if (constraintCount > m_islandOffsets.back()) m_islandOffsets.push_back(static_cast<std::uint32_t>(constraintCount));
+	}
+
+	m_constraints.resize(constraintCount);
+}
+
+void ContactSolver::solveIsland(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd)
+{
+	if (m_settings.warmStarting) warmStart(store, constraintBegin, constraintEnd);
+	for (std::size_t iteration = 0; iteration < m_settings.velocityIterations; iteration++) {
+		solveVelocities(store, constraintBegin, constraintEnd);
+	}
+
+	if (m_settings.positionCorrection == PositionCorrection::SplitImpulse) {
+		for (std::size_t iteration = 0; iteration < m_settings.positionIterations; iteration++) {
+			solvePositions(constraintBegin, constraintEnd);
+		}
+	}
+}
+
+void ContactSolver::warmStart(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd)
+{
+	auto& linearVelocity = store.translational.linearVelocity;
+	auto& angularVelocity = store.rotational.angularVelocity;
+
+	for (std::size_t c = constraintBegin; c < constraintEnd; c++) {
+		const auto& constraint = m_constraints[c];
+
+		// Impulse at an offset from the bodies, the twist is an additional angular impulse around the normal
+		const auto applyImpulse = [&](const Eigen::Vector3d& offsetA, const Eigen::Vector3d& offsetB, const Eigen::Vector3d& impulse,
+									  const Eigen::Vector3d& twist) {
+			if (constraint.movableA) {
+				linearVelocity[constraint.translationalA] -= constraint.inverseMassA*impulse;
+				angularVelocity[constraint.rotationalA] -= constraint.inverseInertiaA*(offsetA.cross(impulse) + twist);
+			}
+			if (constraint.movableB) {
+				linearVelocity[constraint.translationalB] += constraint.inverseMassB*impulse;
+				angularVelocity[constraint.rotationalB] += constraint.inverseInertiaB*(offsetB.cross(impulse) + twist);
+			}
+		};
+
+		for (std::uint32_t p = 0; p < constraint.pointCount; p++) {
+			const auto& point = constraint.points[p];
+			applyImpulse(point.offsetA, point.offsetB, point.normalImpulse*constraint.normal, Eigen::Vector3d::Zero());
+		}
+		const Eigen::Vector3d friction = constraint.tangentImpulse[0]*constraint.tangents[0] + constraint.tangentImpulse[1]*constraint.tangents[1];
+		applyImpulse(constraint.centerOffsetA, constraint.centerOffsetB, friction, constraint.twistImpulse*constraint.normal);
+	}
+}
+
+void ContactSolver::solveVelocities(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd)
+{
+	auto& linearVelocity = store.translational.linearVelocity;
+	auto& angularVelocity = store.rotational.angularVelocity;
+
+	for (std::size_t c = constraintBegin; c < constraintEnd; c++) {
+		auto& constraint = m_constraints[c];
+
+		// The velocities are updated in local copies, immovable bodies may be shared with other islands
+		Eigen::Vector3d linearA = linearVelocity[constraint.translationalA];
+		Eigen::Vector3d angularA = angularVelocity[constraint.rotationalA];
+		Eigen::Vector3d linearB = linearVelocity[constraint.translationalB];
+		Eigen::Vector3d angularB = angularVelocity[constraint.rotationalB];
+
+		const auto applyImpulse = [&](const Eigen::Vector3d& offsetA, const Eigen::Vector3d& offsetB, const Eigen::Vector3d& impulse) {
+			linearA -= constraint.inverseMassA*impulse;
+			angularA -= constraint.inverseInertiaA*offsetA.cross(impulse);
+			linearB += constraint.inverseMassB*impulse;
+			angularB += constraint.inverseInertiaB*offsetB.cross(impulse);
+		};
+		const auto relativeVelocity = [&](const Eigen::Vector3d& offsetA, const Eigen::Vector3d& offsetB) {
+			return Eigen::Vector3d(linearB + angularB.cross(offsetB) - linearA - angularA.cross(offsetA));
+		};
+
+		// Friction is clamped by the normal impulses of the previous iteration
+		double normalImpulse = 0.0;
+		for (std::uint32_t p = 0; p < constraint.pointCount; p++) normalImpulse += constraint.points[p].normalImpulse;
+		const double maxFriction = m_settings.friction*normalImpulse;
+		for (std::size_t k = 0; k < 2; k++) {
+			const double tangentVelocity = relativeVelocity(constraint.centerOffsetA, constraint.centerOffsetB).dot(constraint.tangents[k]);
+			const double accumulated = std::clamp(constraint.tangentImpulse[k] - constraint.tangentMass[k]*tangentVelocity, -maxFriction, maxFriction);
+			applyImpulse(constraint.centerOffsetA, constraint.centerOffsetB, (accumulated - constraint.tangentImpulse[k])*constraint.tangents[k]);
+			constraint.tangentImpulse[k] = accumulated;
+		}
+
+		const double maxTwist = constraint.frictionRadius*maxFriction;
+		const double twistVelocity = (angularB - angularA).dot(constraint.normal);
+		const double accumulatedTwist = std::clamp(constraint.twistImpulse - constraint.twistMass*twistVelocity, -maxTwist, maxTwist);
+		const Eigen::Vector3d twist = (accumulatedTwist - constraint.twistImpulse)*constraint.normal;
+		angularA -= constraint.inverseInertiaA*twist;
+		angularB += constraint.inverseInertiaB*twist;
+		constraint.twistImpulse = accumulatedTwist;
+
+		for (std::size_t pass = 0; pass < m_settings.pointPasses; pass++) {
+			for (std::uint32_t p = 0; p < constraint.pointCount; p++) {
+				auto& point = constraint.points[p];
+				const double normalVelocity = relativeVelocity(point.offsetA, point.offsetB).dot(constraint.normal);
+				const double accumulated = std::max(point.normalImpulse - point.normalMass*(normalVelocity - point.velocityBias), 0.0);
+				applyImpulse(point.offsetA, point.offsetB, (accumulated - point.normalImpulse)*constraint.normal);
+				point.normalImpulse = accumulated;
+			}
+		}
+
+		if (constraint.movableA) {
+			linearVelocity[constraint.translationalA] = linearA;
+			angularVelocity[constraint.rotationalA] = angularA;
+		}
+		if (constraint.movableB) {
+			linearVelocity[constraint.translationalB] = linearB;
+			angularVelocity[constraint.rotationalB] = angularB;
+		}
+	}
+}
+
+void ContactSolver::solvePositions(std::size_t constraintBegin, std::size_t constraintEnd)
+{
+	for (std::size_t c = constraintBegin; c < constraintEnd; c++) {
+		auto& constraint = m_constraints[c];
+
+		Eigen::Vector3d linearA = m_pseudoLinearVelocity[constraint.translationalA];
+		Eigen::Vector3d angularA = m_pseudoAngularVelocity[constraint.rotationalA];
+		Eigen::Vector3d linearB = m_pseudoLinearVelocity[constraint.translationalB];
+		Eigen::Vector3d angularB = m_pseudoAngularVelocity[constraint.rotationalB];
+
+		for (std::uint32_t p = 0; p < constraint.pointCount; p++) {
+			auto& point = constraint.points[p];
+
+			const double normalVelocity = (linearB + angularB.cross(point.offsetB) - linearA - angularA.cross(point.offsetA)).dot(constraint.normal);
+			const double accumulated = std::max(point.pseudoImpulse + point.normalMass*(point.positionBias - normalVelocity), 0.0);
+			const Eigen::Vector3d impulse = (accumulated - point.pseudoImpulse)*constraint.normal;
+			point.pseudoImpulse = accumulated;
+
+			linearA -= constraint.inverseMassA*impulse;
+			angularA -= constraint.inverseInertiaA*point.offsetA.cross(impulse);
+			linearB += constraint.inverseMassB*impulse;
+			angularB += constraint.inverseInertiaB*point.offsetB.cross(impulse);
+		}
+
+		if (constraint.movableA) {
+			m_pseudoLinearVelocity[constraint.translationalA] = linearA;
+			m_pseudoAngularVelocity[constraint.rotationalA] = angularA;
+		}
+		if (constraint.movableB) {
+			m_pseudoLinearVelocity[constraint.translationalB] = linearB;
+			m_pseudoAngularVelocity[constraint.rotationalB] = angularB;
+		}
+	}
+}
+
+void ContactSolver::applyCorrections(BodyStateStore& store, WorkerPool& pool, double dt)
+{
+	// The velocity changes and the pseudo velocities move the bodies, the pseudo velocities are discarded afterwards
+	pool.parallelFor(0, m_solvedTranslational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto t = m_solvedTranslational[i];
+			const Eigen::Vector3d velocity = (store.translational.linearVelocity[t] - m_initialLinearVelocity[t]) + m_pseudoLinearVelocity[t];
+			store.translational.position[t] += dt*velocity;
+			m_pseudoLinearVelocity[t].setZero();
+			m_translationalSolved[t] = 0;
+		}
+	});
+	pool.parallelFor(0, m_solvedRotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const auto r = m_solvedRotational[i];
+			const Eigen::Vector3d omega = (store.rotational.angularVelocity[r] - m_initialAngularVelocity[r]) + m_pseudoAngularVelocity[r];
+			auto& rotation = store.rotational.rotation[r];
+			rotation.coeffs() += (0.5*dt)*(Eigen::Quaterniond(0.0, omega.x(), omega.y(), omega.z())*rotation).coeffs();
+			rotation.normalize();
+
+			m_pseudoAngularVelocity[r].setZero();
+			m_rotationalSolved[r] = 0;
+		}
+	});
+
+	m_solvedTranslational.clear();
+	m_solvedRotational.clear();
+}
+
+void ContactSolver::storeImpulses(std::vector<ContactManifold>& manifolds) const
+{
+	for (const auto& constraint : m_constraints) {
+		auto& manifold = manifolds[constraint.manifold];
+		for (std::uint32_t p = 0; p < constraint.pointCount; p++) {
+			manifold.points[p].normalImpulse = constraint.points[p].normalImpulse;
+		}
+		manifold.tangentImpulse[0] = constraint.tangentImpulse[0];
+		manifold.tangentImpulse[1] = constraint.tangentImpulse[1];
+		manifold.twistImpulse = constraint.twistImpulse;
+	}
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "BodyStateStore.h"
+#include "NarrowPhase.h"
+#include "SimulationIslands.h"
+#include "WorkerPool.h"
+
+//! Velocity level solver of the contacts of the narrow-phase with sequential impulses.
+/*
+ * The contacts are solved with projected Gauss-Seidel iterations on the velocities after the integration
+ * step: non-penetration impulses are clamped to be positive. Friction is solved once per manifold at the
+ * center of its points, by two tangential impulses clamped to the friction coefficient times the total
+ * normal impulse and by an impulse around the normal that additionally scales with the mean distance of
+ * the points from the center. Friction per point would over-constrain the face contacts, and the
+ * sequential solve locks in opposing tangential impulses of the points that tilt resting stacks. The
+ * accumulated impulses are stored in the manifolds and applied at the start of the next step (warm
+ * starting), so resting contacts start close to the solution and stacks converge with few iterations.
+ *
+ * As the integrator already advanced the positions with the velocities before the solve, the bodies are
+ * additionally moved by the velocity changes of the solve, which corresponds to applying the contact
+ * impulses before the position update. Penetration is either removed by a Baumgarte bias on the contact
+ * velocity or by split impulses, i.e. by separate pseudo velocities that only move the bodies and do not
+ * add energy. Sleeping bodies and bodies without mass or inertia are treated as immovable.
+ *
+ * The constraints are grouped by the solver islands and the islands are iterated in parallel. Immovable
+ * bodies may be shared by islands, so their velocities are only read and never written by the solver.
+ */
+class ContactSolver
+{
+public:
+	enum class PositionCorrection
+	{
+		//! Adds a velocity bias proportional to the penetration to the velocity constraints.
+		Baumgarte,
+		//! Solves separate pseudo velocity constraints that only correct the positions.
+		SplitImpulse
+	};
+
+	struct Settings
+	{
+		std::size_t velocityIterations = 8;
+		//! Number of passes over the normal constraints of the points of a manifold per velocity iteration.
+		/*
+		 * The points of a face contact are coupled through the rotation of the bodies, a single sequential pass
+		 * over them leaves each impulse tilting the bodies against the previous points. In stacks the bodies
+		 * keep rocking on their support faces and walk sideways instead of coming to rest. A few passes per
+		 * manifold converge the points almost like a block solve at a fraction of the cost of more iterations.
+		 */
+		std::size_t pointPasses = 3;
+		//! Number of iterations of the pseudo velocity constraints, only used by split impulses.
+		std::size_t positionIterations = 3;
+		PositionCorrection positionCorrection = PositionCorrection::SplitImpulse;
+		//! Fraction of the penetration removed per step.
+		double correctionFactor = 0.2;
+		//! Penetration that is not corrected, avoids jitter of resting contacts.
+		double allowedPenetration = 0.005;
+		double friction = 0.5;
+		double restitution = 0.0;
+		//! Minimum approaching velocity for restitution.
+		double restitutionThreshold = 1.0;
+		bool warmStarting = true;
+	};
+
+	void setSettings(const Settings& settings);
+	const Settings& settings() const;
+
+	//! Allocates the per body buffers for the bodies of the store and reserves the constraints for the colliders.
+	void resize(const BodyStateStore& store);
+	//! Solves the contacts of the awake islands and stores the accumulated impulses in the manifolds, returns whether any body was changed.
+	bool solve(BodyStateStore& store, std::vector<ContactManifold>& manifolds, const SimulationIslands& islands, WorkerPool& pool, double dt);
+
+	//! Returns the number of contact points solved by the last call of solve().
+	std::size_t constraintCount() const;
+
+private:
+	struct PointConstraint
+	{
+		Eigen::Vector3d offsetA;
+		Eigen::Vector3d offsetB;
+		double normalMass;
+		//! Target normal velocity of the velocity and of the pseudo velocity constraint.
+		double velocityBias;
+		double positionBias;
+
+		double normalImpulse;
+		double pseudoImpulse;
+	};
+
+	//! Constraints of the points of a manifold, which share the bodies and the contact frame.
+	struct ManifoldConstraint
+	{
+		std::uint32_t manifold;
+		std::uint32_t translationalA;
+		std::uint32_t rotationalA;
+		std::uint32_t translationalB;
+		std::uint32_t rotationalB;
+
+		//! Set if the body is neither sleeping nor without mass and inertia, only movable bodies are written.
+		bool movableA;
+		bool movableB;
+		double inverseMassA;
+		double inverseMassB;
+		Eigen::Matrix3d inverseInertiaA;
+		Eigen::Matrix3d inverseInertiaB;
+
+		Eigen::Vector3d normal;
+		Eigen::Vector3d tangents[2];
+
+		std::uint32_t pointCount;
+		std::array<PointConstraint, 4> points;
+
+		//! Friction at the center of the points, the radius is the mean distance of the points from the center.
+		Eigen::Vector3d centerOffsetA;
+		Eigen::Vector3d centerOffsetB;
+		double frictionRadius;
+		double tangentMass[2];
+		double twistMass;
+		double tangentImpulse[2];
+		double twistImpulse;
+	};
+
+	Settings m_settings;
+
+	std::vector<ManifoldConstraint> m_constraints;
+	//! Ranges of the constraints of the solver islands
+	std::vector<std::uint32_t> m_islandOffsets;
+	std::size_t m_pointCount = 0;
+
+	//! Velocities of the bodies before the solve and pseudo velocities of the split impulses, indexed like the body arrays of the store.
+	std::vector<Eigen::Vector3d> m_initialLinearVelocity;
+	std::vector<Eigen::Vector3d> m_initialAngularVelocity;
+	std::vector<Eigen::Vector3d> m_pseudoLinearVelocity;
+	std::vector<Eigen::Vector3d> m_pseudoAngularVelocity;
+	//! Movable bodies with contacts in the current step.
+	std::vector<std::uint32_t> m_solvedTranslational;
+	std::vector<std::uint32_t> m_solvedRotational;
+	std::vector<std::uint8_t> m_translationalSolved;
+	std::vector<std::uint8_t> m_rotationalSolved;
+
+	void prepare(const BodyStateStore& store, const std::vector<ContactManifold>& manifolds, const SimulationIslands& islands, double dt);
+	void solveIsland(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd);
+	void warmStart(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd);
+	void solveVelocities(BodyStateStore& store, std::size_t constraintBegin, std::size_t constraintEnd);
+	void solvePositions(std::size_t constraintBegin, std::size_t constraintEnd);
+	void applyCorrections(BodyStateStore& store, WorkerPool& pool, double dt);
+	void storeImpulses(std::vector<ContactManifold>& manifolds) const;
+};
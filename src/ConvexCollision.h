@@ -0,0 +1,364 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <Eigen/Geometry>
+
+//! Oriented box in world space with the support mapping required by GjkEpa.
+struct BoxShape
+{
+	Eigen::Vector3d center;
+	//! Columns are the axes of the box.
+	Eigen::Matrix3d rotation;
+	Eigen::Vector3d halfExtents;
+
+	//! Returns the point of the box that is farthest in the specified direction.
+	Eigen::Vector3d support(const Eigen::Vector3d& direction) const
+	{
+		const Eigen::Vector3d localDirection = rotation.transpose()*direction;
+		Eigen::Vector3d localSupport;
+		for (int i = 0; i < 3; i++) localSupport[i] = (localDirection[i] >= 0) ? halfExtents[i] : -halfExtents[i];
+		return center + rotation*localSupport;
+	}
+};
+
+//! Penetration depth computation of convex shapes with GJK and the expanding polytope algorithm.
+/*
+ * The shapes only have to provide 'Eigen::Vector3d support(const Eigen::Vector3d& direction) const'.
+ * GJK searches a tetrahedron of the Minkowski difference A - B that encloses the origin, EPA expands it
+ * towards the face closest to the origin. All storage is fixed size on the stack, so both are free of
+ * heap allocations and can be run concurrently. The result is a single contact point, manifolds with
+ * several points are accumulated over consecutive steps.
+ */
+class GjkEpa
+{
+public:
+	struct Result
+	{
+		//! Unit normal pointing from A to B.
+		Eigen::Vector3d normal = Eigen::Vector3d::UnitX();
+		double depth = 0.0;
+		//! Deepest point of A inside B and deepest point of B inside A.
+		Eigen::Vector3d pointA = Eigen::Vector3d::Zero();
+		Eigen::Vector3d pointB = Eigen::Vector3d::Zero();
+	};
+
+	//! Returns whether the shapes overlap and computes the penetration if they do.
+	template <typename ShapeA, typename ShapeB>
+	static bool penetration(const ShapeA& a, const ShapeB& b, Result& result)
+	{
+		const auto support = [&](const Eigen::Vector3d& direction) {
+			Vertex vertex;
+			vertex.pointA = a.support(direction);
+			vertex.pointB = b.support(-direction);
+			vertex.point = vertex.pointA - vertex.pointB;
+			return vertex;
+		};
+
+		Simplex simplex;
+		if (!intersect(support, simplex)) return false;
+		if (!completeTetrahedron(support, simplex)) return false;
+		return expand(support, simplex, result);
+	}
+
+private:
+	static constexpr std::size_t maxGjkIterations = 64;
+	static constexpr std::size_t maxEpaIterations = 64;
+	static constexpr std::size_t maxVertices = maxEpaIterations + 4;
+	static constexpr std::size_t maxFaces = 2*maxVertices;
+	static constexpr std::size_t maxHorizonEdges = 3*maxFaces;
+	static constexpr double epaTolerance = 1e-7;
+
+	//! Vertex of the Minkowski difference with the support points it was created from.
+	struct Vertex
+	{
+		Eigen::Vector3d point;
+		Eigen::Vector3d pointA;
+		Eigen::Vector3d pointB;
+	};
+
+	//! Simplex of up to four vertices, the most recently added vertex is the last one.
+	struct Simplex
+	{
+		std::array<Vertex, 4> vertices;
+		std::size_t size = 0;
+	};
+
+	struct Face
+	{
+		std::array<std::uint32_t, 3> vertices;
+		Eigen::Vector3d normal;
+		double distance;
+		bool valid;
+	};
+
+	template <typename SupportT>
+	static bool intersect(const SupportT& support, Simplex& simplex)
+	{
+		Eigen::Vector3d direction = Eigen::Vector3d::UnitX();
+		simplex.vertices[0] = support(direction);
+		simplex.size = 1;
+		direction = -simplex.vertices[0].point;
+
+		for (std::size_t iteration = 0; iteration < maxGjkIterations; iteration++) {
+			// The origin lies on the current simplex
+			if (direction.squaredNorm() < 1e-24) return true;
+
+			const Vertex vertex = support(direction);
+			if (vertex.point.dot(direction) < 0) return false;
+
+			simplex.vertices[simplex.size++] = vertex;
+			if (reduceSimplex(simplex, direction)) return true;
+		}
+		return false;
+	}
+
+	//! Reduces the simplex to the feature closest to the origin and updates the search direction, returns true if it encloses the origin.
+	static bool reduceSimplex(Simplex& simplex, Eigen::Vector3d& direction)
+	{
+		auto& v = simplex.vertices;
+		const auto tripleProduct = [](const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c) {
+			return a.cross(b).cross(c);
+		};
+
+		// Line with the newest vertex 'a' and 'b'
+		const auto line = [&](Vertex a, Vertex b) {
+			const Eigen::Vector3d ab = b.point - a.point;
+			const Eigen::Vector3d ao = -a.point;
+			if (ab.dot(ao) > 0) {
+				v[0] = b;
+				v[1] = a;
+				simplex.size = 2;
+				direction = tripleProduct(ab, ao, ab);
+			} else {
+				v[0] = a;
+				simplex.size = 1;
+				direction = ao;
+			}
+			return false;
+		};
+
+		// Triangle with the newest vertex 'a', 'b' and 'c'
+		const auto triangle = [&](Vertex a, Vertex b, Vertex c) {
+			const Eigen::Vector3d ab = b.point - a.point;
+			const Eigen::Vector3d ac = c.point - a.point;
+			const Eigen::Vector3d ao = -a.point;
+			const Eigen::Vector3d abc = ab.cross(ac);
+
+			if (abc.cross(ac).dot(ao) > 0) {
+				if (ac.dot(ao) > 0) {
+					v[0] = c;
+					v[1] = a;
+					simplex.size = 2;
+					direction = tripleProduct(ac, ao, ac);
+					return false;
+				}
+				return line(a, b);
+			}
+			if (ab.cross(abc).dot(ao) > 0) return line(a, b);
+
+			// The origin projects into the triangle, the winding is kept such that 'direction' is the normal
+			const double side = abc.dot(ao);
+			if (side > 0) {
+				v[0] = c;
+				v[1] = b;
+				v[2] = a;
+				direction = abc;
+			} else {
+				v[0] = b;
+				v[1] = c;
+				v[2] = a;
+				direction = -abc;
+			}
+			simplex.size = 3;
+			return side == 0;
+		};
+
+		switch (simplex.size) {
+			case 2:
+				return line(v[1], v[0]);
+			case 3:
+				return triangle(v[2], v[1], v[0]);
+			case 4: {
+				// The triangle 'bcd' has its normal pointing towards 'a', check the other three faces
+				const Vertex a = v[3], b = v[2], c = v[1], d = v[0];
+				const Eigen::Vector3d ao = -a.point;
+				const Eigen::Vector3d ab = b.point - a.point;
+				const Eigen::Vector3d ac = c.point - a.point;
+				const Eigen::Vector3d ad = d.point - a.point;
+
+				if (ab.cross(ac).dot(ao) > 0) return triangle(a, b, c);
+				if (ac.cross(ad).dot(ao) > 0) return triangle(a, c, d);
+				if (ad.cross(ab).dot(ao) > 0) return triangle(a, d, b);
+				return true;
+			}
+			default:
+				return false;
+		}
+	}
+
+	//! Extends a degenerate simplex of touching shapes to a tetrahedron, returns false if the difference is flat.
+	template <typename SupportT>
+	static bool completeTetrahedron(const SupportT& support, Simplex& simplex)
+	{
+		auto& v = simplex.vertices;
+		const auto tryAdd = [&](const Eigen::Vector3d& direction, const auto& isValid) {
+			for (const double sign : { 1.0, -1.0 }) {
+				const Vertex vertex = support(sign*direction);
+				if (isValid(vertex.point)) {
+					v[simplex.size++] = vertex;
+					return true;
+				}
+			}
+			return false;
+		};
+
+		const Eigen::Vector3d axes[3] = { Eigen::Vector3d::UnitX(), Eigen::Vector3d::UnitY(), Eigen::Vector3d::UnitZ() };
+		constexpr double epsilon = 1e-10;
+
+		if (simplex.size == 1) {
+			const auto distinct = [&](const Eigen::Vector3d& p) { return (p - v[0].point).squaredNorm() > epsilon; };
+			bool added = false;
+			for (const auto& axis : axes) {
+				if ((added = tryAdd(axis, distinct))) break;
+			}
+			if (!added) return false;
+		}
+		if (simplex.size == 2) {
+			const Eigen::Vector3d lineDirection = v[1].point - v[0].point;
+			const auto offLine = [&](const Eigen::Vector3d& p) {
+				return lineDirection.cross(p - v[0].point).squaredNorm() > epsilon*lineDirection.squaredNorm();
+			};
+			bool added = false;
+			for (const auto& axis : axes) {
+				const Eigen::Vector3d direction = lineDirection.cross(axis);
+				if (direction.squaredNorm() > epsilon && (added = tryAdd(direction, offLine))) break;
+			}
+			if (!added) return false;
+		}
+		if (simplex.size == 3) {
+			const Eigen::Vector3d normal = (v[1].point - v[0].point).cross(v[2].point - v[0].point);
+			const auto offPlane = [&](const Eigen::Vector3d& p) {
+				return std::abs(normal.dot(p - v[0].point)) > epsilon*normal.norm();
+			};
+			if (!tryAdd(normal, offPlane)) return false;
+		}
+		return true;
+	}
+
+	template <typename SupportT>
+	static bool expand(const SupportT& support, const Simplex& simplex, Result& result)
+	{
+		std::array<Vertex, maxVertices> vertices;
+		std::array<Face, maxFaces> faces;
+		std::array<std::array<std::uint32_t, 2>, maxHorizonEdges> horizon;
+		std::size_t vertexCount = 0;
+		std::size_t faceCount = 0;
+
+		for (std::size_t i = 0; i < 4; i++) vertices[vertexCount++] = simplex.vertices[i];
+
+		// The centroid of the initial tetrahedron stays inside of the polytope and is used to orient the faces
+		const Eigen::Vector3d interior = 0.25*(vertices[0].point + vertices[1].point + vertices[2].point + vertices[3].point);
+
+		const auto addFace = [&](std::uint32_t i0, std::uint32_t i1, std::uint32_t i2) {
+			if (faceCount == maxFaces) return false;
+
+			Eigen::Vector3d normal = (vertices[i1].point - vertices[i0].point).cross(vertices[i2].point - vertices[i0].point);
+			const double length = normal.norm();
+			if (!(length > 0)) return false;
+			normal /= length;
+
+			auto& face = faces[faceCount++];
+			face.vertices = { i0, i1, i2 };
+			if (normal.dot(vertices[i0].point - interior) < 0) {
+				std::swap(face.vertices[1], face.vertices[2]);
+				normal = -normal;
+			}
+			face.normal = normal;
+			face.distance = normal.dot(vertices[i0].point);
+			face.valid = true;
+			return true;
+		};
+
+		if (!addFace(0, 1, 2) || !addFace(0, 3, 1) || !addFace(0, 2, 3) || !addFace(1, 3, 2)) return false;
+
+		Face closest;
+		for (std::size_t iteration = 0; iteration < maxEpaIterations; iteration++) {
+			const Face* closestFace = nullptr;
+			for (std::size_t f = 0; f < faceCount; f++) {
+				if (faces[f].valid && (!closestFace || faces[f].distance < closestFace->distance)) closestFace = &faces[f];
+			}
+			if (!closestFace) return false;
+			closest = *closestFace;
+
+			const Vertex vertex = support(closest.normal);
+			const double distance = vertex.point.dot(closest.normal);
+			if (distance - closest.distance <= epaTolerance*std::max(1.0, distance) || vertexCount == maxVertices) break;
+
+			// Remove all faces visible from the new vertex and collect the edges of the hole
+			const auto newVertex = static_cast<std::uint32_t>(vertexCount);
+			vertices[vertexCount++] = vertex;
+
+			std::size_t horizonCount = 0;
+			for (std::size_t f = 0; f < faceCount; f++) {
+				auto& face = faces[f];
+				if (!face.valid || face.normal.dot(vertex.point - vertices[face.vertices[0]].point) <= 0) continue;
+
+				face.valid = false;
+				for (std::size_t e = 0; e < 3; e++) {
+					const std::array<std::uint32_t, 2> edge = { face.vertices[e], face.vertices[(e + 1) % 3] };
+
+					// Edges shared by two removed faces are interior to the hole
+					bool shared = false;
+					for (std::size_t h = 0; h < horizonCount; h++) {
+						if (horizon[h][0] == edge[1] && horizon[h][1] == edge[0]) {
+							horizon[h] = horizon[--horizonCount];
+							shared = true;
+							break;
+						}
+					}
+					if (!shared && horizonCount < maxHorizonEdges) horizon[horizonCount++] = edge;
+				}
+			}
+
+			// Compact the face list before the hole is closed
+			std::size_t validCount = 0;
+			for (std::size_t f = 0; f < faceCount; f++) {
+				if (faces[f].valid) faces[validCount++] = faces[f];
+			}
+			faceCount = validCount;
+
+			for (std::size_t h = 0; h < horizonCount; h++) {
+				if (!addFace(horizon[h][0], horizon[h][1], newVertex)) break;
+			}
+		}
+
+		// Barycentric coordinates of the projection of the origin onto the closest face
+		const auto& a = vertices[closest.vertices[0]];
+		const auto& b = vertices[closest.vertices[1]];
+		const auto& c = vertices[closest.vertices[2]];
+		const Eigen::Vector3d projection = closest.distance*closest.normal;
+
+		const Eigen::Vector3d v0 = b.point - a.point;
+		const Eigen::Vector3d v1 = c.point - a.point;
+		const Eigen::Vector3d v2 = projection - a.point;
+		const double d00 = v0.dot(v0), d01 = v0.dot(v1), d11 = v1.dot(v1);
+		const double d20 = v2.dot(v0), d21 = v2.dot(v1);
+		const double denominator = d00*d11 - d01*d01;
+		if (!(std::abs(denominator) > 0)) return false;
+
+		const double wb = (d11*d20 - d01*d21)/denominator;
+		const double wc = (d00*d21 - d01*d20)/denominator;
+		const double wa = 1.0 - wb - wc;
+
+		result.normal = closest.normal;
+		result.depth = closest.distance;
+		result.pointA = wa*a.pointA + wb*b.pointA + wc*c.pointA;
+		result.pointB = wa*a.pointB + wb*b.pointB + wc*c.pointB;
+		return true;
+	}
+};
@@ -0,0 +1,60 @@
+#include "DurationHistogram.h"
+
+#include <cmath>
+#include <fstream>
+
+DurationHistogram::DurationHistogram()
+{
+	clear();
+}
+
+void DurationHistogram::add(double seconds)
+{
+	const double microseconds = seconds*1e6;
+
+	std::size_t bin = 0;
+	if (microseconds >= 1.0) {
+		const double index = std::floor(std::log2(microseconds)*binsPerOctave) + 1.0;
+		bin = (index < static_cast<double>(binCount - 1)) ? static_cast<std::size_t>(index) : binCount - 1;
+	}
+
+	// Single writer, a relaxed read-modify-write sequence is sufficient
+	m_counts[bin].store(m_counts[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void DurationHistogram::clear()
+{
+	for (auto& count : m_counts) count.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t DurationHistogram::totalCount() const
+{
+	std::uint64_t total = 0;
+	for (const auto& count : m_counts) total += count.load(std::memory_order_relaxed);
+	return total;
+}
+
+double DurationHistogram::binLowerBound(std::size_t bin)
+{
+	if (bin == 0) return 0.0;
+	return 1e-6*std::exp2(static_cast<double>(bin - 1) / binsPerOctave);
+}
+
+void DurationHistogram::writeCsv(std::ostream& out) const
+{
+	out << "lower_us,upper_us,count\n";
+	for (std::size_t bin = 0; bin < binCount; bin++) {
+		out << binLowerBound(bin)*1e6 << ",";
+		if (bin + 1 < binCount) out << binLowerBound(bin + 1)*1e6;
+		else out << "inf";
+		out << "," << count(bin) << "\n";
+	}
+}
+
+bool DurationHistogram::writeCsv(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file) return false;
+	writeCsv(file);
+	return static_cast<bool>(file);
+}
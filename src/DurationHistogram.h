@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//! Histogram of non-negative durations with logarithmically spaced bins, e.g. for scheduling delays.
+/*
+ * The first bin counts durations below one microsecond, every following bin spans a factor of 2^(1/4),
+ * and the last bin counts all durations above about 46 ms. Samples are added by a single thread and the
+ * counts may be read by any other thread without locks. Adding a sample never allocates.
+ */
+class DurationHistogram
+{
+public:
+	static constexpr std::size_t binCount = 64;
+	static constexpr std::size_t binsPerOctave = 4;
+
+	DurationHistogram();
+
+	//! Counts a duration in seconds, negative durations are counted in the first bin. Must only be called by a single thread.
+	void add(double seconds);
+	//! Resets all counts. Samples that are added concurrently may be lost.
+	void clear();
+
+	std::uint64_t count(std::size_t bin) const { return m_counts[bin].load(std::memory_order_relaxed); }
+	std::uint64_t totalCount() const;
+	//! Returns the lower bound of the bin in seconds, the upper bound is the lower bound of the next bin.
+	static double binLowerBound(std::size_t bin);
+
+	//! Writes one 'lower_us,upper_us,count' line per bin after a header line, the upper bound of the last bin is 'inf'.
+	void writeCsv(std::ostream& out) const;
+	//! Writes the CSV file, returns false if it could not be written.
+	bool writeCsv(const std::string& path) const;
+
+private:
+	std::array<std::atomic<std::uint64_t>, binCount> m_counts;
+};
@@ -0,0 +1,222 @@
+#include "DynamicAabbTree.h"
+
+#include <algorithm>
+
+DynamicAabbTree::DynamicAabbTree()
+	: m_root(nullNode)
+	, m_freeList(nullNode)
+	, m_proxyCount(0) {}
+
+std::uint32_t DynamicAabbTree::createProxy(const Aabb& aabb, std::uint32_t userData)
+{
+	const std::uint32_t proxy = allocateNode();
+	auto& node = m_nodes[proxy];
+	node.aabb = aabb;
+	node.userData = userData;
+	node.height = 0;
+
+	insertLeaf(proxy);
+	m_proxyCount++;
+	return proxy;
+}
+
+void DynamicAabbTree::destroyProxy(std::uint32_t proxy)
+{
+	assert(m_nodes[proxy].isLeaf());
+
+	removeLeaf(proxy);
+	freeNode(proxy);
+	m_proxyCount--;
+}
+
+void DynamicAabbTree::moveProxy(std::uint32_t proxy, const Aabb& aabb)
+{
+	assert(m_nodes[proxy].isLeaf());
+
+	removeLeaf(proxy);
+	m_nodes[proxy].aabb = aabb;
+	insertLeaf(proxy);
+}
+
+void DynamicAabbTree::clear()
+{
+	m_nodes.clear();
+	m_root = nullNode;
+	m_freeList = nullNode;
+	m_proxyCount = 0;
+}
+
+int DynamicAabbTree::height() const
+{
+	return (m_root != nullNode) ? m_nodes[m_root].height : 0;
+}
+
+std::uint32_t DynamicAabbTree::allocateNode()
+{
+	if (m_freeList == nullNode) {
+		m_nodes.emplace_back();
+		return static_cast<std::uint32_t>(m_nodes.size() - 1);
+	}
+
+	const std::uint32_t node = m_freeList;
+	m_freeList = m_nodes[node].parent;
+	m_nodes[node] = Node();
+	return node;
+}
+
+void DynamicAabbTree::freeNode(std::uint32_t node)
+{
+	m_nodes[node].parent = m_freeList;
+	m_nodes[node].height = -1;
+	m_freeList = node;
+}
+
+void DynamicAabbTree::insertLeaf(std::uint32_t leaf)
+{
+	if (m_root == nullNode) {
+		m_root = leaf;
+		m_nodes[leaf].parent = nullNode;
+		return;
+	}
+
+	// Descend to the sibling with the lowest cost, the cost of a subtree is the increase of its surface area
+	const Aabb leafAabb = m_nodes[leaf].aabb;
+	std::uint32_t index = m_root;
+	while (!m_nodes[index].isLeaf()) {
+		const auto& node = m_nodes[index];
+		const double area = node.aabb.surfaceArea();
+		const double combinedArea = node.aabb.merged(leafAabb).surfaceArea();
+
+		// Cost of creating a new parent for this node and the leaf, and the minimum cost of pushing the leaf further down
+		const double cost = 2*combinedArea;
+		const double inheritanceCost = 2*(combinedArea - area);
+
+		const auto childCost = [&](std::uint32_t child) {
+			const auto& childAabb = m_nodes[child].aabb;
+			const double newArea = childAabb.merged(leafAabb).surfaceArea();
+			return m_nodes[child].isLeaf() ? newArea + inheritanceCost
+										   : (newArea - childAabb.surfaceArea()) + inheritanceCost;
+		};
+
+		const double cost1 = childCost(node.child1);
+		const double cost2 = childCost(node.child2);
+		if (cost < cost1 && cost < cost2) break;
+
+		index = (cost1 < cost2) ? node.child1 : node.child2;
+	}
+
+	// Create a new parent for the sibling and the leaf
+	const std::uint32_t sibling = index;
+	const std::uint32_t oldParent = m_nodes[sibling].parent;
+	const std::uint32_t newParent = allocateNode();
+	{
+		auto& node = m_nodes[newParent];
+		node.parent = oldParent;
+		node.aabb = leafAabb.merged(m_nodes[sibling].aabb);
+		node.height = m_nodes[sibling].height + 1;
+		node.child1 = sibling;
+		node.child2 = leaf;
+	}
+
+	if (oldParent != nullNode) {
+		auto& parent = m_nodes[oldParent];
+		if (parent.child1 == sibling) parent.child1 = newParent; else parent.child2 = newParent;
+	} else {
+		m_root = newParent;
+	}
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	refitAncestors(m_nodes[leaf].parent);
+}
+
+void DynamicAabbTree::removeLeaf(std::uint32_t leaf)
+{
+	if (leaf == m_root) {
+		m_root = nullNode;
+		return;
+	}
+
+	// The sibling replaces the parent of the leaf
+	const std::uint32_t parent = m_nodes[leaf].parent;
+	const std::uint32_t grandParent = m_nodes[parent].parent;
+	const std::uint32_t sibling = (m_nodes[parent].child1 == leaf) ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+	if (grandParent != nullNode) {
+		auto& node = m_nodes[grandParent];
+		if (node.child1 == parent) node.child1 = sibling; else node.child2 = sibling;
+		m_nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		refitAncestors(grandParent);
+	} else {
+		m_root = sibling;
+		m_nodes[sibling].parent = nullNode;
+		freeNode(parent);
+	}
+}
+
+void DynamicAabbTree::refitAncestors(std::uint32_t index)
+{
+	while (index != nullNode) {
+		index = balance(index);
+
+		auto& node = m_nodes[index];
+		const auto& child1 = m_nodes[node.child1];
+		const auto& child2 = m_nodes[node.child2];
+		node.height = 1 + std::max(child1.height, child2.height);
+		node.aabb = child1.aabb.merged(child2.aabb);
+
+		index = node.parent;
+	}
+}
+
+std::uint32_t DynamicAabbTree::balance(std::uint32_t a)
+{
+	if (m_nodes[a].isLeaf() || m_nodes[a].height < 2) return a;
+
+	const std::uint32_t b = m_nodes[a].child1;
+	const std::uint32_t c = m_nodes[a].child2;
+	const int heightDifference = m_nodes[c].height - m_nodes[b].height;
+
+	// Promotes the higher child 'up' of 'a', 'a' takes the place of one of the children of 'up'
+	const auto rotate = [this, a](std::uint32_t up, std::uint32_t other) {
+		const std::uint32_t f = m_nodes[up].child1;
+		const std::uint32_t g = m_nodes[up].child2;
+
+		// Swap 'a' and 'up'
+		m_nodes[up].child1 = a;
+		m_nodes[up].parent = m_nodes[a].parent;
+		m_nodes[a].parent = up;
+
+		if (m_nodes[up].parent != nullNode) {
+			auto& parent = m_nodes[m_nodes[up].parent];
+			if (parent.child1 == a) parent.child1 = up; else parent.child2 = up;
+		} else {
+			m_root = up;
+		}
+
+		// The higher grandchild stays below 'up', the other one replaces 'up' below 'a'
+		const bool fHigher = m_nodes[f].height > m_nodes[g].height;
+		const std::uint32_t stay = fHigher ? f : g;
+		const std::uint32_t move = fHigher ? g : f;
+
+		m_nodes[up].child2 = stay;
+		if (m_nodes[a].child1 == up) m_nodes[a].child1 = move; else m_nodes[a].child2 = move;
+		m_nodes[move].parent = a;
+
+		auto& nodeA = m_nodes[a];
+		nodeA.aabb = m_nodes[other].aabb.merged(m_nodes[move].aabb);
+		nodeA.height = 1 + std::max(m_nodes[other].height, m_nodes[move].height);
+
+		auto& nodeUp = m_nodes[up];
+		nodeUp.aabb = nodeA.aabb.merged(m_nodes[stay].aabb);
+		nodeUp.height = 1 + std::max(nodeA.height, m_nodes[stay].height);
+
+		return up;
+	};
+
+	if (heightDifference > 1) return rotate(c, b);
+	if (heightDifference < -1) return rotate(b, c);
+	return a;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+//! Axis aligned bounding box.
+struct Aabb
+{
+	Eigen::Vector3d min = Eigen::Vector3d::Zero();
+	Eigen::Vector3d max = Eigen::Vector3d::Zero();
+
+	bool overlaps(const Aabb& other) const
+	{
+		return (min.array() <= other.max.array()).all() && (other.min.array() <= max.array()).all();
+	}
+
+	bool contains(const Aabb& other) const
+	{
+		return (min.array() <= other.min.array()).all() && (other.max.array() <= max.array()).all();
+	}
+
+	Aabb merged(const Aabb& other) const
+	{
+		return { min.cwiseMin(other.min), max.cwiseMax(other.max) };
+	}
+
+	double surfaceArea() const
+	{
+		const Eigen::Vector3d extents = max - min;
+		return 2*(extents.x()*extents.y() + extents.y()*extents.z() + extents.z()*extents.x());
+	}
+};
+
+//! Bounding volume hierarchy of axis aligned boxes that is updated incrementally.
+/*
+ * Leaves (proxies) are inserted at the position with the lowest increase of surface area and the tree is
+ * kept balanced by AVL rotations, so insertion, removal and queries are O(log n). Proxies are usually
+ * inserted with enlarged ("fat") boxes, so moving objects only need to be reinserted when they leave their
+ * box. Proxy ids stay valid until the proxy is destroyed. Queries are const and can be run concurrently.
+ */
+class DynamicAabbTree
+{
+public:
+	static constexpr std::uint32_t nullNode = std::numeric_limits<std::uint32_t>::max();
+
+	DynamicAabbTree();
+
+	//! Creates a leaf with the specified box and user data, returns the proxy id.
+	std::uint32_t createProxy(const Aabb& aabb, std::uint32_t userData);
+	void destroyProxy(std::uint32_t proxy);
+	//! Replaces the box of the proxy, the leaf is reinserted.
+	void moveProxy(std::uint32_t proxy, const Aabb& aabb);
+	//! Removes all proxies.
+	void clear();
+
+	const Aabb& aabb(std::uint32_t proxy) const { return m_nodes[proxy].aabb; }
+	std::uint32_t userData(std::uint32_t proxy) const { return m_nodes[proxy].userData; }
+
+	//! Returns the height of the tree, zero for a single leaf.
+	int height() const;
+	std::size_t proxyCount() const { return m_proxyCount; }
+
+	//! Calls 'callback(proxy)' for every proxy whose box overlaps the box, stops when the callback returns false.
+	template <typename CallbackT>
+	void query(const Aabb& aabb, CallbackT&& callback) const
+	{
+		if (m_root == nullNode) return;
+
+		// The tree is balanced, so the depth stays far below the stack size for any realistic proxy count
+		std::uint32_t stack[maxStackSize];
+		std::size_t stackSize = 0;
+		stack[stackSize++] = m_root;
+
+		while (stackSize > 0) {
+			const auto& node = m_nodes[stack[--stackSize]];
+			if (!node.aabb.overlaps(aabb)) continue;
+
+			if (node.isLeaf()) {
+				if (!callback(static_cast<std::uint32_t>(&node - m_nodes.data()))) return;
+			} else {
+				assert(stackSize + 2 <= maxStackSize);
+				stack[stackSize++] = node.child1;
+				stack[stackSize++] = node.child2;
+			}
+		}
+	}
+
+private:
+	static constexpr std::size_t maxStackSize = 256;
+
+	struct Node
+	{
+		Aabb aabb;
+		//! Parent of a node in the tree, next free node of a node in the free list
+		std::uint32_t parent = nullNode;
+		std::uint32_t child1 = nullNode;
+		std::uint32_t child2 = nullNode;
+		//! Height of the subtree, -1 for free nodes
+		int height = -1;
+		std::uint32_t userData = 0;
+
+		bool isLeaf() const { return child1 == nullNode; }
+	};
+
+	std::vector<Node> m_nodes;
+	std::uint32_t m_root;
+	std::uint32_t m_freeList;
+	std::size_t m_proxyCount;
+
+	std::uint32_t allocateNode();
+	void freeNode(std::uint32_t node);
+
+	void insertLeaf(std::uint32_t leaf);
+	void removeLeaf(std::uint32_t leaf);
+	//! Refits the boxes and heights from the node up to the root, balancing every ancestor.
+	void refitAncestors(std::uint32_t node);
+	//! Performs a left or right rotation if the node is imbalanced, returns the new root of the subtree.
+	std::uint32_t balance(std::uint32_t node);
+};
@@ -8,6 +8,7 @@
 #include <Eigen/Geometry>
 
 #include "Common.h"
+#include "WorkerPool.h"
 
 using EntityType = std::uint32_t;
 
@@ -75,6 +76,8 @@ struct RotationalAnimatedBody
 struct RenderData
 {
 	Eigen::Vector4f color;
+	//! Set if all bodies of the entity are sleeping, allows renderers to highlight them.
+	bool sleeping = false;
 
 	struct Cuboid
 	{
@@ -95,4 +98,13 @@ struct RenderData
 
 using EntityComponentSystemBase = entt::Registry<EntityType>;
 
-class EntityComponentSystem : public EntityComponentSystemBase {};
+//! Registry of all entities and components and the worker pool of the systems operating on them.
+class EntityComponentSystem : public EntityComponentSystemBase
+{
+public:
+	//! Returns the persistent worker pool shared by all systems operating on the registry.
+	WorkerPool& workerPool() const { return m_workerPool; }
+
+private:
+	mutable WorkerPool m_workerPool;
+};
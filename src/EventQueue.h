@@ -1,12 +1,46 @@
 ﻿#pragma once
 
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
-#include <queue>
+#include <mutex>
+#include <optional>
+#include <utility>
 
 #include <noname_tools/utility_tools.h>
 
+#include "AllocationTracker.h"
 #include "Common.h"
+#include "MpscQueue.h"
+#include "Trace.h"
+
+//! Promise of an event that only creates its shared state if a future was requested.
+/*
+ * Mirrors the interface of std::promise used by the event visitors. Events posted without a future (see
+ * EventQueue::postEventDetached) never allocate a shared state and set_value() does nothing for them.
+ */
+template <typename PromisedT>
+class EventPromise
+{
+public:
+	//! Creates the shared state and returns its future, may only be called once.
+	std::future<PromisedT> get_future()
+	{
+		m_promise.emplace();
+		return m_promise->get_future();
+	}
+
+	//! Stores the response in the shared state if a future was requested.
+	template <typename... ValueTs>
+	void set_value(ValueTs&&... value)
+	{
+		if (m_promise) m_promise->set_value(std::forward<ValueTs>(value)...);
+	}
+
+private:
+	std::optional<std::promise<PromisedT>> m_promise;
+};
 
 //! Element type for the 'EventQueue'.
 /*
@@ -24,16 +58,31 @@ struct Event
 	//! Request input data.
 	RequestT request;
 	//! Promise to return response data.
-	std::promise<PromisedT> promise;
+	EventPromise<PromisedT> promise;
 };
 
 //! Event type with a void response type
 template< typename RequestT>
 using VoidEvent = Event<RequestT, void>;
 
+//! Lanes of the EventQueue, events of the high priority lane are processed before all normal events.
+enum class EventPriority
+{
+	Normal,
+	High
+};
+
 //! An event queue which stores requests of the user and returns future objects to await a result.
+/*
+ * Any number of threads may post events, but only a single thread may process them. The events are stored
+ * in bounded lock-free rings (see MpscQueue), posting only takes a lock to wake up the processing thread
+ * if it is blocked in waitForEvent(). Posting to a full lane blocks until its oldest event was processed.
+ *
+ * Every event is posted to one of two lanes: control events of the high priority lane overtake the queued
+ * events of the normal lane, the order of the events within a lane is preserved.
+ */
 template <typename... EventTs>
-class EventQueue : protected std::queue<common::variant::variant<Event<typename EventTs::request_type, typename EventTs::promised_type>...>>
+class EventQueue
 {
 	// Make sure that we have at least one event type
 	static_assert(sizeof...(EventTs) > 0, "The number of event types has to be larger than zero.");
@@ -43,79 +92,161 @@ class EventQueue : protected std::queue<common::variant::variant<Event<typename
 	//! Alias for the promised result type associated to the 'RequestT'.
 	template <typename RequestT>
 	using promised_type = noname::tools::nth_element_t<noname::tools::element_index_v<RequestT, typename EventTs::request_type...>, typename EventTs::promised_type...>;
-	//! The underlying container type of the queue.
-	using container_type = std::queue<common::variant::variant<Event<typename EventTs::request_type, typename EventTs::promised_type>...>>;
+	//! The type of the stored events.
+	using value_type = common::variant::variant<Event<typename EventTs::request_type, typename EventTs::promised_type>...>;
 
 public:
+	//! Default number of events that can be pending before postEvent() blocks.
+	static constexpr std::size_t defaultCapacity = 256;
+
+	explicit EventQueue(std::size_t capacity = defaultCapacity)
+		: m_events(capacity)
+		, m_highPriorityEvents(capacity)
+		, m_consumerWaiting(false)
+	{
+	}
+
 	//! Creates an event associated to the specified request and returns a future to wait for a response.
 	/*
 	 * \param request A request which has to be of a supported type, i.e. one event supported by the 
 	 *		queue has to specify it as a 'request_type'.
+	 * \param priority The lane the event is posted to.
 	 * \return A future which can  be used to wait for the response of the request.
 	 */
 	template <typename RequestT>
-	std::future<promised_type<RequestT>> postEvent(RequestT request)
+	std::future<promised_type<RequestT>> postEvent(RequestT request, EventPriority priority = EventPriority::Normal)
 	// We can have a templated return type and still never have to explicitely specify it, because the 'RequestT' types have to be unique
 	{
 		static_assert(noname::tools::count_element_v<RequestT, typename EventTs::request_type...> > 0, "The request type has to be a request type of the compatible events.");
-		using PromisedT = promised_type<RequestT>;
-		using EventT = Event<RequestT, PromisedT>;
+		using EventT = Event<RequestT, promised_type<RequestT>>;
 
-		// Lock the queue and access to the "await event" promise (prevent multiple postEvent calls from setting the value)
-		std::lock_guard<std::mutex> lock(this->m_queueMutex);
+#ifdef PHYANI_ALLOCATION_TRACKING
+		AllocationScope allocationScope(&postEventAllocationSite());
+#endif
 
-		// Notify waiting threads that an event occured
-		m_awaitEventPromise.set_value();
+		// The future has to be retrieved before the event is visible to the processing thread
+		EventT event{ std::move(request), {} };
+		auto future = event.promise.get_future();
+		push(std::move(event), priority);
+		return future;
+	}
 
-		// Store the event with a promise associated to the request
-		this->emplace(EventT{request});
-		auto& promise = common::variant::get<EventT>(this->back()).promise;
+	//! Creates an event associated to the specified request without a way to wait for its response.
+	/*
+	 * Unlike postEvent(), no shared state for a future is allocated, i.e. posting does not allocate at all.
+	 */
+	template <typename RequestT>
+	void postEventDetached(RequestT request, EventPriority priority = EventPriority::Normal)
+	{
+		static_assert(noname::tools::count_element_v<RequestT, typename EventTs::request_type...> > 0, "The request type has to be a request type of the compatible events.");
+		using EventT = Event<RequestT, promised_type<RequestT>>;
 
-		// Create a new promise to allow other threads to wait for events
-		m_awaitEventPromise = std::move(std::promise<void>());
-		// The future has to be retrieved here because get_future may only be called once
-		m_awaitEventFuture = std::move(m_awaitEventPromise.get_future());
+#ifdef PHYANI_ALLOCATION_TRACKING
+		AllocationScope allocationScope(&postEventAllocationSite());
+#endif
 
-		// Return the future of the enqueued event
-		return promise.get_future();
+		push(EventT{ std::move(request), {} }, priority);
 	}
 
-	//! Uses a visitor to process the oldest event in the queue.
+	//! Uses a visitor to process the oldest event in the queue, high priority events are processed first.
 	/*
 	 * The specified visitor is called with the oldest event of type Event<RequestT, PromisedT>. 
 	 * It is the task visitor to update the promise with a value to allow the user to obtain it
-	 * via the associated future.
+	 * via the associated future. Must only be called by the processing thread.
 	 * \param visitor The visitor to apply to the event. Has to provide a function call operator
 	 *		for every supported event type of the queue.
+	 * \return False if the queue was empty.
+	 */
+	template <typename VisitorT>
+	bool processOldestEvent(VisitorT visitor)
+	{
+		TRACE_ZONE("EventQueue::processOldestEvent");
+
+		// The event is moved out of the ring before it is visited, so the visitor may post further events
+		const auto process = [&](value_type& event) { visit(visitor, event); };
+		return m_highPriorityEvents.consume(process) || m_events.consume(process);
+	}
+
+	//! Uses a visitor to process the oldest event of the high priority lane, returns false if the lane is empty.
+	/*
+	 * Allows the processing thread to react to control events while it works off a long running normal event.
 	 */
 	template <typename VisitorT>
-	void processOldestEvent(VisitorT visitor)
+	bool processHighPriorityEvent(VisitorT visitor)
 	{
-		std::unique_lock<std::mutex> lock(m_queueMutex);
-		// Move event out of queue
-		typename container_type::value_type event(std::move(this->front()));
-		// Remove the empty event from the queue
-		this->pop();
-		lock.unlock();
-
-		// Apply visitor to process the event
-		visit(visitor, event);
+		TRACE_ZONE("EventQueue::processHighPriorityEvent");
+		return m_highPriorityEvents.consume([&](value_type& event) { visit(visitor, event); });
 	}
 
-	//! Blocks the current thread until an event was enqueued.
+	//! Blocks the current thread until an event was enqueued. Must only be called by the processing thread.
 	void waitForEvent()
 	{
-		if (m_awaitEventFuture.valid())
-			m_awaitEventFuture.wait();
+		if (!empty()) return;
+
+		std::unique_lock<std::mutex> lock(m_waitMutex);
+		m_consumerWaiting.store(true, std::memory_order_relaxed);
+		// Either this thread sees the new event or the posting thread sees the flag, see notifyConsumer()
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_waitCondition.wait(lock, [this]() { return !empty(); });
+		m_consumerWaiting.store(false, std::memory_order_relaxed);
+	}
+
+	//! Blocks the current thread until an event was enqueued or the deadline passed, returns whether an event is available.
+	template <typename ClockT, typename DurationT>
+	bool waitForEventUntil(const std::chrono::time_point<ClockT, DurationT>& deadline)
+	{
+		if (!empty()) return true;
+
+		std::unique_lock<std::mutex> lock(m_waitMutex);
+		m_consumerWaiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const bool available = m_waitCondition.wait_until(lock, deadline, [this]() { return !empty(); });
+		m_consumerWaiting.store(false, std::memory_order_relaxed);
+		return available;
 	}
 
 	//! Returns whether the queue is currently empty
-	using container_type::empty;
+	bool empty() const { return m_highPriorityEvents.empty() && m_events.empty(); }
+	//! Returns whether the high priority lane contains an event.
+	bool hasHighPriorityEvent() const { return !m_highPriorityEvents.empty(); }
 	//! Returns the number of events in the queue
-	using container_type::size;
+	std::size_t size() const { return m_highPriorityEvents.size() + m_events.size(); }
 
 protected:
-	std::mutex m_queueMutex;
-	std::promise<void> m_awaitEventPromise;
-	std::future<void> m_awaitEventFuture;
+#ifdef PHYANI_ALLOCATION_TRACKING
+	//! Site shared by all request types, a static variable in postEvent would create one site per request type.
+	static AllocationSite& postEventAllocationSite()
+	{
+		static AllocationSite site("EventQueue::postEvent");
+		return site;
+	}
+#endif
+
+	template <typename EventT>
+	void push(EventT&& event, EventPriority priority)
+	{
+		auto& lane = (priority == EventPriority::High) ? m_highPriorityEvents : m_events;
+		lane.emplace(std::forward<EventT>(event));
+		notifyConsumer();
+	}
+
+	//! Wakes up the processing thread if it is blocked in waitForEvent().
+	void notifyConsumer()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!m_consumerWaiting.load(std::memory_order_relaxed)) return;
+
+		// Taking the lock ensures that the processing thread either still checks the queue or already waits
+		{
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+		}
+		m_waitCondition.notify_one();
+	}
+
+	MpscQueue<value_type> m_events;
+	MpscQueue<value_type> m_highPriorityEvents;
+
+	std::mutex m_waitMutex;
+	std::condition_variable m_waitCondition;
+	std::atomic<bool> m_consumerWaiting;
 };
@@ -0,0 +1,284 @@
+#include "ImplicitEulerIntegrator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Common.h"
+#include "RotationKernels.h"
+
+ImplicitEulerIntegrator::ImplicitEulerIntegrator()
+	: m_tolerance(1e-5)
+	, m_maxIterations(200)
+	, m_lastIterationCount(0)
+	, m_lastRelativeResidual(0.0) {}
+
+IntegrationScheme ImplicitEulerIntegrator::scheme() const
+{
+	return IntegrationScheme::ImplicitEuler;
+}
+
+void ImplicitEulerIntegrator::resize(const BodyStateStore& store)
+{
+	const std::size_t bodyCount = store.translational.size();
+	const std::size_t jointCount = store.joints.size();
+
+	// Count the joints adjacent to every body, then fill the rows
+	m_neighborOffsets.assign(bodyCount + 1, 0);
+	for (const auto& parents : store.joints.parents) {
+		if (parents.first.translational != BodyStateStore::invalidIndex) m_neighborOffsets[parents.first.translational + 1]++;
+		if (parents.second.translational != BodyStateStore::invalidIndex) m_neighborOffsets[parents.second.translational + 1]++;
+	}
+	for (std::size_t i = 0; i < bodyCount; i++) m_neighborOffsets[i + 1] += m_neighborOffsets[i];
+
+	m_neighbors.resize(m_neighborOffsets.back());
+	std::vector<std::uint32_t> fill(m_neighborOffsets.begin(), m_neighborOffsets.end() - 1);
+	for (std::size_t j = 0; j < jointCount; j++) {
+		const auto first = store.joints.parents[j].first.translational;
+		const auto second = store.joints.parents[j].second.translational;
+		const auto joint = static_cast<std::uint32_t>(j);
+		if (first != BodyStateStore::invalidIndex) m_neighbors[fill[first]++] = { joint, second };
+		if (second != BodyStateStore::invalidIndex) m_neighbors[fill[second]++] = { joint, first };
+	}
+
+	m_stiffness.resize(jointCount);
+	m_systemBlocks.resize(jointCount);
+
+	m_preconditioner.resize(bodyCount);
+	m_mass.resize(bodyCount);
+	m_velocityChange.assign(bodyCount, Eigen::Vector3d::Zero());
+	m_rhs.resize(bodyCount);
+	m_residual.resize(bodyCount);
+	m_preconditioned.resize(bodyCount);
+	m_direction.resize(bodyCount);
+	m_product.resize(bodyCount);
+	m_partialSums.resize((bodyCount + reductionGrainSize - 1) / reductionGrainSize);
+}
+
+void ImplicitEulerIntegrator::step(IntegrationTarget& target, double dt)
+{
+	auto& store = target.bodyState();
+	auto& pool = target.workerPool();
+
+	target.computeForces();
+
+	computeJacobians(target, dt);
+	assembleSystem(target, dt);
+	solve(pool);
+
+	// Update the velocities of the free bodies, all awake bodies move with their new velocity
+	auto& translational = store.translational;
+	pool.parallelFor<Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!translational.sleeping[i]) {
+				translational.linearVelocity[i] += m_velocityChange[i];
+				translational.position[i] += dt*translational.linearVelocity[i];
+			}
+		}
+	});
+
+	// The rotational motion is integrated explicitly
+	auto& rotational = store.rotational;
+	pool.parallelFor<Eigen::Matrix3d>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!rotational.sleeping[i]) rotational.angularVelocity[i] += dt*angularAcceleration(rotational, i);
+		}
+
+		RotationKernels::integrateRotations(end - begin, dt, &rotational.angularVelocity[begin], &rotational.sleeping[begin],
+											&rotational.rotation[begin]);
+	});
+
+	target.updateDerivedState();
+}
+
+void ImplicitEulerIntegrator::setTolerance(double tolerance)
+{
+	m_tolerance = tolerance;
+}
+
+double ImplicitEulerIntegrator::tolerance() const
+{
+	return m_tolerance;
+}
+
+void ImplicitEulerIntegrator::setMaxIterations(std::size_t maxIterations)
+{
+	m_maxIterations = maxIterations;
+}
+
+std::size_t ImplicitEulerIntegrator::maxIterations() const
+{
+	return m_maxIterations;
+}
+
+std::size_t ImplicitEulerIntegrator::lastIterationCount() const
+{
+	return m_lastIterationCount;
+}
+
+double ImplicitEulerIntegrator::lastRelativeResidual() const
+{
+	return m_lastRelativeResidual;
+}
+
+void ImplicitEulerIntegrator::computeJacobians(IntegrationTarget& target, double dt)
+{
+	const auto& joints = target.bodyState().joints;
+
+	target.workerPool().parallelFor<Eigen::Matrix3d>(0, joints.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t j = begin; j < end; j++) {
+			m_stiffness[j].setZero();
+			m_systemBlocks[j].setZero();
+
+			const auto dampedSpring = common::variant::get_if<Joint::DampedSpring>(&joints.properties[j]);
+			if (!dampedSpring) continue;
+
+			const auto& connectors = joints.connectors[j];
+			const Eigen::Vector3d distance = connectors.first.globalPosition - connectors.second.globalPosition;
+			const double length = distance.norm();
+			if (!(length > 0)) continue;
+
+			// K = -df/dx: axial stiffness and the transverse stiffness of stretched springs
+			const Eigen::Vector3d direction = distance / length;
+			const Eigen::Matrix3d axial = direction*direction.transpose();
+			const double transverse = dampedSpring->elasticity*std::max(1 - dampedSpring->restLength / length, 0.0);
+			const Eigen::Matrix3d stiffness = dampedSpring->elasticity*axial
+											  + transverse*(Eigen::Matrix3d::Identity() - axial);
+			// D = -df/dv, the damping acts on the velocity difference projected on the unnormalized distance
+			const Eigen::Matrix3d damping = (dampedSpring->damping*length)*axial;
+
+			m_stiffness[j] = (dt*dt)*stiffness;
+			m_systemBlocks[j] = dt*damping + m_stiffness[j];
+		}
+	});
+}
+
+void ImplicitEulerIntegrator::assembleSystem(IntegrationTarget& target, double dt)
+{
+	const auto& translational = target.bodyState().translational;
+
+	target.workerPool().parallelFor<Eigen::Matrix3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			const bool free = !translational.sleeping[i] && translational.mass[i] > 0;
+			m_mass[i] = free ? translational.mass[i] : 0.0;
+
+			if (!free) {
+				m_preconditioner[i].setZero();
+				m_rhs[i].setZero();
+				m_velocityChange[i].setZero();
+				continue;
+			}
+
+			// b = dt*f - dt^2*K*(v_i - v_other), diagonal block M + sum of the joint blocks
+			Eigen::Vector3d rhs = dt*translational.externalForce[i];
+			Eigen::Matrix3d diagonal = translational.mass[i]*Eigen::Matrix3d::Identity();
+
+			for (std::uint32_t n = m_neighborOffsets[i]; n < m_neighborOffsets[i + 1]; n++) {
+				const auto& neighbor = m_neighbors[n];
+				Eigen::Vector3d relativeVelocity = translational.linearVelocity[i];
+				if (neighbor.other != BodyStateStore::invalidIndex) relativeVelocity -= translational.linearVelocity[neighbor.other];
+
+				rhs -= m_stiffness[neighbor.joint]*relativeVelocity;
+				diagonal += m_systemBlocks[neighbor.joint];
+			}
+
+			m_rhs[i] = rhs;
+			m_preconditioner[i] = diagonal.inverse();
+		}
+	});
+}
+
+void ImplicitEulerIntegrator::solve(WorkerPool& pool)
+{
+	const std::size_t bodyCount = m_rhs.size();
+	m_lastIterationCount = 0;
+	m_lastRelativeResidual = 0.0;
+
+	const double rhsNorm = std::sqrt(dot(pool, m_rhs, m_rhs));
+	if (!(rhsNorm > 0)) {
+		std::fill(m_velocityChange.begin(), m_velocityChange.end(), Eigen::Vector3d::Zero());
+		return;
+	}
+
+	// Warm start with the velocity changes of the previous step
+	applySystem(pool, m_velocityChange, m_product);
+	pool.parallelFor<Eigen::Vector3d>(0, bodyCount, 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) m_residual[i] = m_rhs[i] - m_product[i];
+	});
+	applyPreconditioner(pool, m_residual, m_preconditioned);
+	m_direction = m_preconditioned;
+
+	double residualDotPreconditioned = dot(pool, m_residual, m_preconditioned);
+	double residualNorm = std::sqrt(dot(pool, m_residual, m_residual));
+
+	const double targetNorm = m_tolerance*rhsNorm;
+	while (residualNorm > targetNorm && m_lastIterationCount < m_maxIterations) {
+		applySystem(pool, m_direction, m_product);
+		const double curvature = dot(pool, m_direction, m_product);
+		if (!(curvature > 0)) break;
+
+		const double alpha = residualDotPreconditioned / curvature;
+		pool.parallelFor<Eigen::Vector3d>(0, bodyCount, 0, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				m_velocityChange[i] += alpha*m_direction[i];
+				m_residual[i] -= alpha*m_product[i];
+			}
+		});
+
+		applyPreconditioner(pool, m_residual, m_preconditioned);
+		const double nextResidualDotPreconditioned = dot(pool, m_residual, m_preconditioned);
+		const double beta = nextResidualDotPreconditioned / residualDotPreconditioned;
+		residualDotPreconditioned = nextResidualDotPreconditioned;
+
+		pool.parallelFor<Eigen::Vector3d>(0, bodyCount, 0, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) m_direction[i] = m_preconditioned[i] + beta*m_direction[i];
+		});
+
+		residualNorm = std::sqrt(dot(pool, m_residual, m_residual));
+		m_lastIterationCount++;
+	}
+
+	m_lastRelativeResidual = residualNorm / rhsNorm;
+}
+
+void ImplicitEulerIntegrator::applySystem(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& x, BodyStateStore::aligned_vector<Eigen::Vector3d>& result)
+{
+	// Gathers the joint blocks of every body, entries of bodies that are not free stay zero
+	pool.parallelFor<Eigen::Vector3d>(0, x.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!(m_mass[i] > 0)) {
+				result[i].setZero();
+				continue;
+			}
+
+			Eigen::Vector3d value = m_mass[i]*x[i];
+			for (std::uint32_t n = m_neighborOffsets[i]; n < m_neighborOffsets[i + 1]; n++) {
+				const auto& neighbor = m_neighbors[n];
+				Eigen::Vector3d relative = x[i];
+				if (neighbor.other != BodyStateStore::invalidIndex) relative -= x[neighbor.other];
+				value += m_systemBlocks[neighbor.joint]*relative;
+			}
+			result[i] = value;
+		}
+	});
+}
+
+void ImplicitEulerIntegrator::applyPreconditioner(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& x, BodyStateStore::aligned_vector<Eigen::Vector3d>& result)
+{
+	pool.parallelFor<Eigen::Vector3d>(0, x.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) result[i] = m_preconditioner[i]*x[i];
+	});
+}
+
+double ImplicitEulerIntegrator::dot(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& a, const BodyStateStore::aligned_vector<Eigen::Vector3d>& b)
+{
+	// Partial sums of fixed chunks are added in order, the result is independent of the number of threads
+	pool.parallelFor(0, a.size(), reductionGrainSize, [&](std::size_t begin, std::size_t end) {
+		double sum = 0.0;
+		for (std::size_t i = begin; i < end; i++) sum += a[i].dot(b[i]);
+		m_partialSums[begin / reductionGrainSize] = sum;
+	});
+
+	double sum = 0.0;
+	for (std::size_t chunk = 0; chunk*reductionGrainSize < a.size(); chunk++) sum += m_partialSums[chunk];
+	return sum;
+}
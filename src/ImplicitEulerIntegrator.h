@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "Integrator.h"
+
+//! Linearly implicit (backward) Euler scheme for the translational motion of stiff damped spring networks.
+/*
+ * Every step solves (M - dt*df/dv - dt^2*df/dx)*deltaV = dt*(f + dt*df/dx*v) for the velocity changes of
+ * all free bodies with a block Jacobi preconditioned conjugate gradient. The system matrix is applied
+ * matrix-free by gathering the 3x3 spring Jacobian blocks over the joints adjacent to each body, so
+ * the solve is parallel without atomics and its result does not depend on the number of threads.
+ * The solution of the previous step is used as the initial guess.
+ *
+ * To keep the system symmetric positive definite, the Jacobians drop the non-symmetric damping term
+ * of the position derivative and only keep the transverse stiffness of stretched springs. Bodies
+ * without mass are kinematic, connector offsets of rotational bodies are treated as constant during
+ * the step and the rotational motion is integrated explicitly with the semi-implicit Euler scheme.
+ */
+class ImplicitEulerIntegrator : public Integrator
+{
+public:
+	ImplicitEulerIntegrator();
+
+	IntegrationScheme scheme() const override;
+	void resize(const BodyStateStore& store) override;
+	void step(IntegrationTarget& target, double dt) override;
+
+	//! Sets the relative residual norm at which the conjugate gradient iteration stops.
+	void setTolerance(double tolerance);
+	double tolerance() const;
+	//! Sets the maximum number of conjugate gradient iterations per step.
+	void setMaxIterations(std::size_t maxIterations);
+	std::size_t maxIterations() const;
+
+	//! Returns the number of iterations of the last solve.
+	std::size_t lastIterationCount() const;
+	//! Returns the relative residual norm reached by the last solve.
+	double lastRelativeResidual() const;
+
+private:
+	//! Fixed chunk size of the dot products, the summation order does not depend on the number of threads.
+	static constexpr std::size_t reductionGrainSize = 1024;
+
+	//! Joint adjacent to a translational body.
+	struct Neighbor
+	{
+		std::uint32_t joint;
+		//! Translational index of the body at the other end of the joint, may be invalid.
+		std::uint32_t other;
+	};
+
+	double m_tolerance;
+	std::size_t m_maxIterations;
+	std::size_t m_lastIterationCount;
+	double m_lastRelativeResidual;
+
+	//! Adjacency of the translational bodies in compressed row format, rebuilt on resize.
+	std::vector<std::uint32_t> m_neighborOffsets;
+	std::vector<Neighbor> m_neighbors;
+
+	//! Per joint blocks dt^2*K and dt*D + dt^2*K of the linearized spring forces.
+	BodyStateStore::aligned_vector<Eigen::Matrix3d> m_stiffness;
+	BodyStateStore::aligned_vector<Eigen::Matrix3d> m_systemBlocks;
+
+	//! Inverse diagonal blocks of the system matrix, zero for bodies that are not free.
+	BodyStateStore::aligned_vector<Eigen::Matrix3d> m_preconditioner;
+	BodyStateStore::aligned_vector<double> m_mass;
+
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_velocityChange;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_rhs;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_residual;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_preconditioned;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_direction;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_product;
+	std::vector<double> m_partialSums;
+
+	void computeJacobians(IntegrationTarget& target, double dt);
+	void assembleSystem(IntegrationTarget& target, double dt);
+	void solve(WorkerPool& pool);
+
+	//! Computes result = A*x with the current joint blocks.
+	void applySystem(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& x, BodyStateStore::aligned_vector<Eigen::Vector3d>& result);
+	//! Computes result = P*x with the block Jacobi preconditioner.
+	void applyPreconditioner(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& x, BodyStateStore::aligned_vector<Eigen::Vector3d>& result);
+	double dot(WorkerPool& pool, const BodyStateStore::aligned_vector<Eigen::Vector3d>& a, const BodyStateStore::aligned_vector<Eigen::Vector3d>& b);
+};
@@ -0,0 +1,233 @@
+#include "Integrator.h"
+
+#include "ImplicitEulerIntegrator.h"
+#include "RotationKernels.h"
+
+std::unique_ptr<Integrator> Integrator::create(IntegrationScheme scheme)
+{
+	switch (scheme) {
+	case IntegrationScheme::VelocityVerlet: return std::make_unique<VelocityVerletIntegrator>();
+	case IntegrationScheme::RungeKutta4: return std::make_unique<RungeKutta4Integrator>();
+	case IntegrationScheme::ImplicitEuler: return std::make_unique<ImplicitEulerIntegrator>();
+	default: return std::make_unique<SymplecticEulerIntegrator>();
+	}
+}
+
+const char* Integrator::schemeName(IntegrationScheme scheme)
+{
+	switch (scheme) {
+	case IntegrationScheme::SymplecticEuler: return "Symplectic Euler";
+	case IntegrationScheme::VelocityVerlet: return "Velocity Verlet";
+	case IntegrationScheme::RungeKutta4: return "Runge-Kutta 4";
+	case IntegrationScheme::ImplicitEuler: return "Implicit Euler";
+	}
+	return "Unknown";
+}
+
+void Integrator::resize(const BodyStateStore&) {}
+
+Eigen::Vector3d Integrator::linearAcceleration(const BodyStateStore::TranslationalArrays& bodies, std::size_t i)
+{
+	if (bodies.mass[i] > 0) return (1 / bodies.mass[i])*bodies.externalForce[i];
+	return Eigen::Vector3d::Zero();
+}
+
+Eigen::Vector3d Integrator::angularAcceleration(const BodyStateStore::RotationalArrays& bodies, std::size_t i)
+{
+	if (bodies.prinicipalInertia[i].sum() > 0) {
+		// Expressions are evaluated explicitly, 'auto' would keep references to destroyed temporaries
+		const auto& angularVelocity = bodies.angularVelocity[i];
+		const Eigen::Vector3d angularMomentum = bodies.globalInertiaMatrix[i]*angularVelocity;
+		const Eigen::Vector3d netTorque = bodies.externalTorque[i] - angularVelocity.cross(angularMomentum);
+		return bodies.globalInverseInertiaMatrix[i]*netTorque;
+	}
+	return Eigen::Vector3d::Zero();
+}
+
+IntegrationScheme SymplecticEulerIntegrator::scheme() const
+{
+	return IntegrationScheme::SymplecticEuler;
+}
+
+void SymplecticEulerIntegrator::step(IntegrationTarget& target, double dt)
+{
+	auto& store = target.bodyState();
+	auto& pool = target.workerPool();
+
+	target.computeForces();
+
+	auto& translational = store.translational;
+	pool.parallelFor<Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!translational.sleeping[i]) {
+				translational.linearVelocity[i] += dt*linearAcceleration(translational, i);
+				translational.position[i] += dt*translational.linearVelocity[i];
+			}
+		}
+	});
+
+	auto& rotational = store.rotational;
+	pool.parallelFor<Eigen::Matrix3d>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!rotational.sleeping[i]) rotational.angularVelocity[i] += dt*angularAcceleration(rotational, i);
+		}
+
+		// Integrate the quaternions of the chunk with the batched kernels
+		RotationKernels::integrateRotations(end - begin, dt, &rotational.angularVelocity[begin], &rotational.sleeping[begin],
+											&rotational.rotation[begin]);
+	});
+
+	target.updateDerivedState();
+}
+
+IntegrationScheme VelocityVerletIntegrator::scheme() const
+{
+	return IntegrationScheme::VelocityVerlet;
+}
+
+void VelocityVerletIntegrator::step(IntegrationTarget& target, double dt)
+{
+	auto& store = target.bodyState();
+	auto& pool = target.workerPool();
+
+	// Half kick with the forces of the current state
+	target.computeForces();
+	kick(target, 0.5*dt);
+
+	// Drift with the half step velocities
+	auto& translational = store.translational;
+	pool.parallelFor<Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!translational.sleeping[i]) translational.position[i] += dt*translational.linearVelocity[i];
+		}
+	});
+
+	auto& rotational = store.rotational;
+	pool.parallelFor<Eigen::Quaterniond>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		RotationKernels::integrateRotations(end - begin, dt, &rotational.angularVelocity[begin], &rotational.sleeping[begin],
+											&rotational.rotation[begin]);
+	});
+
+	// Second half kick with the forces of the new positions
+	target.updateDerivedState();
+	target.computeForces();
+	kick(target, 0.5*dt);
+
+	// The connector velocities depend on the final velocities
+	target.updateDerivedState();
+}
+
+void VelocityVerletIntegrator::kick(IntegrationTarget& target, double dt)
+{
+	auto& store = target.bodyState();
+	auto& pool = target.workerPool();
+
+	auto& translational = store.translational;
+	pool.parallelFor<Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!translational.sleeping[i]) translational.linearVelocity[i] += dt*linearAcceleration(translational, i);
+		}
+	});
+
+	auto& rotational = store.rotational;
+	pool.parallelFor<Eigen::Matrix3d>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (!rotational.sleeping[i]) rotational.angularVelocity[i] += dt*angularAcceleration(rotational, i);
+		}
+	});
+}
+
+IntegrationScheme RungeKutta4Integrator::scheme() const
+{
+	return IntegrationScheme::RungeKutta4;
+}
+
+void RungeKutta4Integrator::resize(const BodyStateStore& store)
+{
+	const std::size_t translationalCount = store.translational.size();
+	m_position.resize(translationalCount);
+	m_linearVelocity.resize(translationalCount);
+	m_positionRate.resize(translationalCount);
+	m_linearVelocityRate.resize(translationalCount);
+
+	const std::size_t rotationalCount = store.rotational.size();
+	m_rotation.resize(rotationalCount);
+	m_angularVelocity.resize(rotationalCount);
+	m_rotationRate.resize(rotationalCount);
+	m_angularVelocityRate.resize(rotationalCount);
+}
+
+void RungeKutta4Integrator::step(IntegrationTarget& target, double dt)
+{
+	auto& store = target.bodyState();
+	auto& pool = target.workerPool();
+	auto& translational = store.translational;
+	auto& rotational = store.rotational;
+
+	// Weights of the stage derivatives and offsets of the following stage
+	static constexpr double weights[4] = { 1.0, 2.0, 2.0, 1.0 };
+	static constexpr double offsets[3] = { 0.5, 0.5, 1.0 };
+
+	for (std::size_t stage = 0; stage < 4; stage++) {
+		const double weight = weights[stage];
+		const bool lastStage = (stage == 3);
+		// Either the offset of the next stage or the final combination of the weighted derivatives
+		const double factor = lastStage ? dt/6 : offsets[stage]*dt;
+
+		target.computeForces();
+
+		pool.parallelFor<Eigen::Vector3d>(0, translational.size(), 0, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				if (translational.sleeping[i]) continue;
+
+				auto& position = translational.position[i];
+				auto& linearVelocity = translational.linearVelocity[i];
+				const Eigen::Vector3d positionRate = linearVelocity;
+				const Eigen::Vector3d linearVelocityRate = linearAcceleration(translational, i);
+
+				if (stage == 0) {
+					m_position[i] = position;
+					m_linearVelocity[i] = linearVelocity;
+					m_positionRate[i] = positionRate;
+					m_linearVelocityRate[i] = linearVelocityRate;
+				} else {
+					m_positionRate[i] += weight*positionRate;
+					m_linearVelocityRate[i] += weight*linearVelocityRate;
+				}
+
+				position = m_position[i] + factor*(lastStage ? m_positionRate[i] : positionRate);
+				linearVelocity = m_linearVelocity[i] + factor*(lastStage ? m_linearVelocityRate[i] : linearVelocityRate);
+			}
+		});
+
+		pool.parallelFor<Eigen::Matrix3d>(0, rotational.size(), 0, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				if (rotational.sleeping[i]) continue;
+
+				auto& rotation = rotational.rotation[i];
+				auto& angularVelocity = rotational.angularVelocity[i];
+				const Eigen::Vector3d halfAngularVelocity = 0.5*angularVelocity;
+				const Eigen::Vector4d rotationRate = (Eigen::Quaterniond(0, halfAngularVelocity.x(),
+																		 halfAngularVelocity.y(),
+																		 halfAngularVelocity.z())*rotation).coeffs();
+				const Eigen::Vector3d angularVelocityRate = angularAcceleration(rotational, i);
+
+				if (stage == 0) {
+					m_rotation[i] = rotation;
+					m_angularVelocity[i] = angularVelocity;
+					m_rotationRate[i] = rotationRate;
+					m_angularVelocityRate[i] = angularVelocityRate;
+				} else {
+					m_rotationRate[i] += weight*rotationRate;
+					m_angularVelocityRate[i] += weight*angularVelocityRate;
+				}
+
+				rotation.coeffs() = m_rotation[i].coeffs() + factor*(lastStage ? m_rotationRate[i] : rotationRate);
+				angularVelocity = m_angularVelocity[i] + factor*(lastStage ? m_angularVelocityRate[i] : angularVelocityRate);
+			}
+		});
+
+		// Normalizes the quaternions and evaluates the connectors of the stage state
+		target.updateDerivedState();
+	}
+}
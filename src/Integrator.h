@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "BodyStateStore.h"
+#include "WorkerPool.h"
+
+//! Time integration schemes provided by Integrator::create.
+enum class IntegrationScheme
+{
+	//! Semi-implicit Euler, first order, a single force evaluation per step.
+	SymplecticEuler,
+	//! Velocity Verlet (kick-drift-kick), second order, two force evaluations per step.
+	VelocityVerlet,
+	//! Classical Runge-Kutta, fourth order, four force evaluations per step.
+	RungeKutta4,
+	//! Linearly implicit Euler for stiff spring networks, see ImplicitEulerIntegrator.
+	ImplicitEuler
+};
+
+//! System integrated by an Integrator, i.e. the body state and the evaluation of the forces acting on it.
+class IntegrationTarget
+{
+public:
+	//! Returns the body state that is advanced by the integrator.
+	virtual BodyStateStore& bodyState() = 0;
+	//! Returns the worker pool that should be used for loops over the bodies.
+	virtual WorkerPool& workerPool() = 0;
+
+	//! Accumulates all forces and torques of the current state into the external force/torque arrays.
+	virtual void computeForces() = 0;
+	//! Updates all quantities derived from the state, i.e. rotation and inertia matrices, connectors, and resets the forces.
+	virtual void updateDerivedState() = 0;
+
+protected:
+	~IntegrationTarget() = default;
+};
+
+//! Interface of the time integration schemes of the AnimationSystem.
+/*
+ * When step() is called, the derived state of the target is up to date and the forces are not yet
+ * accumulated. An implementation has to restore this condition for the new state before returning.
+ * Sleeping bodies are not advanced.
+ */
+class Integrator
+{
+public:
+	virtual ~Integrator() = default;
+
+	//! Creates an integrator implementing the specified scheme.
+	static std::unique_ptr<Integrator> create(IntegrationScheme scheme);
+	//! Returns a human readable name of the scheme.
+	static const char* schemeName(IntegrationScheme scheme);
+
+	//! Returns the scheme implemented by the integrator.
+	virtual IntegrationScheme scheme() const = 0;
+	//! Allocates the scratch state for the number of bodies of the store, called whenever the store was rebuilt.
+	virtual void resize(const BodyStateStore& store);
+	//! Advances the state of the target by 'dt'.
+	virtual void step(IntegrationTarget& target, double dt) = 0;
+
+protected:
+	//! Returns the linear acceleration of the translational body caused by the accumulated force.
+	static Eigen::Vector3d linearAcceleration(const BodyStateStore::TranslationalArrays& bodies, std::size_t i);
+	//! Returns the angular acceleration of the rotational body caused by the accumulated torque (Euler's equations).
+	static Eigen::Vector3d angularAcceleration(const BodyStateStore::RotationalArrays& bodies, std::size_t i);
+};
+
+//! Semi-implicit Euler, the velocities are updated first and used to update positions and rotations.
+class SymplecticEulerIntegrator : public Integrator
+{
+public:
+	IntegrationScheme scheme() const override;
+	void step(IntegrationTarget& target, double dt) override;
+};
+
+//! Velocity Verlet, velocity dependent (damping) forces of the second kick are evaluated with the half step velocities.
+class VelocityVerletIntegrator : public Integrator
+{
+public:
+	IntegrationScheme scheme() const override;
+	void step(IntegrationTarget& target, double dt) override;
+
+private:
+	//! Updates the velocities of all awake bodies by 'dt' with the current forces.
+	static void kick(IntegrationTarget& target, double dt);
+};
+
+//! Classical fourth order Runge-Kutta scheme, the quaternions of intermediate stages are normalized.
+class RungeKutta4Integrator : public Integrator
+{
+public:
+	IntegrationScheme scheme() const override;
+	void resize(const BodyStateStore& store) override;
+	void step(IntegrationTarget& target, double dt) override;
+
+private:
+	//! State at the beginning of the step
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_position;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_linearVelocity;
+	BodyStateStore::aligned_vector<Eigen::Quaterniond> m_rotation;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_angularVelocity;
+
+	//! Weighted sums of the derivatives of all stages
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_positionRate;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_linearVelocityRate;
+	BodyStateStore::aligned_vector<Eigen::Vector4d> m_rotationRate;
+	BodyStateStore::aligned_vector<Eigen::Vector3d> m_angularVelocityRate;
+};
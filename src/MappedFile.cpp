@@ -0,0 +1,186 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, Mode mode, std::size_t initialSize)
+{
+	close();
+	m_mode = mode;
+
+	const bool write = mode == Mode::Write;
+	m_file = CreateFileA(path.c_str(), write ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, write ? 0 : FILE_SHARE_READ,
+						 nullptr, write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		return false;
+	}
+
+	if (write) {
+		m_size = initialSize;
+	} else {
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size)) {
+			close();
+			return false;
+		}
+		m_size = static_cast<std::size_t>(size.QuadPart);
+	}
+
+	if (!map()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::map()
+{
+	// Empty files cannot be mapped
+	if (m_size == 0) return false;
+
+	const bool write = m_mode == Mode::Write;
+	const auto size = static_cast<unsigned long long>(m_size);
+	m_mapping = CreateFileMappingA(m_file, nullptr, write ? PAGE_READWRITE : PAGE_READONLY,
+								   static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffffu), nullptr);
+	if (!m_mapping) return false;
+
+	m_data = static_cast<char*>(MapViewOfFile(m_mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m_size));
+	return m_data != nullptr;
+}
+
+void MappedFile::unmap()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	m_data = nullptr;
+	m_mapping = nullptr;
+}
+
+bool MappedFile::resize(std::size_t size)
+{
+	if (!m_file || m_mode != Mode::Write) return false;
+
+	// The mapping extends the file when it is created, shrinking requires an explicit truncation
+	unmap();
+	if (size < m_size) {
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(size);
+		if (!SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) return false;
+	}
+	m_size = size;
+	return map();
+}
+
+void MappedFile::close(std::size_t finalSize)
+{
+	if (m_data && m_mode == Mode::Write) FlushViewOfFile(m_data, 0);
+	unmap();
+
+	if (m_file) {
+		if (m_mode == Mode::Write && finalSize > 0) {
+			LARGE_INTEGER position;
+			position.QuadPart = static_cast<LONGLONG>(finalSize);
+			if (SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN)) SetEndOfFile(m_file);
+		}
+		CloseHandle(m_file);
+	}
+	m_file = nullptr;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, Mode mode, std::size_t initialSize)
+{
+	close();
+	m_mode = mode;
+
+	const bool write = mode == Mode::Write;
+	m_file = ::open(path.c_str(), write ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+	if (m_file < 0) return false;
+
+	if (write) {
+		if (::ftruncate(m_file, static_cast<off_t>(initialSize)) != 0) {
+			close();
+			return false;
+		}
+		m_size = initialSize;
+	} else {
+		struct stat status;
+		if (::fstat(m_file, &status) != 0) {
+			close();
+			return false;
+		}
+		m_size = static_cast<std::size_t>(status.st_size);
+	}
+
+	if (!map()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::map()
+{
+	// Empty files cannot be mapped
+	if (m_size == 0) return false;
+
+	const int protection = (m_mode == Mode::Write) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* data = ::mmap(nullptr, m_size, protection, MAP_SHARED, m_file, 0);
+	if (data == MAP_FAILED) return false;
+
+	m_data = static_cast<char*>(data);
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if (m_data) ::munmap(m_data, m_size);
+	m_data = nullptr;
+}
+
+bool MappedFile::resize(std::size_t size)
+{
+	if (m_file < 0 || m_mode != Mode::Write) return false;
+
+	unmap();
+	if (::ftruncate(m_file, static_cast<off_t>(size)) != 0) return false;
+	m_size = size;
+	return map();
+}
+
+void MappedFile::close(std::size_t finalSize)
+{
+	unmap();
+
+	if (m_file >= 0) {
+		if (m_mode == Mode::Write && finalSize > 0) {
+			// A failed truncation only leaves padding at the end of the file
+			const bool truncated = ::ftruncate(m_file, static_cast<off_t>(finalSize)) == 0;
+			static_cast<void>(truncated);
+		}
+		::close(m_file);
+	}
+	m_file = -1;
+	m_size = 0;
+}
+
+#endif
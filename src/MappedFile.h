@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//! File that is memory-mapped in its whole length, can be grown for writing.
+/*
+ * Growing the file remaps it, so pointers into the mapping are invalidated by resize(). The mapping is
+ * unmapped and the file is closed by close() or the destructor.
+ */
+class MappedFile
+{
+public:
+	enum class Mode
+	{
+		//! Maps an existing file read-only.
+		Read,
+		//! Creates or truncates the file and maps it for reading and writing.
+		Write
+	};
+
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//! Opens and maps the file, a file opened for writing starts with the specified size. Returns false on failure.
+	bool open(const std::string& path, Mode mode, std::size_t initialSize = 0);
+	//! Changes the size of a file opened for writing and remaps it, returns false on failure.
+	bool resize(std::size_t size);
+	//! Unmaps and closes the file, a file opened for writing is truncated to 'finalSize' first unless it is zero.
+	void close(std::size_t finalSize = 0);
+
+	bool isOpen() const { return m_data != nullptr; }
+	char* data() { return m_data; }
+	const char* data() const { return m_data; }
+	std::size_t size() const { return m_size; }
+
+private:
+	Mode m_mode = Mode::Read;
+	char* m_data = nullptr;
+	std::size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+
+	bool map();
+	void unmap();
+};
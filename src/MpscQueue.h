@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+
+//! Bounded lock-free queue for any number of producer threads and exactly one consumer thread.
+/*
+ * Every slot of the ring carries a sequence number that tells producers and the consumer whether the slot
+ * is free or filled in the current lap, so producers only contend on the tail counter and never on a lock.
+ * The capacity is rounded up to a power of two and allocated by the constructor, push() and pop() never
+ * allocate. A push() into a full queue yields until the consumer freed a slot.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+	explicit MpscQueue(std::size_t capacity)
+	{
+		std::size_t size = 2;
+		while (size < capacity) size *= 2;
+		m_slots.reset(new Slot[size]);
+		m_mask = size - 1;
+		for (std::size_t i = 0; i < size; i++) m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	//! Constructs an element at the end of the queue, blocks while the queue is full. May be called by any thread.
+	template <typename... ArgTs>
+	void emplace(ArgTs&&... args)
+	{
+		Slot* slot;
+		std::size_t position = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			slot = &m_slots[position & m_mask];
+			const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+
+			if (difference == 0) {
+				// The slot is free in this lap, claim it by advancing the tail
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				// The slot still holds the element of the previous lap, i.e. the queue is full
+				std::this_thread::yield();
+				position = m_tail.load(std::memory_order_relaxed);
+			} else {
+				// Another producer claimed the slot first
+				position = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		slot->value.emplace(std::forward<ArgTs>(args)...);
+		slot->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	//! Removes the oldest element and calls 'function(element)' with it, returns false if the queue is empty. Must only be called by the consumer.
+	/*
+	 * The element is moved out of the ring and its slot is released before the function is called, so the
+	 * function may push further elements into the queue even if it was full.
+	 */
+	template <typename FunctionT>
+	bool consume(FunctionT&& function)
+	{
+		const std::size_t position = m_head.load(std::memory_order_relaxed);
+		Slot& slot = m_slots[position & m_mask];
+		if (slot.sequence.load(std::memory_order_acquire) != position + 1) return false;
+
+		T value(std::move(*slot.value));
+		slot.value.reset();
+		// Release the slot for the producers of the next lap
+		slot.sequence.store(position + m_mask + 1, std::memory_order_release);
+		m_head.store(position + 1, std::memory_order_relaxed);
+
+		function(value);
+		return true;
+	}
+
+	//! Returns whether the oldest element is not published yet. Exact if called by the consumer.
+	bool empty() const
+	{
+		const std::size_t position = m_head.load(std::memory_order_relaxed);
+		return m_slots[position & m_mask].sequence.load(std::memory_order_acquire) != position + 1;
+	}
+
+	//! Returns the number of claimed slots, including slots that are still being filled by their producers.
+	std::size_t size() const
+	{
+		return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_relaxed);
+	}
+
+	std::size_t capacity() const { return m_mask + 1; }
+
+private:
+	struct Slot
+	{
+		std::atomic<std::size_t> sequence{0};
+		std::optional<T> value;
+	};
+
+	std::unique_ptr<Slot[]> m_slots;
+	std::size_t m_mask = 0;
+
+	alignas(64) std::atomic<std::size_t> m_head{0};
+	alignas(64) std::atomic<std::size_t> m_tail{0};
+};
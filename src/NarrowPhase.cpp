@@ -0,0 +1,494 @@
+#include "NarrowPhase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	//! Maximum number of vertices of the incident face after clipping it against the four side planes.
+	constexpr std::size_t maxClipVertices = 8;
+
+	//! Face axes are preferred over edge axes and axes of A over axes of B unless they separate clearly more.
+	constexpr double relativeAxisTolerance = 0.95;
+	constexpr double absoluteAxisTolerance = 0.0005;
+	//! Edge axes of nearly parallel edges are skipped, the face axes cover these cases.
+	constexpr double parallelEdgeTolerance = 1e-6;
+	//! Distance by which incident vertices may lie outside the side planes of the reference face without being clipped.
+	constexpr double clipTolerance = 0.0005;
+
+	struct ClipVertex
+	{
+		Eigen::Vector3d point;
+		std::uint32_t id;
+	};
+
+	using ClipPolygon = std::array<ClipVertex, maxClipVertices>;
+
+	std::uint32_t combineIds(std::uint32_t first, std::uint32_t second, std::uint32_t plane)
+	{
+		return ((first*31u + second)*7u + plane + 1u) & 0xffffu;
+	}
+
+	//! Keeps the part of the polygon with 'normal.dot(p) <= offset', returns the new number of vertices.
+	std::size_t clipPolygon(const ClipPolygon& input, std::size_t count, const Eigen::Vector3d& normal, double offset,
+							std::uint32_t plane, ClipPolygon& output)
+	{
+		std::size_t outputCount = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			const auto& previous = input[(i + count - 1) % count];
+			const auto& current = input[i];
+			const double previousDistance = normal.dot(previous.point) - offset;
+			const double currentDistance = normal.dot(current.point) - offset;
+
+			if ((previousDistance <= 0) != (currentDistance <= 0)) {
+				const double t = previousDistance/(previousDistance - currentDistance);
+				output[outputCount++] = { previous.point + t*(current.point - previous.point), combineIds(previous.id, current.id, plane) };
+			}
+			if (currentDistance <= 0) output[outputCount++] = current;
+		}
+		return outputCount;
+	}
+
+	//! Selects up to four points spanning the largest area, starting with the deepest one.
+	template <std::size_t N>
+	std::size_t reducePoints(std::array<ContactPoint, N>& points, std::size_t count, const Eigen::Vector3d& normal)
+	{
+		if (count <= 4) return count;
+
+		const auto argmax = [&](const auto& score) {
+			std::size_t best = 0;
+			double bestScore = -std::numeric_limits<double>::infinity();
+			for (std::size_t i = 0; i < count; i++) {
+				const double s = score(points[i]);
+				if (s > bestScore) {
+					best = i;
+					bestScore = s;
+				}
+			}
+			return std::make_pair(best, bestScore);
+		};
+		const auto area = [&](const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c) {
+			return (b - a).cross(c - a).dot(normal);
+		};
+
+		const std::size_t i0 = argmax([](const ContactPoint& p) { return p.penetration; }).first;
+		const auto& p0 = points[i0].position;
+		const std::size_t i1 = argmax([&](const ContactPoint& p) { return (p.position - p0).squaredNorm(); }).first;
+		const auto& p1 = points[i1].position;
+		std::size_t i2 = argmax([&](const ContactPoint& p) { return std::abs(area(p0, p1, p.position)); }).first;
+
+		// Orient the triangle counter clockwise, the fourth point is the one farthest outside of one of its edges
+		std::size_t triangle[3] = { i0, i1, i2 };
+		if (area(p0, p1, points[i2].position) < 0) std::swap(triangle[1], triangle[2]);
+		const auto outside = [&](const ContactPoint& p) {
+			double result = -std::numeric_limits<double>::infinity();
+			for (std::size_t e = 0; e < 3; e++) {
+				result = std::max(result, -area(points[triangle[e]].position, points[triangle[(e + 1) % 3]].position, p.position));
+			}
+			return result;
+		};
+		const auto fourth = argmax(outside);
+
+		std::array<ContactPoint, 4> selected = { points[triangle[0]], points[triangle[1]], points[triangle[2]], points[fourth.first] };
+		const std::size_t selectedCount = (fourth.second > 0) ? 4 : 3;
+		std::copy(selected.begin(), selected.begin() + selectedCount, points.begin());
+		return selectedCount;
+	}
+
+	//! Contacts of the face 'axis' of the reference box and the most anti-parallel face of the incident box.
+	void faceContact(const BoxShape& reference, const BoxShape& incident, int axis, bool flipped, ContactManifold& manifold)
+	{
+		Eigen::Vector3d normal = reference.rotation.col(axis);
+		const bool negativeReference = normal.dot(incident.center - reference.center) < 0;
+		if (negativeReference) normal = -normal;
+
+		int incidentAxis = 0;
+		(incident.rotation.transpose()*normal).cwiseAbs().maxCoeff(&incidentAxis);
+		Eigen::Vector3d incidentNormal = incident.rotation.col(incidentAxis);
+		const bool negativeIncident = incidentNormal.dot(normal) > 0;
+		if (negativeIncident) incidentNormal = -incidentNormal;
+
+		// Vertices of the incident face in cyclic order
+		const int k1 = (incidentAxis + 1) % 3;
+		const int k2 = (incidentAxis + 2) % 3;
+		const Eigen::Vector3d incidentCenter = incident.center + incident.halfExtents[incidentAxis]*incidentNormal;
+		const Eigen::Vector3d u = incident.halfExtents[k1]*incident.rotation.col(k1);
+		const Eigen::Vector3d v = incident.halfExtents[k2]*incident.rotation.col(k2);
+
+		ClipPolygon polygon = {};
+		ClipPolygon clipped = {};
+		polygon[0] = { incidentCenter + u + v, 0 };
+		polygon[1] = { incidentCenter - u + v, 1 };
+		polygon[2] = { incidentCenter - u - v, 2 };
+		polygon[3] = { incidentCenter + u - v, 3 };
+		std::size_t count = 4;
+
+		// Clip against the side planes of the reference face. Faces of equal size that are aligned have their vertices on
+		// the side planes, the tolerance keeps them from being split into pairs of points whose ids change every step.
+		std::uint32_t plane = 0;
+		for (const int sideAxis : { (axis + 1) % 3, (axis + 2) % 3 }) {
+			const Eigen::Vector3d sideNormal = reference.rotation.col(sideAxis);
+			const double centerOffset = sideNormal.dot(reference.center);
+			const double halfExtent = reference.halfExtents[sideAxis] + clipTolerance;
+
+			count = clipPolygon(polygon, count, sideNormal, centerOffset + halfExtent, plane++, clipped);
+			count = clipPolygon(clipped, count, -sideNormal, -centerOffset + halfExtent, plane++, polygon);
+		}
+
+		// Keep the points below the reference face
+		const Eigen::Vector3d referenceCenter = reference.center + reference.halfExtents[axis]*normal;
+		const std::uint32_t faceId = (flipped ? 1u << 31 : 0u)
+									 | static_cast<std::uint32_t>(2*axis + (negativeReference ? 1 : 0)) << 24
+									 | static_cast<std::uint32_t>(2*incidentAxis + (negativeIncident ? 1 : 0)) << 20;
+
+		std::array<ContactPoint, maxClipVertices> points;
+		std::size_t pointCount = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			const double separation = normal.dot(polygon[i].point - referenceCenter);
+			if (separation > 0) continue;
+
+			auto& point = points[pointCount++];
+			point = ContactPoint();
+			point.position = polygon[i].point - (0.5*separation)*normal;
+			point.penetration = -separation;
+			point.featureId = faceId | polygon[i].id;
+		}
+
+		manifold.normal = flipped ? Eigen::Vector3d(-normal) : normal;
+		manifold.pointCount = static_cast<std::uint32_t>(reducePoints(points, pointCount, normal));
+		std::copy(points.begin(), points.begin() + manifold.pointCount, manifold.points.begin());
+	}
+
+	//! Contact of the edge 'axisA' of A and the edge 'axisB' of B.
+	void edgeContact(const BoxShape& a, const BoxShape& b, int axisA, int axisB, double separation, ContactManifold& manifold)
+	{
+		const Eigen::Vector3d directionA = a.rotation.col(axisA);
+		const Eigen::Vector3d directionB = b.rotation.col(axisB);
+		Eigen::Vector3d normal = directionA.cross(directionB).normalized();
+		if (normal.dot(b.center - a.center) < 0) normal = -normal;
+
+		// Centers of the edges of A farthest along the normal and of B farthest against it
+		Eigen::Vector3d centerA = a.center;
+		Eigen::Vector3d centerB = b.center;
+		for (int k = 0; k < 3; k++) {
+			if (k != axisA) centerA += ((a.rotation.col(k).dot(normal) > 0) ? 1.0 : -1.0)*a.halfExtents[k]*a.rotation.col(k);
+			if (k != axisB) centerB += ((b.rotation.col(k).dot(normal) > 0) ? -1.0 : 1.0)*b.halfExtents[k]*b.rotation.col(k);
+		}
+
+		// Closest points of the two segments
+		const Eigen::Vector3d r = centerA - centerB;
+		const double cosine = directionA.dot(directionB);
+		const double c = directionA.dot(r);
+		const double f = directionB.dot(r);
+		const double denominator = std::max(1.0 - cosine*cosine, std::numeric_limits<double>::epsilon());
+
+		const double halfA = a.halfExtents[axisA];
+		const double halfB = b.halfExtents[axisB];
+		double s = std::clamp((cosine*f - c)/denominator, -halfA, halfA);
+		const double t = std::clamp(cosine*s + f, -halfB, halfB);
+		s = std::clamp(cosine*t - c, -halfA, halfA);
+
+		auto& point = manifold.points[0];
+		point = ContactPoint();
+		point.position = 0.5*((centerA + s*directionA) + (centerB + t*directionB));
+		point.penetration = -separation;
+		point.featureId = (1u << 30) | static_cast<std::uint32_t>(axisA) << 4 | static_cast<std::uint32_t>(axisB);
+
+		manifold.normal = normal;
+		manifold.pointCount = 1;
+	}
+}
+
+void NarrowPhase::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+}
+
+const NarrowPhase::Settings& NarrowPhase::settings() const
+{
+	return m_settings;
+}
+
+void NarrowPhase::resize(const BodyStateStore& store)
+{
+	const std::size_t manifoldCount = store.colliders.size()*BroadPhase::reservedPairsPerCollider;
+	m_manifolds.reserve(manifoldCount);
+	m_keys.reserve(manifoldCount);
+	m_previousManifolds.reserve(manifoldCount);
+	m_previousKeys.reserve(manifoldCount);
+}
+
+void NarrowPhase::update(const BodyStateStore& store, WorkerPool& pool, const std::vector<BroadPhase::Pair>& pairs)
+{
+	// The manifolds of the last update are kept for the lookup of persistent contacts
+	std::swap(m_manifolds, m_previousManifolds);
+	std::swap(m_keys, m_previousKeys);
+
+	m_manifolds.resize(pairs.size());
+	pool.parallelFor(0, pairs.size(), pairGrainSize, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t p = begin; p < end; p++) {
+			collide(store, pairs[p].first, pairs[p].second, m_manifolds[p]);
+		}
+	});
+
+	// Remove the pairs without contacts, the order of the remaining pairs is kept
+	std::size_t count = 0;
+	for (std::size_t p = 0; p < m_manifolds.size(); p++) {
+		if (m_manifolds[p].pointCount == 0) continue;
+		if (count != p) m_manifolds[count] = m_manifolds[p];
+		count++;
+	}
+	m_manifolds.resize(count);
+
+	m_keys.resize(count);
+	for (std::size_t m = 0; m < count; m++) {
+		m_keys[m] = { static_cast<std::uint64_t>(m_manifolds[m].entityA) << 32 | m_manifolds[m].entityB, static_cast<std::uint32_t>(m) };
+	}
+	std::sort(m_keys.begin(), m_keys.end());
+}
+
+void NarrowPhase::clear()
+{
+	m_manifolds.clear();
+	m_keys.clear();
+	m_previousManifolds.clear();
+	m_previousKeys.clear();
+}
+
+std::size_t NarrowPhase::contactCount() const
+{
+	std::size_t count = 0;
+	for (const auto& manifold : m_manifolds) count += manifold.pointCount;
+	return count;
+}
+
+bool NarrowPhase::collideBoxes(const BoxShape& a, const BoxShape& b, ContactManifold& manifold)
+{
+	manifold.pointCount = 0;
+
+	// Rotation and translation of B in the frame of A
+	const Eigen::Vector3d d = b.center - a.center;
+	const Eigen::Matrix3d rotation = a.rotation.transpose()*b.rotation;
+	const Eigen::Matrix3d absRotation = rotation.cwiseAbs();
+	const Eigen::Vector3d translation = a.rotation.transpose()*d;
+	const Eigen::Vector3d translationB = b.rotation.transpose()*d;
+	const Eigen::Vector3d& ha = a.halfExtents;
+	const Eigen::Vector3d& hb = b.halfExtents;
+
+	// Face axes of A and B
+	double separationA = -std::numeric_limits<double>::infinity();
+	double separationB = -std::numeric_limits<double>::infinity();
+	int faceA = 0, faceB = 0;
+	for (int i = 0; i < 3; i++) {
+		const double s = std::abs(translation[i]) - (ha[i] + absRotation.row(i).dot(hb));
+		if (s > 0) return false;
+		if (s > separationA) {
+			separationA = s;
+			faceA = i;
+		}
+	}
+	for (int j = 0; j < 3; j++) {
+		const double s = std::abs(translationB[j]) - (absRotation.col(j).dot(ha) + hb[j]);
+		if (s > 0) return false;
+		if (s > separationB) {
+			separationB = s;
+			faceB = j;
+		}
+	}
+
+	// Edge axes, i.e. the cross products of the axes of A and B
+	double separationEdge = -std::numeric_limits<double>::infinity();
+	int edgeA = 0, edgeB = 0;
+	for (int i = 0; i < 3; i++) {
+		const int i1 = (i + 1) % 3;
+		const int i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; j++) {
+			const int j1 = (j + 1) % 3;
+			const int j2 = (j + 2) % 3;
+
+			const double length = std::sqrt(rotation(i1, j)*rotation(i1, j) + rotation(i2, j)*rotation(i2, j));
+			if (length < parallelEdgeTolerance) continue;
+
+			const double distance = std::abs(translation[i2]*rotation(i1, j) - translation[i1]*rotation(i2, j));
+			const double radiusA = ha[i1]*absRotation(i2, j) + ha[i2]*absRotation(i1, j);
+			const double radiusB = hb[j1]*absRotation(i, j2) + hb[j2]*absRotation(i, j1);
+			const double s = (distance - radiusA - radiusB)/length;
+			if (s > 0) return false;
+			if (s > separationEdge) {
+				separationEdge = s;
+				edgeA = i;
+				edgeB = j;
+			}
+		}
+	}
+
+	const bool useB = separationB > relativeAxisTolerance*separationA + absoluteAxisTolerance;
+	const double separationFace = useB ? separationB : separationA;
+	if (separationEdge > relativeAxisTolerance*separationFace + absoluteAxisTolerance) {
+		edgeContact(a, b, edgeA, edgeB, separationEdge, manifold);
+	} else if (useB) {
+		faceContact(b, a, faceB, true, manifold);
+	} else {
+		faceContact(a, b, faceA, false, manifold);
+	}
+	return manifold.pointCount > 0;
+}
+
+const ContactManifold* NarrowPhase::findPrevious(EntityType entityA, EntityType entityB) const
+{
+	const ManifoldKey key = { static_cast<std::uint64_t>(entityA) << 32 | entityB, 0 };
+	const auto it = std::lower_bound(m_previousKeys.begin(), m_previousKeys.end(), key);
+	return (it != m_previousKeys.end() && it->entities == key.entities) ? &m_previousManifolds[it->manifold] : nullptr;
+}
+
+void NarrowPhase::collide(const BodyStateStore& store, std::uint32_t colliderA, std::uint32_t colliderB, ContactManifold& manifold) const
+{
+	EntityType entityA = store.colliders.entities[colliderA];
+	EntityType entityB = store.colliders.entities[colliderB];
+	if (entityA > entityB) {
+		std::swap(colliderA, colliderB);
+		std::swap(entityA, entityB);
+	}
+
+	const ContactManifold* previous = findPrevious(entityA, entityB);
+
+	// Pairs of sleeping and unmoving static bodies keep their contacts
+	const auto isResting = [&](std::uint32_t collider) {
+		const auto& body = store.colliders.bodies[collider];
+		if (store.translational.sleeping[body.translational] && store.rotational.sleeping[body.rotational]) return true;
+		return !(store.translational.mass[body.translational] > 0) && store.translational.linearVelocity[body.translational].isZero(0.0)
+			   && store.rotational.angularVelocity[body.rotational].isZero(0.0);
+	};
+	if (previous && isResting(colliderA) && isResting(colliderB)) {
+		manifold = *previous;
+		manifold.colliderA = colliderA;
+		manifold.colliderB = colliderB;
+		return;
+	}
+
+	manifold.colliderA = colliderA;
+	manifold.colliderB = colliderB;
+	manifold.entityA = entityA;
+	manifold.entityB = entityB;
+	manifold.pointCount = 0;
+	manifold.tangentImpulse[0] = 0.0;
+	manifold.tangentImpulse[1] = 0.0;
+	manifold.twistImpulse = 0.0;
+
+	const BoxShape a = boxShape(store, colliderA);
+	const BoxShape b = boxShape(store, colliderB);
+
+	if (m_settings.separatingAxisForCuboids) {
+		if (!collideBoxes(a, b, manifold)) return;
+		computeLocalPositions(a, b, manifold);
+		if (previous) matchFeatures(*previous, manifold);
+	} else {
+		collideConvex(a, b, previous, manifold);
+	}
+}
+
+void NarrowPhase::collideConvex(const BoxShape& a, const BoxShape& b, const ContactManifold* previous, ContactManifold& manifold) const
+{
+	GjkEpa::Result result;
+	if (!GjkEpa::penetration(a, b, result)) return;
+
+	manifold.normal = result.normal;
+	const double threshold = m_settings.contactBreakingThreshold;
+
+	// Refresh the points of the previous step and remove the ones that separated or slid away
+	std::array<ContactPoint, 5> points;
+	std::size_t count = 0;
+	if (previous) {
+		for (std::uint32_t p = 0; p < previous->pointCount; p++) {
+			const auto& point = previous->points[p];
+			const Eigen::Vector3d pointA = a.center + a.rotation*point.localPositionA;
+			const Eigen::Vector3d pointB = b.center + b.rotation*point.localPositionB;
+			const double penetration = (pointA - pointB).dot(manifold.normal);
+			const Eigen::Vector3d drift = (pointA - pointB) - penetration*manifold.normal;
+			if (penetration < -threshold || drift.squaredNorm() > threshold*threshold) continue;
+
+			auto& refreshed = points[count++];
+			refreshed = point;
+			refreshed.position = 0.5*(pointA + pointB);
+			refreshed.penetration = penetration;
+		}
+	}
+
+	// The new point replaces a nearby persistent point, keeping its impulses
+	ContactPoint newPoint;
+	newPoint.position = 0.5*(result.pointA + result.pointB);
+	newPoint.localPositionA = a.rotation.transpose()*(result.pointA - a.center);
+	newPoint.localPositionB = b.rotation.transpose()*(result.pointB - b.center);
+	newPoint.penetration = result.depth;
+
+	std::size_t nearest = count;
+	double nearestDistance = threshold*threshold;
+	for (std::size_t p = 0; p < count; p++) {
+		const double distance = (points[p].position - newPoint.position).squaredNorm();
+		if (distance < nearestDistance) {
+			nearest = p;
+			nearestDistance = distance;
+		}
+	}
+	if (nearest < count) {
+		newPoint.featureId = points[nearest].featureId;
+		newPoint.normalImpulse = points[nearest].normalImpulse;
+		points[nearest] = newPoint;
+	} else {
+		// Unique id within the manifold so that the points can be distinguished by the solver
+		std::uint32_t id = 0;
+		while (std::any_of(points.begin(), points.begin() + count, [id](const ContactPoint& p) { return p.featureId == id; })) id++;
+		newPoint.featureId = id;
+		points[count++] = newPoint;
+	}
+
+	manifold.pointCount = static_cast<std::uint32_t>(reducePoints(points, count, manifold.normal));
+	std::copy(points.begin(), points.begin() + manifold.pointCount, manifold.points.begin());
+	if (previous) matchFriction(*previous, manifold);
+}
+
+BoxShape NarrowPhase::boxShape(const BodyStateStore& store, std::uint32_t collider)
+{
+	const auto& body = store.colliders.bodies[collider];
+	return { store.translational.position[body.translational], store.rotational.rotationMatrix[body.rotational],
+			 store.colliders.halfExtents[collider] };
+}
+
+void NarrowPhase::computeLocalPositions(const BoxShape& a, const BoxShape& b, ContactManifold& manifold)
+{
+	for (std::uint32_t p = 0; p < manifold.pointCount; p++) {
+		auto& point = manifold.points[p];
+		const Eigen::Vector3d halfPenetration = (0.5*point.penetration)*manifold.normal;
+		point.localPositionA = a.rotation.transpose()*(point.position + halfPenetration - a.center);
+		point.localPositionB = b.rotation.transpose()*(point.position - halfPenetration - b.center);
+	}
+}
+
+void NarrowPhase::matchFeatures(const ContactManifold& previous, ContactManifold& manifold)
+{
+	if (!matchFriction(previous, manifold)) return;
+
+	for (std::uint32_t p = 0; p < manifold.pointCount; p++) {
+		auto& point = manifold.points[p];
+		for (std::uint32_t q = 0; q < previous.pointCount; q++) {
+			const auto& previousPoint = previous.points[q];
+			if (previousPoint.featureId != point.featureId) continue;
+
+			point.normalImpulse = previousPoint.normalImpulse;
+			break;
+		}
+	}
+}
+
+bool NarrowPhase::matchFriction(const ContactManifold& previous, ContactManifold& manifold)
+{
+	// Impulses along a different normal are not useful as initial guess
+	constexpr double minNormalCosine = 0.95;
+	if (previous.normal.dot(manifold.normal) < minNormalCosine) return false;
+
+	manifold.tangentImpulse[0] = previous.tangentImpulse[0];
+	manifold.tangentImpulse[1] = previous.tangentImpulse[1];
+	manifold.twistImpulse = previous.twistImpulse;
+	return true;
+}
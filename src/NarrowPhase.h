@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "BodyStateStore.h"
+#include "BroadPhase.h"
+#include "ConvexCollision.h"
+#include "WorkerPool.h"
+
+//! Contact point of a ContactManifold.
+struct ContactPoint
+{
+	//! World position halfway between the surfaces of the two colliders.
+	Eigen::Vector3d position = Eigen::Vector3d::Zero();
+	//! Contact points on the surfaces of the colliders in their local frames.
+	Eigen::Vector3d localPositionA = Eigen::Vector3d::Zero();
+	Eigen::Vector3d localPositionB = Eigen::Vector3d::Zero();
+	//! Penetration depth along the normal, positive if the colliders overlap.
+	double penetration = 0.0;
+	//! Identifies the pair of features that generated the point, equal ids are matched over consecutive steps.
+	std::uint32_t featureId = 0;
+
+	//! Accumulated normal impulse of the contact solver, carried over to the next step for warm starting.
+	double normalImpulse = 0.0;
+};
+
+//! Contacts of a pair of colliders, A is the collider of the entity with the smaller id.
+struct ContactManifold
+{
+	std::uint32_t colliderA;
+	std::uint32_t colliderB;
+	EntityType entityA;
+	EntityType entityB;
+
+	//! Unit normal pointing from A to B.
+	Eigen::Vector3d normal = Eigen::Vector3d::UnitX();
+	std::uint32_t pointCount = 0;
+	std::array<ContactPoint, 4> points;
+
+	//! Accumulated friction impulses of the contact solver at the center of the points along the two tangents and around the normal.
+	double tangentImpulse[2] = { 0.0, 0.0 };
+	double twistImpulse = 0.0;
+};
+
+//! Narrow-phase collision detection generating persistent contact manifolds for the pairs of the broad-phase.
+/*
+ * Pairs of cuboids are tested with the separating axis test. For face contacts the incident face is
+ * clipped against the side planes of the reference face and the clipped polygon is reduced to the four
+ * points spanning the largest area. Other shape pairs (and cuboids if the separating axis test is
+ * disabled) are handled by GJK/EPA, which yields a single point per step that is merged into the
+ * manifold of the previous step.
+ *
+ * Manifolds are keyed by the entity pair, so they survive store rebuilds, and the solver impulses of
+ * points with matching feature ids (or positions for GJK/EPA) are carried over. The pairs are processed
+ * in parallel into preallocated buffers, so a step does not allocate once the buffers have grown and the
+ * output order (by collider pair) does not depend on the number of threads.
+ */
+class NarrowPhase
+{
+public:
+	struct Settings
+	{
+		//! Uses the separating axis test for pairs of cuboids, otherwise GJK/EPA.
+		bool separatingAxisForCuboids = true;
+		//! Maximum distance of persistent GJK/EPA points from their original position before they are removed.
+		double contactBreakingThreshold = 0.02;
+	};
+
+	void setSettings(const Settings& settings);
+	const Settings& settings() const;
+
+	//! Reserves the manifold buffers for the colliders of the store, the manifolds are kept as they are matched by entities.
+	void resize(const BodyStateStore& store);
+	//! Computes the manifolds of all overlapping pairs, reusing the manifolds of the previous step.
+	void update(const BodyStateStore& store, WorkerPool& pool, const std::vector<BroadPhase::Pair>& pairs);
+	//! Removes all persistent manifolds.
+	void clear();
+
+	//! Returns the manifolds with at least one contact point of the last update, sorted by collider pair.
+	const std::vector<ContactManifold>& manifolds() const { return m_manifolds; }
+	//! Returns the manifolds for modification, e.g. to store the impulses of the contact solver.
+	std::vector<ContactManifold>& manifolds() { return m_manifolds; }
+	std::size_t contactCount() const;
+
+	//! Computes the contact manifold of two boxes with the separating axis test, returns false if they are separated.
+	static bool collideBoxes(const BoxShape& a, const BoxShape& b, ContactManifold& manifold);
+
+private:
+	//! Number of pairs per task.
+	static constexpr std::size_t pairGrainSize = 64;
+
+	//! Key of a manifold in the previous step.
+	struct ManifoldKey
+	{
+		std::uint64_t entities;
+		std::uint32_t manifold;
+
+		bool operator<(const ManifoldKey& other) const { return entities < other.entities; }
+	};
+
+	Settings m_settings;
+
+	std::vector<ContactManifold> m_manifolds;
+	std::vector<ManifoldKey> m_keys;
+	std::vector<ContactManifold> m_previousManifolds;
+	std::vector<ManifoldKey> m_previousKeys;
+
+	const ContactManifold* findPrevious(EntityType entityA, EntityType entityB) const;
+
+	void collide(const BodyStateStore& store, std::uint32_t colliderA, std::uint32_t colliderB, ContactManifold& manifold) const;
+	void collideConvex(const BoxShape& a, const BoxShape& b, const ContactManifold* previous, ContactManifold& manifold) const;
+
+	static BoxShape boxShape(const BodyStateStore& store, std::uint32_t collider);
+	//! Sets the local positions of the points from their world positions and the penetration.
+	static void computeLocalPositions(const BoxShape& a, const BoxShape& b, ContactManifold& manifold);
+	//! Copies the friction impulses and the normal impulses of the points of the previous manifold with matching feature ids.
+	static void matchFeatures(const ContactManifold& previous, ContactManifold& manifold);
+	//! Copies the friction impulses of the previous manifold if its normal is similar, returns whether they were copied.
+	static bool matchFriction(const ContactManifold& previous, ContactManifold& manifold);
+};
@@ -0,0 +1,92 @@
+#include "RenderStateBuffer.h"
+
+#include <algorithm>
+
+void RenderStateBuffer::capture(const std::vector<RenderData*>& components)
+{
+	std::swap(m_previous, m_current);
+
+	m_current.resize(components.size());
+	for (std::size_t i = 0; i < components.size(); i++) m_current[i] = *components[i];
+	m_captured = true;
+
+	// The entities changed, there is nothing to interpolate from
+	if (m_previous.size() != m_current.size()) m_previous = m_current;
+}
+
+void RenderStateBuffer::publish(double alpha)
+{
+	const bool captured = m_captured;
+	if (captured) {
+		m_stagedPrevious.assign(m_previous.begin(), m_previous.end());
+		m_stagedCurrent.assign(m_current.begin(), m_current.end());
+		m_captured = false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (captured) {
+		std::swap(m_publishedPrevious, m_stagedPrevious);
+		std::swap(m_publishedCurrent, m_stagedCurrent);
+	}
+	m_publishedAlpha = std::min(std::max(alpha, 0.0), 1.0);
+	m_published = true;
+}
+
+void RenderStateBuffer::clear()
+{
+	m_previous.clear();
+	m_current.clear();
+	m_captured = false;
+	m_stagedPrevious.clear();
+	m_stagedCurrent.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_publishedPrevious.clear();
+	m_publishedCurrent.clear();
+	m_publishedAlpha = 1.0;
+	m_published = false;
+}
+
+bool RenderStateBuffer::interpolate(RenderDataArray& renderData) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_published) return false;
+
+	const auto alpha = static_cast<float>(m_publishedAlpha);
+	renderData.resize(m_publishedCurrent.size());
+	for (std::size_t i = 0; i < m_publishedCurrent.size(); i++) {
+		renderData[i] = interpolate(m_publishedPrevious[i], m_publishedCurrent[i], alpha);
+	}
+	return true;
+}
+
+double RenderStateBuffer::alpha() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_publishedAlpha;
+}
+
+RenderData RenderStateBuffer::interpolate(const RenderData& previous, const RenderData& current, float alpha)
+{
+	RenderData result = current;
+
+	const auto previousCuboid = common::variant::get_if<RenderData::Cuboid>(&previous.properties);
+	if (auto cuboid = common::variant::get_if<RenderData::Cuboid>(&result.properties)) {
+		if (previousCuboid) {
+			cuboid->position = previousCuboid->position + alpha*(cuboid->position - previousCuboid->position);
+			cuboid->rotation = previousCuboid->rotation.slerp(alpha, cuboid->rotation);
+		}
+	}
+
+	const auto previousJoint = common::variant::get_if<RenderData::Joint>(&previous.properties);
+	if (auto joint = common::variant::get_if<RenderData::Joint>(&result.properties)) {
+		if (previousJoint) {
+			auto& positions = joint->connectorPositions;
+			const auto& previousPositions = previousJoint->connectorPositions;
+			positions.first = previousPositions.first + alpha*(positions.first - previousPositions.first);
+			positions.second = previousPositions.second + alpha*(positions.second - previousPositions.second);
+		}
+	}
+
+	return result;
+}
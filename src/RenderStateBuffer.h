@@ -0,0 +1,50 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "BodyStateStore.h"
+#include "EntityComponentSystem.h"
+
+//! Render data of the last two timesteps, published by the animation thread for interpolation by the renderer.
+/*
+ * The animation thread captures the RenderData components after the fixed timesteps and publishes the
+ * previous and current state together with the fraction of the timestep that already elapsed in wall
+ * clock time. The renderer interpolates between the published states, so it can run at any rate
+ * independent of the fixed timestep. The states are copied into staging buffers by the animation thread
+ * and only swapped with the published buffers under the mutex, so a reader never waits for a copy.
+ */
+class RenderStateBuffer
+{
+public:
+	using RenderDataArray = BodyStateStore::aligned_vector<RenderData>;
+
+	//! Captures the specified components as the current state, the last captured state becomes the previous state.
+	void capture(const std::vector<RenderData*>& components);
+	//! Publishes the interpolation factor and the states captured since the last publish, 'alpha' is clamped to [0, 1].
+	void publish(double alpha);
+	//! Removes all states, e.g. after the entities were changed.
+	void clear();
+
+	//! Writes the published render data interpolated between the previous and current state, returns false if nothing was published.
+	bool interpolate(RenderDataArray& renderData) const;
+	//! Returns the interpolation factor of the last publish.
+	double alpha() const;
+
+	//! Interpolates the positions and rotations of two states of an entity, other properties are taken from the current state.
+	static RenderData interpolate(const RenderData& previous, const RenderData& current, float alpha);
+
+private:
+	RenderDataArray m_previous;
+	RenderDataArray m_current;
+	//! Set by capture, the states are only copied for publishing if they changed.
+	bool m_captured = false;
+	RenderDataArray m_stagedPrevious;
+	RenderDataArray m_stagedCurrent;
+
+	mutable std::mutex m_mutex;
+	RenderDataArray m_publishedPrevious;
+	RenderDataArray m_publishedCurrent;
+	double m_publishedAlpha = 1.0;
+	bool m_published = false;
+};
@@ -0,0 +1,50 @@
+#include "RollingStatistics.h"
+
+#include <algorithm>
+
+RollingStatistics::RollingStatistics()
+	: m_sampleCount(0)
+{
+	for (auto& sample : m_samples) sample.store(0.0, std::memory_order_relaxed);
+}
+
+void RollingStatistics::add(double value)
+{
+	const std::size_t count = m_sampleCount.load(std::memory_order_relaxed);
+	m_samples[count % windowSize].store(value, std::memory_order_relaxed);
+
+	// Publishes the sample to readers that acquire the count
+	m_sampleCount.store(count + 1, std::memory_order_release);
+}
+
+std::size_t RollingStatistics::sampleCount() const
+{
+	return std::min(m_sampleCount.load(std::memory_order_acquire), windowSize);
+}
+
+RollingStatistics::Percentiles RollingStatistics::percentiles() const
+{
+	const std::size_t count = m_sampleCount.load(std::memory_order_acquire);
+
+	Percentiles result;
+	if (count == 0) return result;
+	const std::size_t sampleCount = std::min(count, windowSize);
+
+	std::array<double, windowSize> values;
+	for (std::size_t i = 0; i < sampleCount; i++) values[i] = m_samples[i].load(std::memory_order_relaxed);
+
+	const auto begin = values.begin();
+	const auto end = values.begin() + sampleCount;
+	const auto at = [&](double q) {
+		const auto nth = begin + static_cast<std::ptrdiff_t>(q*(sampleCount - 1) + 0.5);
+		std::nth_element(begin, nth, end);
+		return *nth;
+	};
+
+	result.last = m_samples[(count - 1) % windowSize].load(std::memory_order_relaxed);
+	result.p50 = at(0.5);
+	result.p95 = at(0.95);
+	result.p99 = at(0.99);
+	result.max = *std::max_element(begin, end);
+	return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+//! Rolling window of the last samples of a single quantity with percentiles.
+/*
+ * The samples are added by a single thread and summarized by any other thread without locks. Every sample
+ * is an atomic value, so percentiles computed concurrently to add() may mix old and new samples but never
+ * contain torn values. Neither add() nor percentiles() allocate.
+ */
+class RollingStatistics
+{
+public:
+	//! Number of samples in the rolling window.
+	static constexpr std::size_t windowSize = 256;
+
+	struct Percentiles
+	{
+		double last = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	RollingStatistics();
+
+	//! Adds a sample, replacing the oldest sample of the window. Must only be called by a single thread.
+	void add(double value);
+	//! Returns the number of samples in the window, at most 'windowSize'.
+	std::size_t sampleCount() const;
+	//! Computes the percentiles of the window, may be called by any thread.
+	Percentiles percentiles() const;
+
+private:
+	std::array<std::atomic<double>, windowSize> m_samples;
+	//! Number of added samples, the next sample is written at this index modulo the window size.
+	std::atomic<std::size_t> m_sampleCount;
+};
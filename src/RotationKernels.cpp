@@ -0,0 +1,141 @@
+#include "RotationKernels.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+#endif
+
+#include "RotationKernelsImpl.h"
+
+// The kernels reinterpret the Eigen arrays as plain arrays of doubles
+static_assert(sizeof(Eigen::Vector3d) == 3*sizeof(double), "Unexpected memory layout of Eigen::Vector3d");
+static_assert(sizeof(Eigen::Quaterniond) == 4*sizeof(double), "Unexpected memory layout of Eigen::Quaterniond");
+static_assert(sizeof(Eigen::Matrix3d) == 9*sizeof(double), "Unexpected memory layout of Eigen::Matrix3d");
+
+const RotationKernelTable rotationKernelsScalar = makeRotationKernelTable<ScalarPack>(true);
+
+namespace
+{
+	bool cpuSupports(RotationKernels::InstructionSet instructionSet)
+	{
+		using InstructionSet = RotationKernels::InstructionSet;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		switch (instructionSet) {
+		case InstructionSet::Scalar: return true;
+		case InstructionSet::Sse2: return __builtin_cpu_supports("sse2");
+		case InstructionSet::Avx2: return __builtin_cpu_supports("avx2");
+		case InstructionSet::Avx512: return __builtin_cpu_supports("avx512f");
+		}
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		// The OS has to save the AVX (and AVX-512) register state on context switches
+		const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		const bool avxState = (xcr0 & 0x6) == 0x6;
+		const bool avx512State = (xcr0 & 0xe6) == 0xe6;
+
+		int extended[4] = { 0, 0, 0, 0 };
+		if (maxLeaf >= 7) __cpuidex(extended, 7, 0);
+
+		switch (instructionSet) {
+		case InstructionSet::Scalar: return true;
+		case InstructionSet::Sse2: return sse2;
+		case InstructionSet::Avx2: return avxState && (extended[1] & (1 << 5)) != 0;
+		case InstructionSet::Avx512: return avx512State && (extended[1] & (1 << 16)) != 0;
+		}
+#endif
+		return instructionSet == InstructionSet::Scalar;
+	}
+
+	const RotationKernelTable& kernelTable(RotationKernels::InstructionSet instructionSet)
+	{
+		switch (instructionSet) {
+		case RotationKernels::InstructionSet::Sse2: return rotationKernelsSse2;
+		case RotationKernels::InstructionSet::Avx2: return rotationKernelsAvx2;
+		case RotationKernels::InstructionSet::Avx512: return rotationKernelsAvx512;
+		default: return rotationKernelsScalar;
+		}
+	}
+
+	bool isSupported(RotationKernels::InstructionSet instructionSet)
+	{
+		return kernelTable(instructionSet).compiled && cpuSupports(instructionSet);
+	}
+
+	//! Pointer to the table of the active instruction set, selected on first use
+	std::atomic<const RotationKernelTable*> activeTable(nullptr);
+	std::atomic<RotationKernels::InstructionSet> activeInstructionSet(RotationKernels::InstructionSet::Scalar);
+
+	const RotationKernelTable& kernels()
+	{
+		const RotationKernelTable* table = activeTable.load(std::memory_order_acquire);
+		if (!table) {
+			RotationKernels::setInstructionSet(RotationKernels::supportedInstructionSet());
+			table = activeTable.load(std::memory_order_acquire);
+		}
+		return *table;
+	}
+}
+
+RotationKernels::InstructionSet RotationKernels::supportedInstructionSet()
+{
+	for (auto instructionSet : { InstructionSet::Avx512, InstructionSet::Avx2, InstructionSet::Sse2 }) {
+		if (isSupported(instructionSet)) return instructionSet;
+	}
+	return InstructionSet::Scalar;
+}
+
+RotationKernels::InstructionSet RotationKernels::instructionSet()
+{
+	kernels();
+	return activeInstructionSet.load();
+}
+
+void RotationKernels::setInstructionSet(InstructionSet instructionSet)
+{
+	if (!isSupported(instructionSet)) instructionSet = supportedInstructionSet();
+
+	activeInstructionSet.store(instructionSet);
+	activeTable.store(&kernelTable(instructionSet), std::memory_order_release);
+}
+
+const char* RotationKernels::instructionSetName(InstructionSet instructionSet)
+{
+	switch (instructionSet) {
+	case InstructionSet::Scalar: return "Scalar";
+	case InstructionSet::Sse2: return "SSE2";
+	case InstructionSet::Avx2: return "AVX2";
+	case InstructionSet::Avx512: return "AVX-512";
+	}
+	return "Unknown";
+}
+
+void RotationKernels::integrateRotations(std::size_t count, double dt,
+										 const Eigen::Vector3d* angularVelocity, const std::uint8_t* sleeping,
+										 Eigen::Quaterniond* rotation)
+{
+	if (count == 0) return;
+	kernels().integrateRotations(count, dt, angularVelocity->data(), sleeping, rotation->coeffs().data());
+}
+
+void RotationKernels::updateRotationMatrices(std::size_t count, Eigen::Quaterniond* rotation, Eigen::Matrix3d* rotationMatrix)
+{
+	if (count == 0) return;
+	kernels().updateRotationMatrices(count, rotation->coeffs().data(), rotationMatrix->data());
+}
+
+void RotationKernels::updateInertiaMatrices(std::size_t count,
+											const Eigen::Vector3d* principalInertia, const Eigen::Matrix3d* rotationMatrix,
+											Eigen::Matrix3d* inertiaMatrix, Eigen::Matrix3d* inverseInertiaMatrix)
+{
+	if (count == 0) return;
+	kernels().updateInertiaMatrices(count, principalInertia->data(), rotationMatrix->data(),
+									inertiaMatrix->data(), inverseInertiaMatrix->data());
+}
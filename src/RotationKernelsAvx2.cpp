@@ -0,0 +1,63 @@
+// Compiled with AVX2 enabled, see src/CMakeLists.txt
+#include "RotationKernelsImpl.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+namespace
+{
+	struct Avx2Pack
+	{
+		static constexpr std::size_t width = 4;
+		using Mask = __m256d;
+
+		__m256d v;
+
+		static __m256i offsets(std::size_t stride)
+		{
+			const long long s = static_cast<long long>(stride);
+			return _mm256_set_epi64x(3*s, 2*s, s, 0);
+		}
+
+		static Avx2Pack broadcast(double x) { return { _mm256_set1_pd(x) }; }
+		static Avx2Pack load(const double* p, std::size_t stride) { return { _mm256_i64gather_pd(p, offsets(stride), 8) }; }
+
+		void store(double* p, std::size_t stride) const
+		{
+			alignas(32) double lanes[4];
+			_mm256_store_pd(lanes, v);
+			for (std::size_t l = 0; l < 4; l++) p[l*stride] = lanes[l];
+		}
+
+		void store(double* p, std::size_t stride, Mask mask) const
+		{
+			alignas(32) double lanes[4];
+			_mm256_store_pd(lanes, v);
+			const int bits = _mm256_movemask_pd(mask);
+			for (std::size_t l = 0; l < 4; l++) if (bits & (1 << l)) p[l*stride] = lanes[l];
+		}
+
+		static Mask awake(const std::uint8_t* sleeping)
+		{
+			const __m256i flags = _mm256_set_epi64x(sleeping[3], sleeping[2], sleeping[1], sleeping[0]);
+			return _mm256_castsi256_pd(_mm256_cmpeq_epi64(flags, _mm256_setzero_si256()));
+		}
+
+		friend Avx2Pack operator+(Avx2Pack a, Avx2Pack b) { return { _mm256_add_pd(a.v, b.v) }; }
+		friend Avx2Pack operator-(Avx2Pack a, Avx2Pack b) { return { _mm256_sub_pd(a.v, b.v) }; }
+		friend Avx2Pack operator*(Avx2Pack a, Avx2Pack b) { return { _mm256_mul_pd(a.v, b.v) }; }
+		friend Avx2Pack operator/(Avx2Pack a, Avx2Pack b) { return { _mm256_div_pd(a.v, b.v) }; }
+		friend Avx2Pack sqrt(Avx2Pack a) { return { _mm256_sqrt_pd(a.v) }; }
+		friend Mask greater(Avx2Pack a, Avx2Pack b) { return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ); }
+		friend Avx2Pack select(Mask mask, Avx2Pack a, Avx2Pack b) { return { _mm256_blendv_pd(b.v, a.v, mask) }; }
+	};
+}
+
+const RotationKernelTable rotationKernelsAvx2 = makeRotationKernelTable<Avx2Pack>(true);
+
+#else
+
+const RotationKernelTable rotationKernelsAvx2 = makeRotationKernelTable<ScalarPack>(false);
+
+#endif
@@ -0,0 +1,51 @@
+// Compiled with AVX-512F enabled, see src/CMakeLists.txt
+#include "RotationKernelsImpl.h"
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+namespace
+{
+	struct Avx512Pack
+	{
+		static constexpr std::size_t width = 8;
+		using Mask = __mmask8;
+
+		__m512d v;
+
+		static __m512i offsets(std::size_t stride)
+		{
+			const long long s = static_cast<long long>(stride);
+			return _mm512_set_epi64(7*s, 6*s, 5*s, 4*s, 3*s, 2*s, s, 0);
+		}
+
+		static Avx512Pack broadcast(double x) { return { _mm512_set1_pd(x) }; }
+		static Avx512Pack load(const double* p, std::size_t stride) { return { _mm512_i64gather_pd(offsets(stride), p, 8) }; }
+
+		void store(double* p, std::size_t stride) const { _mm512_i64scatter_pd(p, offsets(stride), v, 8); }
+		void store(double* p, std::size_t stride, Mask mask) const { _mm512_mask_i64scatter_pd(p, mask, offsets(stride), v, 8); }
+
+		static Mask awake(const std::uint8_t* sleeping)
+		{
+			const __m512i flags = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sleeping)));
+			return _mm512_cmpeq_epi64_mask(flags, _mm512_setzero_si512());
+		}
+
+		friend Avx512Pack operator+(Avx512Pack a, Avx512Pack b) { return { _mm512_add_pd(a.v, b.v) }; }
+		friend Avx512Pack operator-(Avx512Pack a, Avx512Pack b) { return { _mm512_sub_pd(a.v, b.v) }; }
+		friend Avx512Pack operator*(Avx512Pack a, Avx512Pack b) { return { _mm512_mul_pd(a.v, b.v) }; }
+		friend Avx512Pack operator/(Avx512Pack a, Avx512Pack b) { return { _mm512_div_pd(a.v, b.v) }; }
+		friend Avx512Pack sqrt(Avx512Pack a) { return { _mm512_sqrt_pd(a.v) }; }
+		friend Mask greater(Avx512Pack a, Avx512Pack b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ); }
+		friend Avx512Pack select(Mask mask, Avx512Pack a, Avx512Pack b) { return { _mm512_mask_blend_pd(mask, b.v, a.v) }; }
+	};
+}
+
+const RotationKernelTable rotationKernelsAvx512 = makeRotationKernelTable<Avx512Pack>(true);
+
+#else
+
+const RotationKernelTable rotationKernelsAvx512 = makeRotationKernelTable<ScalarPack>(false);
+
+#endif
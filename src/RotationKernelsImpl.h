@@ -0,0 +1,215 @@
+#pragma once
+
+// Internal header of the RotationKernels, included by the instruction set specific translation units.
+// Everything that is compiled with instruction set specific flags has internal linkage and only operates
+// on raw pointers, so no inline function compiled for a newer instruction set can leak into other code.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+//! Function table of the kernels of one instruction set, operating on raw arrays.
+struct RotationKernelTable
+{
+	//! Whether the translation unit was compiled with the required instruction set enabled.
+	bool compiled;
+
+	void(*integrateRotations)(std::size_t count, double dt, const double* angularVelocity, const std::uint8_t* sleeping, double* rotation);
+	void(*updateRotationMatrices)(std::size_t count, double* rotation, double* rotationMatrix);
+	void(*updateInertiaMatrices)(std::size_t count, const double* principalInertia, const double* rotationMatrix,
+								 double* inertiaMatrix, double* inverseInertiaMatrix);
+};
+
+extern const RotationKernelTable rotationKernelsScalar;
+extern const RotationKernelTable rotationKernelsSse2;
+extern const RotationKernelTable rotationKernelsAvx2;
+extern const RotationKernelTable rotationKernelsAvx512;
+
+namespace
+{
+	// Array strides (in doubles) of the Eigen types stored in the arrays
+	constexpr std::size_t vectorStride = 3;
+	constexpr std::size_t quaternionStride = 4;
+	constexpr std::size_t matrixStride = 9;
+
+	//! Single lane "vector" type used for the scalar variant and the remainders of the vectorized variants.
+	struct ScalarPack
+	{
+		static constexpr std::size_t width = 1;
+		using Mask = bool;
+
+		double v;
+
+		static ScalarPack broadcast(double x) { return { x }; }
+		static ScalarPack load(const double* p, std::size_t) { return { p[0] }; }
+		void store(double* p, std::size_t) const { p[0] = v; }
+		void store(double* p, std::size_t, Mask mask) const { if (mask) p[0] = v; }
+		static Mask awake(const std::uint8_t* sleeping) { return sleeping[0] == 0; }
+
+		friend ScalarPack operator+(ScalarPack a, ScalarPack b) { return { a.v + b.v }; }
+		friend ScalarPack operator-(ScalarPack a, ScalarPack b) { return { a.v - b.v }; }
+		friend ScalarPack operator*(ScalarPack a, ScalarPack b) { return { a.v * b.v }; }
+		friend ScalarPack operator/(ScalarPack a, ScalarPack b) { return { a.v / b.v }; }
+		friend ScalarPack sqrt(ScalarPack a) { return { std::sqrt(a.v) }; }
+		friend Mask greater(ScalarPack a, ScalarPack b) { return a.v > b.v; }
+		friend ScalarPack select(Mask mask, ScalarPack a, ScalarPack b) { return mask ? a : b; }
+	};
+
+	//! Integrates the quaternions of one block of 'P::width' bodies
+	template <typename P>
+	inline void integrateRotationsBlock(double dt, const double* angularVelocity, const std::uint8_t* sleeping, double* rotation)
+	{
+		const P half = P::broadcast(0.5);
+		const P zero = P::broadcast(0.0);
+		const P step = P::broadcast(dt);
+
+		const auto awake = P::awake(sleeping);
+
+		const P hx = half*P::load(angularVelocity + 0, vectorStride);
+		const P hy = half*P::load(angularVelocity + 1, vectorStride);
+		const P hz = half*P::load(angularVelocity + 2, vectorStride);
+
+		const P qx = P::load(rotation + 0, quaternionStride);
+		const P qy = P::load(rotation + 1, quaternionStride);
+		const P qz = P::load(rotation + 2, quaternionStride);
+		const P qw = P::load(rotation + 3, quaternionStride);
+
+		// Quaternion product (0, h)*q
+		const P cw = ((zero - hx*qx) - hy*qy) - hz*qz;
+		const P cx = (hx*qw + hy*qz) - hz*qy;
+		const P cy = (hy*qw + hz*qx) - hx*qz;
+		const P cz = (hz*qw + hx*qy) - hy*qx;
+
+		select(awake, qx + step*cx, qx).store(rotation + 0, quaternionStride);
+		select(awake, qy + step*cy, qy).store(rotation + 1, quaternionStride);
+		select(awake, qz + step*cz, qz).store(rotation + 2, quaternionStride);
+		select(awake, qw + step*cw, qw).store(rotation + 3, quaternionStride);
+	}
+
+	//! Normalizes the quaternions and computes the rotation matrices of one block of 'P::width' bodies
+	template <typename P>
+	inline void updateRotationMatricesBlock(double* rotation, double* rotationMatrix)
+	{
+		const P zero = P::broadcast(0.0);
+		const P one = P::broadcast(1.0);
+		const P two = P::broadcast(2.0);
+
+		P x = P::load(rotation + 0, quaternionStride);
+		P y = P::load(rotation + 1, quaternionStride);
+		P z = P::load(rotation + 2, quaternionStride);
+		P w = P::load(rotation + 3, quaternionStride);
+
+		// Normalization, same summation order as the vectorized Eigen reduction
+		const P squaredNorm = (x*x + z*z) + (y*y + w*w);
+		const auto nonZero = greater(squaredNorm, zero);
+		const P norm = sqrt(squaredNorm);
+		x = select(nonZero, x/norm, x);
+		y = select(nonZero, y/norm, y);
+		z = select(nonZero, z/norm, z);
+		w = select(nonZero, w/norm, w);
+
+		x.store(rotation + 0, quaternionStride);
+		y.store(rotation + 1, quaternionStride);
+		z.store(rotation + 2, quaternionStride);
+		w.store(rotation + 3, quaternionStride);
+
+		// Same operations as Eigen's Quaternion::toRotationMatrix
+		const P tx = two*x;
+		const P ty = two*y;
+		const P tz = two*z;
+		const P twx = tx*w;
+		const P twy = ty*w;
+		const P twz = tz*w;
+		const P txx = tx*x;
+		const P txy = ty*x;
+		const P txz = tz*x;
+		const P tyy = ty*y;
+		const P tyz = tz*y;
+		const P tzz = tz*z;
+
+		// Column major storage, element (r,c) is stored at c*3 + r
+		(one - (tyy + tzz)).store(rotationMatrix + 0, matrixStride);
+		(txy + twz).store(rotationMatrix + 1, matrixStride);
+		(txz - twy).store(rotationMatrix + 2, matrixStride);
+		(txy - twz).store(rotationMatrix + 3, matrixStride);
+		(one - (txx + tzz)).store(rotationMatrix + 4, matrixStride);
+		(tyz + twx).store(rotationMatrix + 5, matrixStride);
+		(txz + twy).store(rotationMatrix + 6, matrixStride);
+		(tyz - twx).store(rotationMatrix + 7, matrixStride);
+		(one - (txx + tyy)).store(rotationMatrix + 8, matrixStride);
+	}
+
+	//! Computes the transformed inertia matrices of one block of 'P::width' bodies
+	template <typename P>
+	inline void updateInertiaMatricesBlock(const double* principalInertia, const double* rotationMatrix,
+										   double* inertiaMatrix, double* inverseInertiaMatrix)
+	{
+		const P zero = P::broadcast(0.0);
+		const P one = P::broadcast(1.0);
+
+		P r[9];
+		for (std::size_t k = 0; k < 9; k++) r[k] = P::load(rotationMatrix + k, matrixStride);
+
+		P inertia[3];
+		P inverseInertia[3];
+		for (std::size_t k = 0; k < 3; k++) {
+			inertia[k] = P::load(principalInertia + k, vectorStride);
+			inverseInertia[k] = one/inertia[k];
+		}
+
+		const auto hasInertia = greater((inertia[0] + inertia[1]) + inertia[2], zero);
+
+		// (R*diag(d))*R^T, element (r,s) = sum_k R(r,k)*d(k)*R(s,k), accumulated in order of k
+		const auto transform = [&](const P* d, double* result) {
+			for (std::size_t c = 0; c < 3; c++) {
+				for (std::size_t row = 0; row < 3; row++) {
+					const P value = ((r[row]*d[0])*r[c] + (r[3 + row]*d[1])*r[3 + c]) + (r[6 + row]*d[2])*r[6 + c];
+					value.store(result + 3*c + row, matrixStride, hasInertia);
+				}
+			}
+		};
+
+		transform(inertia, inertiaMatrix);
+		transform(inverseInertia, inverseInertiaMatrix);
+	}
+
+	template <typename P>
+	void integrateRotations(std::size_t count, double dt, const double* angularVelocity, const std::uint8_t* sleeping, double* rotation)
+	{
+		std::size_t i = 0;
+		for (; i + P::width <= count; i += P::width)
+			integrateRotationsBlock<P>(dt, angularVelocity + vectorStride*i, sleeping + i, rotation + quaternionStride*i);
+		for (; i < count; i++)
+			integrateRotationsBlock<ScalarPack>(dt, angularVelocity + vectorStride*i, sleeping + i, rotation + quaternionStride*i);
+	}
+
+	template <typename P>
+	void updateRotationMatrices(std::size_t count, double* rotation, double* rotationMatrix)
+	{
+		std::size_t i = 0;
+		for (; i + P::width <= count; i += P::width)
+			updateRotationMatricesBlock<P>(rotation + quaternionStride*i, rotationMatrix + matrixStride*i);
+		for (; i < count; i++)
+			updateRotationMatricesBlock<ScalarPack>(rotation + quaternionStride*i, rotationMatrix + matrixStride*i);
+	}
+
+	template <typename P>
+	void updateInertiaMatrices(std::size_t count, const double* principalInertia, const double* rotationMatrix,
+							   double* inertiaMatrix, double* inverseInertiaMatrix)
+	{
+		std::size_t i = 0;
+		for (; i + P::width <= count; i += P::width)
+			updateInertiaMatricesBlock<P>(principalInertia + vectorStride*i, rotationMatrix + matrixStride*i,
+										  inertiaMatrix + matrixStride*i, inverseInertiaMatrix + matrixStride*i);
+		for (; i < count; i++)
+			updateInertiaMatricesBlock<ScalarPack>(principalInertia + vectorStride*i, rotationMatrix + matrixStride*i,
+												   inertiaMatrix + matrixStride*i, inverseInertiaMatrix + matrixStride*i);
+	}
+
+	//! Creates the function table for the specified pack type.
+	template <typename P>
+	constexpr RotationKernelTable makeRotationKernelTable(bool compiled)
+	{
+		return { compiled, &integrateRotations<P>, &updateRotationMatrices<P>, &updateInertiaMatrices<P> };
+	}
+}
@@ -0,0 +1,54 @@
+// Compiled with SSE2 enabled, see src/CMakeLists.txt
+#include "RotationKernelsImpl.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+
+namespace
+{
+	struct Sse2Pack
+	{
+		static constexpr std::size_t width = 2;
+		using Mask = __m128d;
+
+		__m128d v;
+
+		static Sse2Pack broadcast(double x) { return { _mm_set1_pd(x) }; }
+		static Sse2Pack load(const double* p, std::size_t stride) { return { _mm_set_pd(p[stride], p[0]) }; }
+
+		void store(double* p, std::size_t stride) const
+		{
+			_mm_storel_pd(p, v);
+			_mm_storeh_pd(p + stride, v);
+		}
+
+		void store(double* p, std::size_t stride, Mask mask) const
+		{
+			const int bits = _mm_movemask_pd(mask);
+			if (bits & 1) _mm_storel_pd(p, v);
+			if (bits & 2) _mm_storeh_pd(p + stride, v);
+		}
+
+		static Mask awake(const std::uint8_t* sleeping)
+		{
+			return _mm_cmpeq_pd(_mm_set_pd(sleeping[1], sleeping[0]), _mm_setzero_pd());
+		}
+
+		friend Sse2Pack operator+(Sse2Pack a, Sse2Pack b) { return { _mm_add_pd(a.v, b.v) }; }
+		friend Sse2Pack operator-(Sse2Pack a, Sse2Pack b) { return { _mm_sub_pd(a.v, b.v) }; }
+		friend Sse2Pack operator*(Sse2Pack a, Sse2Pack b) { return { _mm_mul_pd(a.v, b.v) }; }
+		friend Sse2Pack operator/(Sse2Pack a, Sse2Pack b) { return { _mm_div_pd(a.v, b.v) }; }
+		friend Sse2Pack sqrt(Sse2Pack a) { return { _mm_sqrt_pd(a.v) }; }
+		friend Mask greater(Sse2Pack a, Sse2Pack b) { return _mm_cmpgt_pd(a.v, b.v); }
+		friend Sse2Pack select(Mask mask, Sse2Pack a, Sse2Pack b) { return { _mm_or_pd(_mm_and_pd(mask, a.v), _mm_andnot_pd(mask, b.v)) }; }
+	};
+}
+
+const RotationKernelTable rotationKernelsSse2 = makeRotationKernelTable<Sse2Pack>(true);
+
+#else
+
+const RotationKernelTable rotationKernelsSse2 = makeRotationKernelTable<ScalarPack>(false);
+
+#endif
@@ -0,0 +1,209 @@
+#include "SimulationIslands.h"
+
+#include <algorithm>
+#include <numeric>
+
+void SimulationIslands::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+}
+
+const SimulationIslands::Settings& SimulationIslands::settings() const
+{
+	return m_settings;
+}
+
+void SimulationIslands::resize(const BodyStateStore& store)
+{
+	const auto& translational = store.translational;
+	const auto& rotational = store.rotational;
+
+	m_translationalCount = translational.size();
+	const std::size_t nodeCount = m_translationalCount + rotational.size();
+	m_parents.resize(nodeCount);
+	m_nodeIsland.resize(nodeCount);
+
+	// Only bodies with mass or inertia are dynamic, the flags change with a rebuild of the store only
+	m_nodeDynamic.resize(nodeCount);
+	for (std::size_t t = 0; t < m_translationalCount; t++) {
+		m_nodeDynamic[t] = (translational.mass[t] > 0) ? 1 : 0;
+	}
+	m_rotationalPartner.resize(rotational.size());
+	for (std::size_t r = 0; r < rotational.size(); r++) {
+		m_nodeDynamic[m_translationalCount + r] = (rotational.prinicipalInertia[r].sum() > 0) ? 1 : 0;
+		m_rotationalPartner[r] = store.bodyIndex(rotational.entities[r]).translational;
+	}
+
+	m_jointIsland.resize(store.joints.size());
+	m_islandCount = 0;
+	m_translationalOffsets.assign(1, 0);
+	m_translationalMembers.clear();
+	m_rotationalOffsets.assign(1, 0);
+	m_rotationalMembers.clear();
+	m_jointOffsets.assign(1, 0);
+	m_jointMembers.clear();
+	m_manifoldOffsets.assign(1, 0);
+	m_manifoldMembers.clear();
+	m_islandAwake.clear();
+	m_solverIslands.clear();
+
+	// Every body may form an island and the manifolds grow with the contacts
+	const std::size_t manifoldCount = store.colliders.size()*BroadPhase::reservedPairsPerCollider;
+	for (auto offsets : { &m_translationalOffsets, &m_rotationalOffsets, &m_jointOffsets, &m_manifoldOffsets }) offsets->reserve(nodeCount + 1);
+	m_translationalMembers.reserve(m_translationalCount);
+	m_rotationalMembers.reserve(rotational.size());
+	m_jointMembers.reserve(store.joints.size());
+	m_manifoldIsland.reserve(manifoldCount);
+	m_manifoldMembers.reserve(manifoldCount);
+	m_islandAwake.reserve(nodeCount);
+	m_solverIslands.reserve(nodeCount);
+	m_fill.reserve(nodeCount);
+}
+
+void SimulationIslands::build(const BodyStateStore& store, const std::vector<ContactManifold>& manifolds)
+{
+	constexpr auto invalidIndex = BodyStateStore::invalidIndex;
+	const auto& joints = store.joints;
+	const std::size_t nodeCount = m_parents.size();
+
+	std::iota(m_parents.begin(), m_parents.end(), 0u);
+
+	// The bodies of an entity and the bodies linked by joints or contacts are united
+	const auto uniteBodies = [&](const BodyStateStore::BodyIndex& first, const BodyStateStore::BodyIndex& second) {
+		const auto a = bodyNode(first);
+		const auto b = bodyNode(second);
+		if (a != invalidIndex && b != invalidIndex) unite(a, b);
+	};
+
+	for (std::size_t r = 0; r < m_rotationalPartner.size(); r++) {
+		const auto rotationalNode = static_cast<std::uint32_t>(m_translationalCount + r);
+		const auto partner = m_rotationalPartner[r];
+		if (partner != invalidIndex && m_nodeDynamic[rotationalNode] && m_nodeDynamic[partner]) unite(rotationalNode, partner);
+	}
+	for (const auto& parents : joints.parents) uniteBodies(parents.first, parents.second);
+	for (const auto& manifold : manifolds) {
+		uniteBodies(store.colliders.bodies[manifold.colliderA], store.colliders.bodies[manifold.colliderB]);
+	}
+
+	// Enumerate the islands in order of their smallest node, a disabled splitting puts all bodies into one island
+	m_islandCount = 0;
+	for (std::uint32_t node = 0; node < nodeCount; node++) {
+		m_nodeIsland[node] = invalidIndex;
+		if (!m_nodeDynamic[node]) continue;
+
+		if (!m_settings.enabled) {
+			m_islandCount = 1;
+			m_nodeIsland[node] = 0;
+			continue;
+		}
+
+		const auto root = find(node);
+		if (m_nodeIsland[root] == invalidIndex) m_nodeIsland[root] = static_cast<std::uint32_t>(m_islandCount++);
+		m_nodeIsland[node] = m_nodeIsland[root];
+	}
+
+	// Assign the joints and manifolds to the island of their first dynamic body
+	const auto constraintIsland = [&](const BodyStateStore::BodyIndex& first, const BodyStateStore::BodyIndex& second) {
+		auto node = bodyNode(first);
+		if (node == invalidIndex) node = bodyNode(second);
+		return (node != invalidIndex) ? m_nodeIsland[node] : invalidIndex;
+	};
+
+	for (std::size_t j = 0; j < joints.size(); j++) {
+		m_jointIsland[j] = constraintIsland(joints.parents[j].first, joints.parents[j].second);
+	}
+	m_manifoldIsland.resize(manifolds.size());
+	for (std::size_t m = 0; m < manifolds.size(); m++) {
+		m_manifoldIsland[m] = constraintIsland(store.colliders.bodies[manifolds[m].colliderA], store.colliders.bodies[manifolds[m].colliderB]);
+	}
+
+	buildRows(m_translationalCount, m_nodeIsland.data(), m_translationalOffsets, m_translationalMembers);
+	buildRows(nodeCount - m_translationalCount, m_nodeIsland.data() + m_translationalCount, m_rotationalOffsets, m_rotationalMembers);
+	buildRows(joints.size(), m_jointIsland.data(), m_jointOffsets, m_jointMembers);
+	buildRows(manifolds.size(), m_manifoldIsland.data(), m_manifoldOffsets, m_manifoldMembers);
+
+	updateSleeping(store);
+}
+
+void SimulationIslands::updateSleeping(const BodyStateStore& store)
+{
+	// An island is awake if any of its bodies is awake
+	m_islandAwake.assign(m_islandCount, 0);
+	for (std::size_t t = 0; t < m_translationalCount; t++) {
+		const auto island = m_nodeIsland[t];
+		if (island != BodyStateStore::invalidIndex && !store.translational.sleeping[t]) m_islandAwake[island] = 1;
+	}
+	for (std::size_t r = 0; r < store.rotational.size(); r++) {
+		const auto island = m_nodeIsland[m_translationalCount + r];
+		if (island != BodyStateStore::invalidIndex && !store.rotational.sleeping[r]) m_islandAwake[island] = 1;
+	}
+
+	updateSolverIslands();
+}
+
+std::size_t SimulationIslands::islandCount() const
+{
+	return m_islandCount;
+}
+
+std::size_t SimulationIslands::constraintCount(std::size_t island) const
+{
+	return (m_jointOffsets[island + 1] - m_jointOffsets[island]) + (m_manifoldOffsets[island + 1] - m_manifoldOffsets[island]);
+}
+
+std::uint32_t SimulationIslands::find(std::uint32_t node)
+{
+	while (m_parents[node] != node) node = m_parents[node] = m_parents[m_parents[node]];
+	return node;
+}
+
+void SimulationIslands::unite(std::uint32_t a, std::uint32_t b)
+{
+	a = find(a);
+	b = find(b);
+	if (a != b) m_parents[std::max(a, b)] = std::min(a, b);
+}
+
+std::uint32_t SimulationIslands::bodyNode(const BodyStateStore::BodyIndex& body) const
+{
+	constexpr auto invalidIndex = BodyStateStore::invalidIndex;
+
+	if (body.translational != invalidIndex && m_nodeDynamic[body.translational]) return body.translational;
+	if (body.rotational != invalidIndex && m_nodeDynamic[m_translationalCount + body.rotational])
+		return static_cast<std::uint32_t>(m_translationalCount + body.rotational);
+	return invalidIndex;
+}
+
+void SimulationIslands::buildRows(std::size_t elementCount, const std::uint32_t* elementIsland,
+								  std::vector<std::uint32_t>& offsets, std::vector<std::uint32_t>& members)
+{
+	// Counting sort by island, the elements of an island keep their ascending order
+	offsets.assign(m_islandCount + 1, 0);
+	for (std::size_t e = 0; e < elementCount; e++) {
+		const auto island = elementIsland[e];
+		if (island != BodyStateStore::invalidIndex) offsets[island + 1]++;
+	}
+	for (std::size_t i = 0; i < m_islandCount; i++) offsets[i + 1] += offsets[i];
+
+	members.resize(offsets.back());
+	m_fill.assign(offsets.begin(), offsets.end() - 1);
+	for (std::size_t e = 0; e < elementCount; e++) {
+		const auto island = elementIsland[e];
+		if (island != BodyStateStore::invalidIndex) members[m_fill[island]++] = static_cast<std::uint32_t>(e);
+	}
+}
+
+void SimulationIslands::updateSolverIslands()
+{
+	m_solverIslands.clear();
+	for (std::size_t island = 0; island < m_islandCount; island++) {
+		if (m_islandAwake[island] && constraintCount(island) > 0) m_solverIslands.push_back(static_cast<std::uint32_t>(island));
+	}
+
+	// Largest islands first, ties are ordered by island so that the order is unique
+	std::sort(m_solverIslands.begin(), m_solverIslands.end(), [this](std::uint32_t a, std::uint32_t b) {
+		const auto countA = constraintCount(a);
+		const auto countB = constraintCount(b);
+		return (countA != countB) ? countA > countB : a < b;
+	});
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BodyStateStore.h"
+#include "NarrowPhase.h"
+
+//! Connected components of the dynamic bodies linked by joints and contacts, rebuilt every (sub) step.
+/*
+ * Bodies without mass and inertia do not connect islands, so the constraints of different islands never
+ * write to the same dynamic body and the islands can be solved in parallel without synchronization. The
+ * translational and rotational body of an entity always belong to the same island. Only awake islands
+ * with at least one joint or contact are listed as solver islands, sorted by decreasing constraint count
+ * so that the largest islands are started first. The SleepController deactivates and wakes up the islands
+ * as a whole, so bodies resting on each other sleep together. All buffers are reused, a build does not
+ * allocate once they have grown.
+ */
+class SimulationIslands
+{
+public:
+	struct Settings
+	{
+		//! Splits the bodies into connected components, otherwise all constraints form a single island.
+		bool enabled = true;
+	};
+
+	void setSettings(const Settings& settings);
+	const Settings& settings() const;
+
+	//! Allocates the buffers for the bodies, joints and contacts of the store and removes all islands.
+	void resize(const BodyStateStore& store);
+	//! Computes the islands of the joints of the store and the contacts of the manifolds.
+	void build(const BodyStateStore& store, const std::vector<ContactManifold>& manifolds);
+	//! Recomputes the list of awake solver islands from the sleeping flags of the bodies, e.g. after a wake up.
+	void updateSleeping(const BodyStateStore& store);
+
+	//! Returns the number of islands of the last build, including sleeping islands and islands without constraints.
+	std::size_t islandCount() const;
+	//! Returns the awake islands with joints or contacts, largest first.
+	const std::vector<std::uint32_t>& solverIslands() const { return m_solverIslands; }
+
+	//! Returns the range of the indices of the dynamic translational bodies of the island, sorted in ascending order.
+	const std::uint32_t* translationalBegin(std::size_t island) const { return m_translationalMembers.data() + m_translationalOffsets[island]; }
+	const std::uint32_t* translationalEnd(std::size_t island) const { return m_translationalMembers.data() + m_translationalOffsets[island + 1]; }
+	//! Returns the range of the indices of the dynamic rotational bodies of the island, sorted in ascending order.
+	const std::uint32_t* rotationalBegin(std::size_t island) const { return m_rotationalMembers.data() + m_rotationalOffsets[island]; }
+	const std::uint32_t* rotationalEnd(std::size_t island) const { return m_rotationalMembers.data() + m_rotationalOffsets[island + 1]; }
+	//! Returns the range of joint indices of the island, sorted in ascending order.
+	const std::uint32_t* jointsBegin(std::size_t island) const { return m_jointMembers.data() + m_jointOffsets[island]; }
+	const std::uint32_t* jointsEnd(std::size_t island) const { return m_jointMembers.data() + m_jointOffsets[island + 1]; }
+	//! Returns the range of manifold indices of the island, sorted in ascending order.
+	const std::uint32_t* manifoldsBegin(std::size_t island) const { return m_manifoldMembers.data() + m_manifoldOffsets[island]; }
+	const std::uint32_t* manifoldsEnd(std::size_t island) const { return m_manifoldMembers.data() + m_manifoldOffsets[island + 1]; }
+	//! Returns the number of joints and contact manifolds of the island.
+	std::size_t constraintCount(std::size_t island) const;
+
+	//! Returns whether the translational or rotational body connects islands, i.e. whether it has mass or inertia.
+	bool isDynamicTranslational(std::uint32_t translational) const { return m_nodeDynamic[translational] != 0; }
+	bool isDynamicRotational(std::uint32_t rotational) const { return m_nodeDynamic[m_translationalCount + rotational] != 0; }
+
+private:
+	Settings m_settings;
+
+	//! Union find over the bodies, translational bodies first, followed by the rotational bodies
+	std::size_t m_translationalCount = 0;
+	std::vector<std::uint32_t> m_parents;
+	std::vector<std::uint8_t> m_nodeDynamic;
+	//! Node of the translational body of the entity of every rotational body or an invalid index.
+	std::vector<std::uint32_t> m_rotationalPartner;
+
+	std::vector<std::uint32_t> m_nodeIsland;
+	std::vector<std::uint8_t> m_islandAwake;
+	std::size_t m_islandCount = 0;
+
+	//! Bodies and constraints of the islands in compressed row format
+	std::vector<std::uint32_t> m_translationalOffsets;
+	std::vector<std::uint32_t> m_translationalMembers;
+	std::vector<std::uint32_t> m_rotationalOffsets;
+	std::vector<std::uint32_t> m_rotationalMembers;
+	std::vector<std::uint32_t> m_jointIsland;
+	std::vector<std::uint32_t> m_jointOffsets;
+	std::vector<std::uint32_t> m_jointMembers;
+	std::vector<std::uint32_t> m_manifoldIsland;
+	std::vector<std::uint32_t> m_manifoldOffsets;
+	std::vector<std::uint32_t> m_manifoldMembers;
+	std::vector<std::uint32_t> m_fill;
+
+	std::vector<std::uint32_t> m_solverIslands;
+
+	std::uint32_t find(std::uint32_t node);
+	void unite(std::uint32_t a, std::uint32_t b);
+	//! Returns the node of the dynamic body of the entity or an invalid index.
+	std::uint32_t bodyNode(const BodyStateStore::BodyIndex& body) const;
+
+	void buildRows(std::size_t elementCount, const std::uint32_t* elementIsland,
+				   std::vector<std::uint32_t>& offsets, std::vector<std::uint32_t>& members);
+	void updateSolverIslands();
+};
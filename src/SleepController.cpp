@@ -0,0 +1,181 @@
+#include "SleepController.h"
+
+#include <algorithm>
+
+void SleepController::setSettings(const Settings& settings)
+{
+	m_settings = settings;
+}
+
+const SleepController::Settings& SleepController::settings() const
+{
+	return m_settings;
+}
+
+void SleepController::resize(const BodyStateStore& store)
+{
+	m_translationalCount = store.translational.size();
+	m_restingSteps.assign(m_translationalCount + store.rotational.size(), 0);
+	m_islandCount = 0;
+	m_sleepingIslandCount.store(0, std::memory_order_relaxed);
+}
+
+void SleepController::wakeUp(BodyStateStore& store, const SimulationIslands& islands, WorkerPool& pool)
+{
+	pool.parallelFor(0, islands.islandCount(), 0, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t island = begin; island < end; island++) {
+			bool anySleeping = false;
+			bool anyAwake = false;
+			sleepingState(store, islands, island, anySleeping, anyAwake);
+			if (!anySleeping) continue;
+
+			const bool wake = !m_settings.enabled || anyAwake || hasMovingLink(store, islands, island);
+			setSleeping(store, islands, island, !wake);
+		}
+	});
+}
+
+void SleepController::update(BodyStateStore& store, const SimulationIslands& islands, WorkerPool& pool)
+{
+	m_islandCount = islands.islandCount();
+	m_sleepingIslandCount.store(0, std::memory_order_relaxed);
+	if (!m_settings.enabled) return;
+
+	const double linearThreshold = m_settings.linearVelocityThreshold*m_settings.linearVelocityThreshold;
+	const double angularThreshold = m_settings.angularVelocityThreshold*m_settings.angularVelocityThreshold;
+	const auto restingStepCount = static_cast<std::uint32_t>(m_settings.restingStepCount);
+
+	// Counts a resting step of an awake body, returns whether the body rested long enough
+	const auto countResting = [&](std::uint32_t& restingSteps, bool resting) {
+		restingSteps = resting ? std::min(restingSteps + 1, restingStepCount) : 0;
+		return restingSteps >= restingStepCount;
+	};
+
+	pool.parallelFor(0, m_islandCount, 0, [&](std::size_t begin, std::size_t end) {
+		std::size_t sleepingIslands = 0;
+		for (std::size_t island = begin; island < end; island++) {
+			bool sleeping = true;
+			bool rested = true;
+			for (auto t = islands.translationalBegin(island); t != islands.translationalEnd(island); ++t) {
+				if (store.translational.sleeping[*t]) continue;
+				sleeping = false;
+				const bool resting = store.translational.linearVelocity[*t].squaredNorm() <= linearThreshold;
+				rested &= countResting(m_restingSteps[*t], resting);
+			}
+			for (auto r = islands.rotationalBegin(island); r != islands.rotationalEnd(island); ++r) {
+				if (store.rotational.sleeping[*r]) continue;
+				sleeping = false;
+				const bool resting = store.rotational.angularVelocity[*r].squaredNorm() <= angularThreshold;
+				rested &= countResting(m_restingSteps[m_translationalCount + *r], resting);
+			}
+
+			if (!sleeping && rested && !hasMovingLink(store, islands, island)) {
+				setSleeping(store, islands, island, true);
+				sleeping = true;
+			}
+			if (sleeping) sleepingIslands++;
+		}
+		m_sleepingIslandCount.fetch_add(sleepingIslands, std::memory_order_relaxed);
+	});
+}
+
+void SleepController::wakeUpContacts(BodyStateStore& store, const std::vector<ContactManifold>& manifolds) const
+{
+	if (!m_settings.enabled) return;
+
+	const double linearThreshold = m_settings.linearVelocityThreshold*m_settings.linearVelocityThreshold;
+
+	auto& translational = store.translational;
+	auto& rotational = store.rotational;
+	const auto isSleeping = [&](const BodyStateStore::BodyIndex& body) {
+		return translational.sleeping[body.translational] || rotational.sleeping[body.rotational];
+	};
+	const auto pointVelocity = [&](const BodyStateStore::BodyIndex& body, const Eigen::Vector3d& localPosition) {
+		const Eigen::Vector3d offset = rotational.rotationMatrix[body.rotational]*localPosition;
+		return (translational.linearVelocity[body.translational] + rotational.angularVelocity[body.rotational].cross(offset)).eval();
+	};
+
+	for (const auto& manifold : manifolds) {
+		const auto& bodyA = store.colliders.bodies[manifold.colliderA];
+		const auto& bodyB = store.colliders.bodies[manifold.colliderB];
+		const bool sleepingA = isSleeping(bodyA);
+		if (sleepingA == isSleeping(bodyB)) continue;
+
+		bool moving = false;
+		for (std::uint32_t p = 0; p < manifold.pointCount && !moving; p++) {
+			const auto& point = manifold.points[p];
+			const Eigen::Vector3d relativeVelocity = pointVelocity(bodyB, point.localPositionB) - pointVelocity(bodyA, point.localPositionA);
+			moving = relativeVelocity.squaredNorm() > linearThreshold;
+		}
+
+		if (moving) {
+			const auto& sleeping = sleepingA ? bodyA : bodyB;
+			translational.sleeping[sleeping.translational] = 0;
+			rotational.sleeping[sleeping.rotational] = 0;
+		}
+	}
+}
+
+std::size_t SleepController::islandCount() const
+{
+	return m_islandCount;
+}
+
+std::size_t SleepController::sleepingIslandCount() const
+{
+	return m_sleepingIslandCount.load(std::memory_order_relaxed);
+}
+
+void SleepController::sleepingState(const BodyStateStore& store, const SimulationIslands& islands, std::size_t island,
+									bool& anySleeping, bool& anyAwake) const
+{
+	for (auto t = islands.translationalBegin(island); t != islands.translationalEnd(island); ++t) {
+		(store.translational.sleeping[*t] ? anySleeping : anyAwake) = true;
+	}
+	for (auto r = islands.rotationalBegin(island); r != islands.rotationalEnd(island); ++r) {
+		(store.rotational.sleeping[*r] ? anySleeping : anyAwake) = true;
+	}
+}
+
+bool SleepController::hasMovingLink(const BodyStateStore& store, const SimulationIslands& islands, std::size_t island) const
+{
+	const double linearThreshold = m_settings.linearVelocityThreshold*m_settings.linearVelocityThreshold;
+
+	// Joints link the island to bodies without mass, contacts with moving kinematic bodies are handled by wakeUpContacts
+	const auto isMovingKinematic = [&](const BodyStateStore::BodyIndex& body) {
+		return body.translational != BodyStateStore::invalidIndex && !islands.isDynamicTranslational(body.translational)
+			   && store.translational.linearVelocity[body.translational].squaredNorm() > linearThreshold;
+	};
+
+	for (auto j = islands.jointsBegin(island); j != islands.jointsEnd(island); ++j) {
+		const auto& parents = store.joints.parents[*j];
+		if (isMovingKinematic(parents.first) || isMovingKinematic(parents.second)) return true;
+	}
+	return false;
+}
+
+void SleepController::setSleeping(BodyStateStore& store, const SimulationIslands& islands, std::size_t island, bool sleeping)
+{
+	const std::uint8_t flag = sleeping ? 1 : 0;
+
+	// Remaining velocities of sleeping bodies would drag the awake bodies at their contacts
+	for (auto t = islands.translationalBegin(island); t != islands.translationalEnd(island); ++t) {
+		store.translational.sleeping[*t] = flag;
+		m_restingSteps[*t] = 0;
+		if (sleeping) {
+			store.translational.linearVelocity[*t].setZero();
+			store.translational.externalForce[*t].setZero();
+		}
+	}
+	for (auto r = islands.rotationalBegin(island); r != islands.rotationalEnd(island); ++r) {
+		store.rotational.sleeping[*r] = flag;
+		m_restingSteps[m_translationalCount + *r] = 0;
+		if (sleeping) {
+			store.rotational.angularVelocity[*r].setZero();
+			store.rotational.externalTorque[*r].setZero();
+		}
+	}
+	for (auto j = islands.jointsBegin(island); j != islands.jointsEnd(island); ++j) {
+		store.joints.sleeping[*j] = flag;
+	}
+}
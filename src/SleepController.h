@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BodyStateStore.h"
+#include "NarrowPhase.h"
+#include "SimulationIslands.h"
+#include "WorkerPool.h"
+
+//! Deactivates islands of bodies that came to rest and wakes them up again.
+/*
+ * The islands are those of SimulationIslands, i.e. the connected components of the dynamic bodies (positive
+ * mass or inertia) linked by joints and contacts, so bodies resting on each other sleep and wake up together.
+ * Bodies without mass are static or kinematic, they never sleep and do not connect islands. Every dynamic
+ * body counts the consecutive timesteps its velocity stayed below the thresholds, an island falls asleep
+ * when all of its bodies rested for the required number of steps. The velocities, forces and torques of
+ * its bodies are set to zero when it falls asleep, as the contact solver treats sleeping bodies as static.
+ * It wakes up as a whole when any of its bodies is woken up (e.g. by clearing its sleeping flag) or when
+ * a kinematic body attached to it by a joint moves. Sleeping bodies keep their contacts, so a sleeping
+ * stack stays in one island. If the splitting of the islands is disabled, all bodies form a single island
+ * and only sleep when the whole scene rests.
+ */
+class SleepController
+{
+public:
+	struct Settings
+	{
+		bool enabled = true;
+		//! Maximum linear velocity of resting bodies.
+		double linearVelocityThreshold = 0.01;
+		//! Maximum angular velocity of resting bodies.
+		double angularVelocityThreshold = 0.02;
+		//! Number of consecutive resting timesteps until an island falls asleep.
+		std::size_t restingStepCount = 60;
+	};
+
+	void setSettings(const Settings& settings);
+	const Settings& settings() const;
+
+	//! Allocates the resting counters for the bodies of the store and resets them.
+	void resize(const BodyStateStore& store);
+
+	//! Wakes up all sleeping islands with an awake body or a moving kinematic neighbor, called before a timestep.
+	/*
+	 * Islands whose bodies are all sleeping put their joints to sleep as well, e.g. after a rebuild of the
+	 * store with bodies that were already sleeping.
+	 */
+	void wakeUp(BodyStateStore& store, const SimulationIslands& islands, WorkerPool& pool);
+	//! Updates the resting time of all awake bodies and deactivates resting islands, called after a timestep.
+	void update(BodyStateStore& store, const SimulationIslands& islands, WorkerPool& pool);
+	//! Clears the sleeping flags of sleeping bodies whose contacts still move after the contact solver, their islands wake up before the next timestep.
+	/*
+	 * Must be called after the contact solver: it treats sleeping bodies as static, so an awake body resting
+	 * on a sleeping body has no relative velocity at their contact anymore, while it still carries the
+	 * velocity gained from gravity before the solve. Contacts with moving bodies without mass are not
+	 * solved and contacts that slide keep their relative velocity, both wake up the sleeping body.
+	 */
+	void wakeUpContacts(BodyStateStore& store, const std::vector<ContactManifold>& manifolds) const;
+
+	//! Returns the number of islands and sleeping islands after the last update.
+	std::size_t islandCount() const;
+	std::size_t sleepingIslandCount() const;
+
+private:
+	Settings m_settings;
+
+	//! Consecutive resting timesteps of the bodies, translational bodies first, followed by the rotational bodies
+	std::vector<std::uint32_t> m_restingSteps;
+	std::size_t m_translationalCount = 0;
+
+	std::size_t m_islandCount = 0;
+	std::atomic<std::size_t> m_sleepingIslandCount{0};
+
+	//! Returns whether the bodies of the island are sleeping, awake or both.
+	void sleepingState(const BodyStateStore& store, const SimulationIslands& islands, std::size_t island,
+					   bool& anySleeping, bool& anyAwake) const;
+	bool hasMovingLink(const BodyStateStore& store, const SimulationIslands& islands, std::size_t island) const;
+	void setSleeping(BodyStateStore& store, const SimulationIslands& islands, std::size_t island, bool sleeping);
+};
@@ -0,0 +1,373 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+
+namespace
+{
+	const char snapshotMagic[4] = { 'P', 'H', 'Y', 'S' };
+
+	// The Eigen types and variants of the components are not trivially copyable, so every component is converted
+	// to a plain record that is copied in bulk. The members are ordered such that the records contain no padding.
+
+	struct TranslationalRecord
+	{
+		std::uint64_t sleeping;
+		double mass;
+		double externalForce[3];
+		double position[3];
+		double linearVelocity[3];
+	};
+
+	struct RotationalRecord
+	{
+		std::uint64_t sleeping;
+		double prinicipalInertia[3];
+		double globalInertiaMatrix[9];
+		double globalInverseInertiaMatrix[9];
+		double externalTorque[3];
+		//! Coefficients in the order w, x, y, z.
+		double rotation[4];
+		double angularVelocity[3];
+		double rotationMatrix[9];
+	};
+
+	struct JointRecord
+	{
+		EntityType parentEntities[2];
+		double localPositions[2][3];
+		double globalPositions[2][3];
+		double globalVelocities[2][3];
+		//! Index of the alternative of the joint properties, the damped spring is the only one.
+		std::uint64_t propertiesIndex;
+		double restLength;
+		double elasticity;
+		double damping;
+	};
+
+	struct RenderRecord
+	{
+		float color[4];
+		std::uint32_t sleeping;
+		//! Index of the alternative of the properties.
+		std::uint32_t propertiesIndex;
+		//! Cuboid: position, rotation (w, x, y, z) and edges. Joint: connector positions, connector size and line width.
+		float properties[10];
+	};
+
+	static_assert(std::is_trivially_copyable<TranslationalRecord>::value && std::is_trivially_copyable<RotationalRecord>::value
+				  && std::is_trivially_copyable<JointRecord>::value && std::is_trivially_copyable<RenderRecord>::value,
+				  "Snapshot records are copied with memcpy");
+	static_assert(sizeof(TranslationalRecord) == 11*sizeof(double) && sizeof(RotationalRecord) == 41*sizeof(double)
+				  && sizeof(JointRecord) == 2*sizeof(EntityType) + 22*sizeof(double) && sizeof(RenderRecord) == 16*sizeof(float),
+				  "Snapshot records must not contain padding");
+
+	template <typename ComponentT> struct RecordOf;
+	template <> struct RecordOf<TranslationalAnimatedBody> { using type = TranslationalRecord; };
+	template <> struct RecordOf<RotationalAnimatedBody> { using type = RotationalRecord; };
+	template <> struct RecordOf<Joint> { using type = JointRecord; };
+	template <> struct RecordOf<RenderData> { using type = RenderRecord; };
+
+	template <typename DerivedT>
+	void copyTo(const Eigen::MatrixBase<DerivedT>& value, typename DerivedT::Scalar* target)
+	{
+		Eigen::Map<typename DerivedT::PlainObject>(target, value.rows(), value.cols()) = value;
+	}
+
+	template <typename ScalarT>
+	void copyTo(const Eigen::Quaternion<ScalarT>& value, ScalarT* target)
+	{
+		target[0] = value.w();
+		target[1] = value.x();
+		target[2] = value.y();
+		target[3] = value.z();
+	}
+
+	template <typename MatrixT>
+	MatrixT matrixFrom(const typename MatrixT::Scalar* source)
+	{
+		return Eigen::Map<const MatrixT>(source);
+	}
+
+	template <typename ScalarT>
+	Eigen::Quaternion<ScalarT> quaternionFrom(const ScalarT* source)
+	{
+		return Eigen::Quaternion<ScalarT>(source[0], source[1], source[2], source[3]);
+	}
+
+	void toRecord(const TranslationalAnimatedBody& body, TranslationalRecord& record)
+	{
+		record.sleeping = body.sleeping ? 1 : 0;
+		record.mass = body.mass;
+		copyTo(body.externalForce, record.externalForce);
+		copyTo(body.state.position, record.position);
+		copyTo(body.state.linearVelocity, record.linearVelocity);
+	}
+
+	void fromRecord(const TranslationalRecord& record, TranslationalAnimatedBody& body)
+	{
+		body.sleeping = record.sleeping != 0;
+		body.mass = record.mass;
+		body.externalForce = matrixFrom<Eigen::Vector3d>(record.externalForce);
+		body.state.position = matrixFrom<Eigen::Vector3d>(record.position);
+		body.state.linearVelocity = matrixFrom<Eigen::Vector3d>(record.linearVelocity);
+	}
+
+	void toRecord(const RotationalAnimatedBody& body, RotationalRecord& record)
+	{
+		record.sleeping = body.sleeping ? 1 : 0;
+		copyTo(body.prinicipalInertia, record.prinicipalInertia);
+		copyTo(body.globalInertiaMatrix, record.globalInertiaMatrix);
+		copyTo(body.globalInverseInertiaMatrix, record.globalInverseInertiaMatrix);
+		copyTo(body.externalTorque, record.externalTorque);
+		copyTo(body.state.rotation, record.rotation);
+		copyTo(body.state.angularVelocity, record.angularVelocity);
+		copyTo(body.rotationMatrix, record.rotationMatrix);
+	}
+
+	void fromRecord(const RotationalRecord& record, RotationalAnimatedBody& body)
+	{
+		body.sleeping = record.sleeping != 0;
+		body.prinicipalInertia = matrixFrom<Eigen::Vector3d>(record.prinicipalInertia);
+		body.globalInertiaMatrix = matrixFrom<Eigen::Matrix3d>(record.globalInertiaMatrix);
+		body.globalInverseInertiaMatrix = matrixFrom<Eigen::Matrix3d>(record.globalInverseInertiaMatrix);
+		body.externalTorque = matrixFrom<Eigen::Vector3d>(record.externalTorque);
+		body.state.rotation = quaternionFrom(record.rotation);
+		body.state.angularVelocity = matrixFrom<Eigen::Vector3d>(record.angularVelocity);
+		body.rotationMatrix = matrixFrom<Eigen::Matrix3d>(record.rotationMatrix);
+	}
+
+	void toRecord(const Joint& joint, JointRecord& record)
+	{
+		const Connector* connectors[2] = { &joint.connectors.first, &joint.connectors.second };
+		for (std::size_t c = 0; c < 2; c++) {
+			record.parentEntities[c] = connectors[c]->parentEntity;
+			copyTo(connectors[c]->localPosition, record.localPositions[c]);
+			copyTo(connectors[c]->globalPosition, record.globalPositions[c]);
+			copyTo(connectors[c]->globalVelocity, record.globalVelocities[c]);
+		}
+
+		const auto& spring = common::variant::get<Joint::DampedSpring>(joint.jointProperties);
+		record.propertiesIndex = joint.jointProperties.index();
+		record.restLength = spring.restLength;
+		record.elasticity = spring.elasticity;
+		record.damping = spring.damping;
+	}
+
+	void fromRecord(const JointRecord& record, Joint& joint)
+	{
+		Connector* connectors[2] = { &joint.connectors.first, &joint.connectors.second };
+		for (std::size_t c = 0; c < 2; c++) {
+			connectors[c]->parentEntity = record.parentEntities[c];
+			connectors[c]->localPosition = matrixFrom<Eigen::Vector3d>(record.localPositions[c]);
+			connectors[c]->globalPosition = matrixFrom<Eigen::Vector3d>(record.globalPositions[c]);
+			connectors[c]->globalVelocity = matrixFrom<Eigen::Vector3d>(record.globalVelocities[c]);
+		}
+
+		joint.jointProperties = Joint::DampedSpring{ record.restLength, record.elasticity, record.damping };
+	}
+
+	void toRecord(const RenderData& renderData, RenderRecord& record)
+	{
+		copyTo(renderData.color, record.color);
+		record.sleeping = renderData.sleeping ? 1 : 0;
+		record.propertiesIndex = static_cast<std::uint32_t>(renderData.properties.index());
+		std::fill(std::begin(record.properties), std::end(record.properties), 0.0f);
+
+		if (const auto cuboid = common::variant::get_if<RenderData::Cuboid>(&renderData.properties)) {
+			copyTo(cuboid->position, record.properties);
+			copyTo(cuboid->rotation, record.properties + 3);
+			copyTo(cuboid->edges, record.properties + 7);
+		} else if (const auto joint = common::variant::get_if<RenderData::Joint>(&renderData.properties)) {
+			copyTo(joint->connectorPositions.first, record.properties);
+			copyTo(joint->connectorPositions.second, record.properties + 3);
+			record.properties[6] = joint->connectorSize;
+			record.properties[7] = joint->lineWidth;
+		}
+	}
+
+	void fromRecord(const RenderRecord& record, RenderData& renderData)
+	{
+		renderData.color = matrixFrom<Eigen::Vector4f>(record.color);
+		renderData.sleeping = record.sleeping != 0;
+
+		if (record.propertiesIndex == 0) {
+			renderData.properties = RenderData::Cuboid{ matrixFrom<Eigen::Vector3f>(record.properties), quaternionFrom(record.properties + 3),
+														matrixFrom<Eigen::Vector3f>(record.properties + 7) };
+		} else {
+			RenderData::Joint joint;
+			joint.connectorPositions = { matrixFrom<Eigen::Vector3f>(record.properties), matrixFrom<Eigen::Vector3f>(record.properties + 3) };
+			joint.connectorSize = record.properties[6];
+			joint.lineWidth = record.properties[7];
+			renderData.properties = joint;
+		}
+	}
+
+	//! Returns whether the variant indices of the record are valid, the other records are always valid.
+	bool isValid(const TranslationalRecord&) { return true; }
+	bool isValid(const RotationalRecord&) { return true; }
+	bool isValid(const JointRecord& record) { return record.propertiesIndex == 0; }
+	bool isValid(const RenderRecord& record) { return record.propertiesIndex < 2; }
+
+	//! Entities and component records of a single pool.
+	template <typename ComponentT>
+	struct Pool
+	{
+		using Component = ComponentT;
+		using Record = typename RecordOf<ComponentT>::type;
+
+		std::vector<EntityType> entities;
+		std::vector<Record> records;
+
+		std::size_t byteSize() const { return entities.size()*(sizeof(EntityType) + sizeof(Record)); }
+	};
+
+	using Pools = std::tuple<Pool<TranslationalAnimatedBody>, Pool<RotationalAnimatedBody>, Pool<Joint>, Pool<RenderData>>;
+
+	template <typename FunctionT, std::size_t... Is>
+	void forEachPool(Pools& pools, FunctionT&& fn, std::index_sequence<Is...>)
+	{
+		(fn(std::integral_constant<std::size_t, Is>(), std::get<Is>(pools)), ...);
+	}
+
+	//! Calls 'fn(index, pool)' for every pool in the order of the snapshot.
+	template <typename FunctionT>
+	void forEachPool(Pools& pools, FunctionT&& fn)
+	{
+		forEachPool(pools, fn, std::make_index_sequence<std::tuple_size<Pools>::value>());
+	}
+
+	template <typename ComponentT>
+	void gather(const EntityComponentSystem& ecs, Pool<ComponentT>& pool)
+	{
+		const auto view = ecs.view<ComponentT>();
+		pool.entities.reserve(view.size());
+		pool.records.resize(view.size());
+		for (auto entity : view) {
+			toRecord(ecs.get<ComponentT>(entity), pool.records[pool.entities.size()]);
+			pool.entities.push_back(entity);
+		}
+	}
+
+	//! Returns whether the registry contains exactly the entities of the pool with the component.
+	template <typename ComponentT>
+	bool matches(const EntityComponentSystem& ecs, const Pool<ComponentT>& pool)
+	{
+		if (ecs.view<ComponentT>().size() != pool.entities.size()) return false;
+		for (const auto entity : pool.entities) {
+			if (!ecs.valid(entity) || !ecs.has<ComponentT>(entity)) return false;
+		}
+		return true;
+	}
+}
+
+void Snapshot::write(const EntityComponentSystem& ecs, double time, std::vector<char>& blob)
+{
+	Pools pools;
+	Header header;
+	std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+	header.version = version;
+	header.time = time;
+
+	std::size_t byteSize = sizeof(Header);
+	forEachPool(pools, [&](auto index, auto& pool) {
+		using RecordT = typename std::decay_t<decltype(pool)>::Record;
+		gather(ecs, pool);
+		header.componentSizes[index] = static_cast<std::uint32_t>(sizeof(RecordT));
+		header.counts[index] = pool.entities.size();
+		byteSize += pool.byteSize();
+	});
+
+	// Every array is copied in one piece
+	blob.resize(byteSize);
+	char* cursor = blob.data();
+	std::memcpy(cursor, &header, sizeof(Header));
+	cursor += sizeof(Header);
+	forEachPool(pools, [&](auto, auto& pool) {
+		using RecordT = typename std::decay_t<decltype(pool)>::Record;
+		std::memcpy(cursor, pool.entities.data(), pool.entities.size()*sizeof(EntityType));
+		cursor += pool.entities.size()*sizeof(EntityType);
+		std::memcpy(cursor, pool.records.data(), pool.records.size()*sizeof(RecordT));
+		cursor += pool.records.size()*sizeof(RecordT);
+	});
+}
+
+bool Snapshot::read(EntityComponentSystem& ecs, const std::vector<char>& blob, double& time)
+{
+	if (blob.size() < sizeof(Header)) return false;
+
+	Header header;
+	std::memcpy(&header, blob.data(), sizeof(Header));
+	if (std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 || header.version != version) return false;
+
+	// Validate the layout before touching the registry
+	Pools pools;
+	bool compatible = true;
+	std::size_t byteSize = sizeof(Header);
+	forEachPool(pools, [&](auto index, auto& pool) {
+		using RecordT = typename std::decay_t<decltype(pool)>::Record;
+		compatible &= header.componentSizes[index] == sizeof(RecordT);
+		byteSize += header.counts[index]*(sizeof(EntityType) + sizeof(RecordT));
+	});
+	if (!compatible || byteSize != blob.size()) return false;
+
+	const char* cursor = blob.data() + sizeof(Header);
+	forEachPool(pools, [&](auto index, auto& pool) {
+		using RecordT = typename std::decay_t<decltype(pool)>::Record;
+		const auto count = static_cast<std::size_t>(header.counts[index]);
+		pool.entities.resize(count);
+		pool.records.resize(count);
+		std::memcpy(pool.entities.data(), cursor, count*sizeof(EntityType));
+		cursor += count*sizeof(EntityType);
+		std::memcpy(pool.records.data(), cursor, count*sizeof(RecordT));
+		cursor += count*sizeof(RecordT);
+
+		for (const auto& record : pool.records) compatible &= isValid(record);
+	});
+	if (!compatible) return false;
+
+	bool inPlace = true;
+	forEachPool(pools, [&](auto, auto& pool) { inPlace = inPlace && matches(ecs, pool); });
+
+	if (inPlace) {
+		forEachPool(pools, [&](auto, auto& pool) {
+			using ComponentT = typename std::decay_t<decltype(pool)>::Component;
+			for (std::size_t i = 0; i < pool.entities.size(); i++) fromRecord(pool.records[i], ecs.get<ComponentT>(pool.entities[i]));
+		});
+	} else {
+		// Recreate the entities in the order of their ids in the snapshot
+		std::vector<EntityType> entities;
+		forEachPool(pools, [&](auto, auto& pool) { entities.insert(entities.end(), pool.entities.begin(), pool.entities.end()); });
+		std::sort(entities.begin(), entities.end());
+		entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+
+		ecs.reset();
+		std::unordered_map<EntityType, EntityType> entityMap;
+		entityMap.reserve(entities.size());
+		for (const auto entity : entities) entityMap.emplace(entity, ecs.create());
+
+		auto& joints = std::get<Pool<Joint>>(pools).records;
+		for (auto& joint : joints) {
+			for (auto& parentEntity : joint.parentEntities) {
+				const auto parent = entityMap.find(parentEntity);
+				if (parent != entityMap.end()) parentEntity = parent->second;
+			}
+		}
+
+		forEachPool(pools, [&](auto, auto& pool) {
+			using ComponentT = typename std::decay_t<decltype(pool)>::Component;
+			for (std::size_t i = 0; i < pool.entities.size(); i++) {
+				ComponentT component;
+				fromRecord(pool.records[i], component);
+				ecs.assign<ComponentT>(entityMap[pool.entities[i]], component);
+			}
+		});
+	}
+
+	time = header.time;
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "EntityComponentSystem.h"
+
+//! Versioned binary snapshots of all animated bodies, joints and render data of an EntityComponentSystem.
+/*
+ * A snapshot consists of a header with the version, the simulation time, the component sizes and the
+ * number of records per pool, followed by the entity ids and the records of every pool. The Eigen types
+ * and variants of the components are not trivially copyable, so every component is converted element by
+ * element to a trivially copyable record without padding, and the records of a pool are copied with a
+ * single bulk copy. Snapshots are only compatible with builds using the same record layouts, which is
+ * checked by the version and the record sizes in the header.
+ */
+class Snapshot
+{
+public:
+	//! Version of the format, has to be incremented whenever the layout of a record changes.
+	static constexpr std::uint32_t version = 2;
+
+	//! Writes the components of the registry and the simulation time to the blob, replacing its content.
+	static void write(const EntityComponentSystem& ecs, double time, std::vector<char>& blob);
+	//! Restores the components and the simulation time from the blob, returns false if the blob is not a compatible snapshot.
+	/*
+	 * If the registry contains exactly the entities of the snapshot, the components are overwritten in
+	 * place and the entity ids are kept. Otherwise the registry is cleared and the entities are recreated,
+	 * the parents of the joint connectors are mapped to the new entity ids.
+	 */
+	static bool read(EntityComponentSystem& ecs, const std::vector<char>& blob, double& time);
+
+private:
+	struct Header
+	{
+		char magic[4];
+		std::uint32_t version;
+		double time;
+		std::uint32_t componentSizes[4];
+		std::uint64_t counts[4];
+	};
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//! Bounded lock-free queue for exactly one producer and one consumer thread.
+/*
+ * The capacity is rounded up to a power of two and allocated by reset(), push() and pop() never allocate
+ * and never block. The head and tail counters live on separate cache lines to avoid false sharing between
+ * the producer and the consumer.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(std::size_t capacity = 0) { reset(capacity); }
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	//! Clears the queue and allocates space for at least the specified number of elements. Not thread safe.
+	void reset(std::size_t capacity)
+	{
+		std::size_t size = 1;
+		while (size < capacity) size *= 2;
+		m_buffer.assign(size, T());
+		m_mask = size - 1;
+		m_head.store(0, std::memory_order_relaxed);
+		m_tail.store(0, std::memory_order_relaxed);
+	}
+
+	//! Appends an element, returns false if the queue is full. Must only be called by the producer.
+	bool push(const T& value)
+	{
+		const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == m_buffer.size()) return false;
+
+		m_buffer[tail & m_mask] = value;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	//! Removes the oldest element, returns false if the queue is empty. Must only be called by the consumer.
+	bool pop(T& value)
+	{
+		const std::size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+		value = m_buffer[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+private:
+	std::vector<T> m_buffer;
+	std::size_t m_mask = 0;
+
+	alignas(64) std::atomic<std::size_t> m_head{0};
+	alignas(64) std::atomic<std::size_t> m_tail{0};
+};
@@ -0,0 +1,115 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "Trace.h"
+
+TaskGraph::TaskId TaskGraph::addTask(const char* name, Access reads, Access writes, std::function<void()> task)
+{
+	return add(name, reads, writes, []() { return std::size_t(1); },
+			   [task = std::move(task)](std::size_t, std::size_t) { task(); }, 1, &WorkerPool::cacheAlignedGrainSize<>);
+}
+
+TaskGraph::TaskId TaskGraph::add(const char* name, Access reads, Access writes, std::function<std::size_t()> elementCount,
+								 std::function<void(std::size_t, std::size_t)> body, std::size_t grainSize, AlignGrainSize alignGrainSize)
+{
+	const TaskId id = m_tasks.size();
+	auto task = std::make_unique<Task>();
+	task->name = name;
+	task->reads = reads;
+	task->writes = writes;
+	task->elementCount = std::move(elementCount);
+	task->body = std::move(body);
+	task->grainSize = grainSize;
+	task->alignGrainSize = alignGrainSize;
+
+	// Read after write, write after write and write after read conflicts keep the order in which the tasks were added
+	for (TaskId previous = 0; previous < id; previous++) {
+		auto& other = *m_tasks[previous];
+		if ((other.writes & (reads | writes)) != 0 || (other.reads & writes) != 0) {
+			task->dependencies.push_back(previous);
+			other.successors.push_back(id);
+		}
+	}
+
+	m_tasks.push_back(std::move(task));
+	return id;
+}
+
+void TaskGraph::run(WorkerPool& pool)
+{
+	if (m_tasks.empty()) return;
+
+	for (auto& task : m_tasks) {
+		task->runElementCount = task->elementCount();
+		const std::size_t grainSize = (task->grainSize != 0) ? task->grainSize : pool.defaultGrainSize(task->runElementCount);
+		task->runGrainSize = task->alignGrainSize(grainSize);
+		// Empty tasks still complete with a single chunk to release their successors
+		task->chunkCount = std::max<std::size_t>((task->runElementCount + task->runGrainSize - 1) / task->runGrainSize, 1);
+
+		task->pendingDependencies.store(task->dependencies.size(), std::memory_order_relaxed);
+		task->nextChunk.store(0, std::memory_order_relaxed);
+		task->finishedChunks.store(0, std::memory_order_relaxed);
+	}
+	m_remainingTasks.store(m_tasks.size(), std::memory_order_relaxed);
+
+	// Every thread of the pool executes chunks until the graph is done, the pool publishes the state above to its workers
+	pool.run(pool.threadCount(), [this](std::size_t) { executeTasks(); });
+}
+
+std::size_t TaskGraph::taskCount() const
+{
+	return m_tasks.size();
+}
+
+const char* TaskGraph::taskName(TaskId task) const
+{
+	return m_tasks[task]->name;
+}
+
+const std::vector<TaskGraph::TaskId>& TaskGraph::dependencies(TaskId task) const
+{
+	return m_tasks[task]->dependencies;
+}
+
+void TaskGraph::executeTasks()
+{
+	while (m_remainingTasks.load(std::memory_order_acquire) != 0) {
+		// Nothing is ready while the last chunks of the dependencies of all remaining tasks are being executed
+		if (!executeChunk()) std::this_thread::yield();
+	}
+}
+
+bool TaskGraph::executeChunk()
+{
+	// Earlier tasks are preferred, they tend to be on the critical path of the graph
+	for (auto& pointer : m_tasks) {
+		Task& task = *pointer;
+		if (task.pendingDependencies.load(std::memory_order_acquire) != 0) continue;
+		if (task.nextChunk.load(std::memory_order_relaxed) >= task.chunkCount) continue;
+
+		const std::size_t chunk = task.nextChunk.fetch_add(1, std::memory_order_relaxed);
+		if (chunk >= task.chunkCount) continue;
+
+		const std::size_t begin = chunk*task.runGrainSize;
+		const std::size_t end = std::min(begin + task.runGrainSize, task.runElementCount);
+		if (begin < end) {
+#ifdef PHYANI_TRACING
+			const std::uint64_t traceStart = Trace::isEnabled() ? Trace::now() : 0;
+			task.body(begin, end);
+			if (traceStart != 0) Trace::record(task.name, traceStart, Trace::now());
+#else
+			task.body(begin, end);
+#endif
+		}
+
+		// The thread finishing the last chunk releases the successors, the acquire-release chain publishes the writes of all chunks
+		if (task.finishedChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == task.chunkCount) {
+			for (const TaskId successor : task.successors) m_tasks[successor]->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel);
+			m_remainingTasks.fetch_sub(1, std::memory_order_acq_rel);
+		}
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "WorkerPool.h"
+
+//! Set of tasks that declare the data they read and write and are executed concurrently where they do not conflict.
+/*
+ * The data is described by bit masks that are defined by the user of the graph, e.g. one bit per array
+ * or component type. A task depends on every previously added task that writes data it reads or writes,
+ * or that reads data it writes, so executing the graph has the same result as executing the tasks in the
+ * order they were added, for any number of threads.
+ *
+ * Parallel tasks are split into chunks of a range of elements. All threads of the worker pool take the
+ * chunks of the earliest ready tasks from shared counters, so independent tasks overlap and the threads
+ * that finished their part of a task continue with the next ready task instead of waiting at a barrier.
+ * The graph is built once, running it does not allocate.
+ */
+class TaskGraph
+{
+public:
+	using Access = std::uint32_t;
+	using TaskId = std::size_t;
+
+	TaskGraph() = default;
+
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	//! Adds a task that is executed as a whole by a single thread.
+	TaskId addTask(const char* name, Access reads, Access writes, std::function<void()> task);
+
+	//! Adds a task that calls 'body(begin, end)' for chunks of [0, elementCount()) in parallel.
+	/*
+	 * The element count is queried at the start of every run. The chunks are sized like the chunks of
+	 * WorkerPool::parallelFor, a grain size of zero selects the default grain size.
+	 */
+	template <typename... ElementTs>
+	TaskId addParallelTask(const char* name, Access reads, Access writes, std::function<std::size_t()> elementCount,
+						   std::function<void(std::size_t, std::size_t)> body, std::size_t grainSize = 0)
+	{
+		return add(name, reads, writes, std::move(elementCount), std::move(body), grainSize,
+				   &WorkerPool::cacheAlignedGrainSize<ElementTs...>);
+	}
+
+	//! Executes all tasks and blocks until they are done. Must not be called concurrently.
+	void run(WorkerPool& pool);
+
+	std::size_t taskCount() const;
+	const char* taskName(TaskId task) const;
+	//! Returns the tasks the specified task directly depends on.
+	const std::vector<TaskId>& dependencies(TaskId task) const;
+
+private:
+	using AlignGrainSize = std::size_t(*)(std::size_t);
+
+	struct Task
+	{
+		const char* name;
+		Access reads;
+		Access writes;
+		std::function<std::size_t()> elementCount;
+		std::function<void(std::size_t, std::size_t)> body;
+		std::size_t grainSize;
+		AlignGrainSize alignGrainSize;
+
+		std::vector<TaskId> dependencies;
+		std::vector<TaskId> successors;
+
+		// State of the current run
+		std::size_t runElementCount = 0;
+		std::size_t runGrainSize = 1;
+		std::size_t chunkCount = 1;
+		std::atomic<std::size_t> pendingDependencies{0};
+		std::atomic<std::size_t> nextChunk{0};
+		std::atomic<std::size_t> finishedChunks{0};
+	};
+
+	//! Tasks in the order they were added, which is also the order of their priority.
+	std::vector<std::unique_ptr<Task>> m_tasks;
+	std::atomic<std::size_t> m_remainingTasks{0};
+
+	TaskId add(const char* name, Access reads, Access writes, std::function<std::size_t()> elementCount,
+			   std::function<void(std::size_t, std::size_t)> body, std::size_t grainSize, AlignGrainSize alignGrainSize);
+
+	//! Executes chunks of ready tasks until all tasks are done, called by every thread of the pool.
+	void executeTasks();
+	//! Claims and executes a chunk of the earliest ready task, returns false if no chunk is available.
+	bool executeChunk();
+};
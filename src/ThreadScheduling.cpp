@@ -0,0 +1,165 @@
+#include "ThreadScheduling.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <sys/mman.h>
+	#include <sys/resource.h>
+	#include <unistd.h>
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+namespace
+{
+	void appendError(std::string& error, const std::string& part, const std::string& reason)
+	{
+		if (!error.empty()) error += "; ";
+		error += part + ": " + reason;
+	}
+
+	//! Whether applyToCurrentThread locked the memory of the process, other code may have locked it as well.
+	std::atomic<bool> memoryLocked(false);
+}
+
+const char* ThreadScheduling::policyName(Policy policy)
+{
+	switch (policy) {
+		case Policy::Default: return "Default";
+		case Policy::RaisedPriority: return "Raised priority";
+		case Policy::Fifo: return "FIFO";
+		default: return "Unknown";
+	}
+}
+
+#ifdef _WIN32
+
+bool ThreadScheduling::applyToCurrentThread(const Settings& settings, std::string& error)
+{
+	error.clear();
+	const HANDLE thread = GetCurrentThread();
+
+	// Windows has no FIFO policy, the time critical priority comes closest. The priority of the thread before it was
+	// raised the first time is restored by the default policy.
+	thread_local bool raised = false;
+	thread_local int originalPriority = THREAD_PRIORITY_NORMAL;
+	if (settings.policy != Policy::Default) {
+		const int priority = (settings.policy == Policy::RaisedPriority) ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_TIME_CRITICAL;
+		const int previousPriority = raised ? originalPriority : GetThreadPriority(thread);
+		if (!SetThreadPriority(thread, priority)) {
+			appendError(error, "priority", "SetThreadPriority failed");
+		} else if (!raised) {
+			originalPriority = previousPriority;
+			raised = true;
+		}
+	} else if (raised) {
+		if (!SetThreadPriority(thread, originalPriority)) appendError(error, "priority", "cannot restore the original priority");
+		else raised = false;
+	}
+
+	// The affinity of the thread before it was pinned the first time is restored if no core is selected
+	thread_local DWORD_PTR originalMask = 0;
+	if (settings.core >= 0) {
+		const DWORD_PTR previousMask = (settings.core < static_cast<int>(8*sizeof(DWORD_PTR))) ? SetThreadAffinityMask(thread, DWORD_PTR(1) << settings.core) : 0;
+		if (previousMask == 0) appendError(error, "affinity", "cannot pin the thread to core " + std::to_string(settings.core));
+		else if (originalMask == 0) originalMask = previousMask;
+	} else if (originalMask != 0) {
+		if (!SetThreadAffinityMask(thread, originalMask)) appendError(error, "affinity", "cannot restore the original affinity");
+		else originalMask = 0;
+	}
+
+	if (settings.lockMemory) appendError(error, "memory locking", "not supported on Windows");
+
+	return error.empty();
+}
+
+#else
+
+bool ThreadScheduling::applyToCurrentThread(const Settings& settings, std::string& error)
+{
+	error.clear();
+
+	// Policy and priority
+	sched_param parameters = {};
+	int policy = SCHED_OTHER;
+	if (settings.policy == Policy::Fifo) {
+		policy = SCHED_FIFO;
+		parameters.sched_priority = std::clamp(settings.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+	}
+	if (const int result = pthread_setschedparam(pthread_self(), policy, &parameters)) {
+		appendError(error, "policy", std::strerror(result));
+	}
+
+	// The nice value of time-sharing threads, it is a per thread attribute on Linux only. The nice value of the thread
+	// before it was raised the first time is restored by the default policy, FIFO scheduling ignores it.
+#ifdef __linux__
+	const id_t thread = static_cast<id_t>(syscall(SYS_gettid));
+#else
+	const id_t thread = 0;
+#endif
+	thread_local bool niceRaised = false;
+	thread_local int originalNice = 0;
+	if (settings.policy == Policy::RaisedPriority) {
+		// -1 is a valid nice value, errors are only reported through errno
+		errno = 0;
+		const int previousNice = niceRaised ? originalNice : getpriority(PRIO_PROCESS, thread);
+		if (errno != 0) {
+			appendError(error, "priority", std::strerror(errno));
+		} else if (setpriority(PRIO_PROCESS, thread, -std::clamp(settings.priority, 1, 20)) != 0) {
+			appendError(error, "priority", std::strerror(errno));
+		} else if (!niceRaised) {
+			originalNice = previousNice;
+			niceRaised = true;
+		}
+	} else if (settings.policy == Policy::Default && niceRaised) {
+		if (setpriority(PRIO_PROCESS, thread, originalNice) != 0) appendError(error, "priority", std::string(std::strerror(errno)) + " (original nice value)");
+		else niceRaised = false;
+	}
+
+	// Core affinity, the affinity of the thread before it was pinned the first time is restored if no core is selected
+#ifdef __linux__
+	thread_local bool pinned = false;
+	thread_local cpu_set_t originalCores;
+	if (settings.core >= 0) {
+		cpu_set_t cores;
+		CPU_ZERO(&cores);
+		if (settings.core < CPU_SETSIZE) CPU_SET(settings.core, &cores);
+
+		int result = pinned ? 0 : pthread_getaffinity_np(pthread_self(), sizeof(originalCores), &originalCores);
+		if (result == 0) result = pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+		if (result == 0) pinned = true;
+		else appendError(error, "affinity", std::string(std::strerror(result)) + " (core " + std::to_string(settings.core) + ")");
+	} else if (pinned) {
+		if (const int result = pthread_setaffinity_np(pthread_self(), sizeof(originalCores), &originalCores)) {
+			appendError(error, "affinity", std::string(std::strerror(result)) + " (original affinity)");
+		} else {
+			pinned = false;
+		}
+	}
+#else
+	if (settings.core >= 0) appendError(error, "affinity", "not supported on this platform");
+#endif
+
+	// Memory locking prevents page faults in the step loop, only memory locked here is unlocked again
+	if (settings.lockMemory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) appendError(error, "memory locking", std::strerror(errno));
+		else memoryLocked = true;
+	} else if (memoryLocked.exchange(false)) {
+		munlockall();
+	}
+
+	return error.empty();
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+//! Scheduling policy, core affinity and memory locking of a thread, e.g. for low jitter timestepping.
+/*
+ * Real-time scheduling usually requires privileges (CAP_SYS_NICE and a sufficient RLIMIT_RTPRIO or
+ * RLIMIT_MEMLOCK on Linux). Every part of the settings is applied independently, parts that fail are
+ * reported but do not prevent the other parts from being applied.
+ */
+class ThreadScheduling
+{
+public:
+	enum class Policy
+	{
+		//! Time-sharing scheduling with the priority (nice value) the thread had before it was raised the first time.
+		Default,
+		//! Time-sharing scheduling (SCHED_OTHER) with a raised priority, i.e. a negative nice value.
+		RaisedPriority,
+		//! Real-time first-in first-out scheduling (SCHED_FIFO), preempts all time-sharing threads.
+		Fifo
+	};
+
+	struct Settings
+	{
+		Policy policy = Policy::Default;
+		//! Real-time priority for Fifo (1 to 99), amount the nice value is lowered by for RaisedPriority (1 to 20).
+		int priority = 10;
+		//! Index of the core the thread is pinned to, a negative index restores the affinity the thread had before it was pinned.
+		int core = -1;
+		//! Locks all current and future pages of the process in memory (mlockall), affects the whole process.
+		/*
+		 * Disabling it only unlocks the memory (munlockall) if it was locked by an earlier call of
+		 * applyToCurrentThread.
+		 */
+		bool lockMemory = false;
+	};
+
+	//! Applies the settings to the calling thread, returns false and describes the failed parts in 'error'.
+	static bool applyToCurrentThread(const Settings& settings, std::string& error);
+
+	//! Returns a human readable name of the policy.
+	static const char* policyName(Policy policy);
+};
@@ -0,0 +1,31 @@
+#include "TimestepStatistics.h"
+
+const char* TimestepTimings::phaseName(TimestepPhase phase)
+{
+	switch (phase) {
+		case TimestepPhase::Synchronize: return "Synchronize";
+		case TimestepPhase::JointForces: return "Joint forces";
+		case TimestepPhase::Integration: return "Integration";
+		case TimestepPhase::DerivedState: return "Derived state";
+		case TimestepPhase::Collisions: return "Collisions";
+		case TimestepPhase::Contacts: return "Contacts";
+		case TimestepPhase::Sleeping: return "Sleeping";
+		case TimestepPhase::Output: return "Output";
+		default: return "Unknown";
+	}
+}
+
+void TimestepStatistics::add(const TimestepTimings& timings)
+{
+	for (std::size_t phase = 0; phase < TimestepTimings::phaseCount; phase++) m_phases[phase].add(timings.phases[phase]);
+	m_total.add(timings.total);
+}
+
+TimestepStatistics::Summary TimestepStatistics::summary() const
+{
+	Summary summary;
+	summary.sampleCount = m_total.sampleCount();
+	for (std::size_t phase = 0; phase < TimestepTimings::phaseCount; phase++) summary.phases[phase] = m_phases[phase].percentiles();
+	summary.total = m_total.percentiles();
+	return summary;
+}
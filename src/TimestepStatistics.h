@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "RollingStatistics.h"
+
+//! Phases of AnimationSystem::computeTimestep that are timed separately.
+enum class TimestepPhase
+{
+	//! Synchronization of the store with the registry, waking up of islands.
+	Synchronize,
+	//! Accumulation of the joint forces, for every force evaluation of the integrator.
+	JointForces,
+	//! Integration of the linear and angular state by the integrator, excluding force evaluations and derived state updates.
+	Integration,
+	//! Update of rotation and inertia matrices, connectors and external forces after every integrator stage.
+	DerivedState,
+	//! Collision broad- and narrow-phase.
+	Collisions,
+	//! Island building and contact solver.
+	Contacts,
+	//! Update of the sleep state of the bodies.
+	Sleeping,
+	//! Update of the render data, write back to the registry and trajectory recording, which run concurrently.
+	Output,
+	Count
+};
+
+//! Durations of the phases of a single timestep in seconds, summed over all sub steps.
+struct TimestepTimings
+{
+	static constexpr std::size_t phaseCount = static_cast<std::size_t>(TimestepPhase::Count);
+
+	//! Returns a human readable name of the phase.
+	static const char* phaseName(TimestepPhase phase);
+
+	std::array<double, phaseCount> phases = {};
+	//! Duration of the complete timestep.
+	double total = 0.0;
+
+	double& operator[](TimestepPhase phase) { return phases[static_cast<std::size_t>(phase)]; }
+	double operator[](TimestepPhase phase) const { return phases[static_cast<std::size_t>(phase)]; }
+};
+
+//! Rolling windows of the phase timings of the last timesteps.
+/*
+ * The timings are added by a single thread (the simulation thread) and summarized by any other thread
+ * without locks, see RollingStatistics. A summary computed concurrently to add() may mix samples of
+ * consecutive timesteps. Neither add() nor summary() allocate.
+ */
+class TimestepStatistics
+{
+public:
+	//! Number of timesteps in the rolling windows.
+	static constexpr std::size_t windowSize = RollingStatistics::windowSize;
+
+	using Percentiles = RollingStatistics::Percentiles;
+
+	struct Summary
+	{
+		//! Number of timesteps in the windows, at most 'windowSize'.
+		std::size_t sampleCount = 0;
+		std::array<Percentiles, TimestepTimings::phaseCount> phases;
+		Percentiles total;
+
+		const Percentiles& operator[](TimestepPhase phase) const { return phases[static_cast<std::size_t>(phase)]; }
+	};
+
+	//! Adds the timings of a timestep, replacing the oldest timestep of the windows. Must only be called by a single thread.
+	void add(const TimestepTimings& timings);
+	//! Computes the percentiles of all windows, may be called by any thread.
+	Summary summary() const;
+
+private:
+	std::array<RollingStatistics, TimestepTimings::phaseCount> m_phases;
+	RollingStatistics m_total;
+};
@@ -0,0 +1,167 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> Trace::s_enabled(false);
+
+namespace
+{
+	struct ZoneRecord
+	{
+		const char* name;
+		std::uint64_t begin;
+		std::uint64_t end;
+	};
+
+	//! Ring buffer of a single thread, written only by its thread.
+	struct ThreadBuffer
+	{
+		std::uint32_t id = 0;
+		std::string name;
+		//! Allocated with the first recorded zone.
+		std::unique_ptr<ZoneRecord[]> zones;
+		//! Number of zones recorded by the thread, the next zone is written at this index modulo the capacity.
+		std::atomic<std::uint64_t> count{0};
+		//! Zones with a lower index were discarded by clear().
+		std::atomic<std::uint64_t> first{0};
+	};
+
+	struct TraceRegistry
+	{
+		std::mutex mutex;
+		//! Buffers are kept after their thread exited, so that its zones can still be exported.
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+		//! Reference point for the conversion of clock ticks to time.
+		std::uint64_t originTicks = Trace::now();
+		std::chrono::steady_clock::time_point originTime = std::chrono::steady_clock::now();
+	};
+
+	TraceRegistry& traceRegistry()
+	{
+		static TraceRegistry registry;
+		return registry;
+	}
+
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer) {
+			auto& registry = traceRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+
+			registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+			buffer = registry.buffers.back().get();
+			buffer->id = static_cast<std::uint32_t>(registry.buffers.size());
+			buffer->name = "Thread " + std::to_string(buffer->id);
+		}
+		return *buffer;
+	}
+
+	//! Writes the string as JSON string literal, zone names are expected to be plain identifiers.
+	void writeJsonString(std::ostream& out, const char* text)
+	{
+		out << '"';
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\') out << '\\';
+			out << *text;
+		}
+		out << '"';
+	}
+}
+
+void Trace::setEnabled(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const std::string& name)
+{
+	auto& buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(traceRegistry().mutex);
+	buffer.name = name;
+}
+
+void Trace::record(const char* name, std::uint64_t begin, std::uint64_t end)
+{
+	auto& buffer = threadBuffer();
+	// Threads that only set their name do not allocate a ring buffer
+	if (!buffer.zones) buffer.zones.reset(new ZoneRecord[bufferCapacity]);
+
+	const std::uint64_t index = buffer.count.load(std::memory_order_relaxed);
+	buffer.zones[index % bufferCapacity] = { name, begin, end };
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void Trace::clear()
+{
+	auto& registry = traceRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	for (auto& buffer : registry.buffers) buffer->first.store(buffer->count.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+void Trace::writeChromeTrace(std::ostream& out)
+{
+	auto& registry = traceRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	// The tick rate is measured over the lifetime of the trace, which has to be long enough for a precise result
+	auto elapsed = std::chrono::steady_clock::now() - registry.originTime;
+	if (elapsed < std::chrono::milliseconds(10)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+		elapsed = std::chrono::steady_clock::now() - registry.originTime;
+	}
+	const double microseconds = std::chrono::duration<double, std::micro>(elapsed).count();
+	const double ticksPerMicrosecond = static_cast<double>(now() - registry.originTicks) / microseconds;
+	const auto toMicroseconds = [&](std::uint64_t ticks) {
+		return static_cast<double>(static_cast<std::int64_t>(ticks - registry.originTicks)) / ticksPerMicrosecond;
+	};
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool firstEvent = true;
+	const auto separator = [&]() -> std::ostream& {
+		out << (firstEvent ? "\n" : ",\n");
+		firstEvent = false;
+		return out;
+	};
+
+	std::vector<ZoneRecord> zones;
+	for (const auto& buffer : registry.buffers) {
+		separator() << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+		writeJsonString(out, buffer->name.c_str());
+		out << "}}";
+
+		// Copy the zones first and drop those that were overwritten by the thread in the meantime
+		const std::uint64_t count = buffer->count.load(std::memory_order_acquire);
+		const std::uint64_t first = std::max(buffer->first.load(std::memory_order_relaxed), count > bufferCapacity ? count - bufferCapacity : 0);
+		zones.clear();
+		for (std::uint64_t i = first; i < count; i++) zones.push_back(buffer->zones[i % bufferCapacity]);
+
+		const std::uint64_t countAfterCopy = buffer->count.load(std::memory_order_acquire);
+		const std::uint64_t overwritten = countAfterCopy > bufferCapacity ? countAfterCopy - bufferCapacity : 0;
+		const std::size_t skipped = static_cast<std::size_t>(std::min<std::uint64_t>(std::max(overwritten, first) - first, zones.size()));
+
+		for (std::size_t i = skipped; i < zones.size(); i++) {
+			const auto& zone = zones[i];
+			separator() << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"name\":";
+			writeJsonString(out, zone.name);
+			out << ",\"ts\":" << toMicroseconds(zone.begin) << ",\"dur\":" << toMicroseconds(zone.end) - toMicroseconds(zone.begin) << "}";
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+bool Trace::writeChromeTrace(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file) return false;
+	file.precision(12);
+	writeChromeTrace(file);
+	return static_cast<bool>(file);
+}
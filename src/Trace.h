@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#define PHYANI_TRACE_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define PHYANI_TRACE_TSC
+#endif
+
+//! Low overhead tracing of scoped zones of all threads, exported in the Chrome trace event format.
+/*
+ * Every thread records its zones into its own ring buffer, so recording neither locks nor allocates
+ * after the first zone of a thread. Timestamps are read from the time stamp counter where available and
+ * converted to microseconds on export, the exported JSON can be opened with chrome://tracing or Perfetto.
+ * Recording is disabled at runtime by default, see setEnabled(). If PHYANI_TRACING is not defined, the
+ * TRACE_ZONE macro compiles to nothing and the instrumented code contains no tracing at all.
+ */
+class Trace
+{
+public:
+	//! Number of zones kept per thread, older zones are overwritten.
+	static constexpr std::size_t bufferCapacity = 1 << 16;
+
+	//! Starts or stops the recording of zones by all threads.
+	static void setEnabled(bool enabled);
+	static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	//! Sets the name of the calling thread in the exported trace.
+	static void setThreadName(const std::string& name);
+
+	//! Returns the current time in ticks of the trace clock.
+	static std::uint64_t now()
+	{
+#ifdef PHYANI_TRACE_TSC
+		return __rdtsc();
+#else
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	//! Records a zone of the calling thread, the name has to outlive the trace (e.g. a string literal).
+	static void record(const char* name, std::uint64_t begin, std::uint64_t end);
+
+	//! Discards the zones recorded so far.
+	static void clear();
+	//! Writes the zones of all threads as Chrome trace JSON, zones overwritten during the export are skipped.
+	static void writeChromeTrace(std::ostream& out);
+	//! Writes the zones of all threads as Chrome trace JSON to the file, returns false on failure.
+	static bool writeChromeTrace(const std::string& path);
+
+	//! Records its lifetime as a zone of the calling thread if tracing is enabled at construction.
+	class Zone
+	{
+	public:
+		explicit Zone(const char* name)
+			: m_name(name)
+			, m_begin(isEnabled() ? now() : 0) {}
+
+		~Zone()
+		{
+			if (m_begin != 0) record(m_name, m_begin, now());
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* m_name;
+		std::uint64_t m_begin;
+	};
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+#define PHYANI_TRACE_CONCAT_IMPL(a, b) a##b
+#define PHYANI_TRACE_CONCAT(a, b) PHYANI_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef PHYANI_TRACING
+	//! Records the remainder of the enclosing scope as a zone with the specified name, which has to outlive the trace.
+	#define TRACE_ZONE(name) Trace::Zone PHYANI_TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+	#define TRACE_ZONE(name) ((void)0)
+#endif
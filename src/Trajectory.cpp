@@ -0,0 +1,438 @@
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace TrajectoryFormat;
+
+namespace
+{
+	constexpr double rotationScale = 32767.0;
+
+	//! Maximum number of bytes of a varint encoding the difference of two int32 and int16 values respectively.
+	constexpr std::size_t maxPositionDeltaSize = 5;
+	constexpr std::size_t maxRotationDeltaSize = 3;
+
+	std::int32_t quantizePosition(double value, double step)
+	{
+		const double quantized = std::round(value / step);
+		return static_cast<std::int32_t>(std::clamp(quantized,
+													static_cast<double>(std::numeric_limits<std::int32_t>::min()),
+													static_cast<double>(std::numeric_limits<std::int32_t>::max())));
+	}
+
+	std::int16_t quantizeRotation(double value)
+	{
+		return static_cast<std::int16_t>(std::round(std::clamp(value, -1.0, 1.0)*rotationScale));
+	}
+
+	std::uint64_t zigzag(std::int64_t value)
+	{
+		return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+	}
+
+	std::int64_t unzigzag(std::uint64_t value)
+	{
+		return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+	}
+
+	char* writeVarint(char* cursor, std::int64_t value)
+	{
+		std::uint64_t encoded = zigzag(value);
+		while (encoded >= 0x80) {
+			*cursor++ = static_cast<char>(encoded | 0x80);
+			encoded >>= 7;
+		}
+		*cursor++ = static_cast<char>(encoded);
+		return cursor;
+	}
+
+	//! Reads a varint, returns nullptr if it exceeds the end of the payload.
+	const char* readVarint(const char* cursor, const char* end, std::int64_t& value)
+	{
+		std::uint64_t encoded = 0;
+		for (unsigned shift = 0; cursor != end && shift < 64; shift += 7) {
+			const auto byte = static_cast<std::uint8_t>(*cursor++);
+			encoded |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) {
+				value = unzigzag(encoded);
+				return cursor;
+			}
+		}
+		return nullptr;
+	}
+
+	template <typename T>
+	char* writeArray(char* cursor, const std::vector<T>& values)
+	{
+		std::memcpy(cursor, values.data(), values.size()*sizeof(T));
+		return cursor + values.size()*sizeof(T);
+	}
+
+	template <typename T>
+	const char* readArray(const char* cursor, const char* end, std::vector<T>& values)
+	{
+		if (static_cast<std::size_t>(end - cursor) < values.size()*sizeof(T)) return nullptr;
+		std::memcpy(values.data(), cursor, values.size()*sizeof(T));
+		return cursor + values.size()*sizeof(T);
+	}
+
+	template <typename T>
+	char* writeDeltas(char* cursor, const std::vector<T>& values, const std::vector<T>& previous)
+	{
+		for (std::size_t i = 0; i < values.size(); i++) {
+			cursor = writeVarint(cursor, static_cast<std::int64_t>(values[i]) - static_cast<std::int64_t>(previous[i]));
+		}
+		return cursor;
+	}
+
+	template <typename T>
+	const char* readDeltas(const char* cursor, const char* end, std::vector<T>& values)
+	{
+		for (auto& value : values) {
+			std::int64_t delta = 0;
+			cursor = readVarint(cursor, end, delta);
+			if (!cursor) return nullptr;
+			value = static_cast<T>(value + delta);
+		}
+		return cursor;
+	}
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	stop();
+}
+
+bool TrajectoryRecorder::start(const std::string& path, const Settings& settings)
+{
+	stop();
+
+	m_settings = settings;
+	m_settings.stepInterval = std::max<std::size_t>(m_settings.stepInterval, 1);
+	m_settings.keyframeInterval = std::max<std::size_t>(m_settings.keyframeInterval, 1);
+	m_settings.chunkSize = std::max(m_settings.chunkSize, sizeof(FileHeader));
+	m_settings.bufferCount = std::max<std::size_t>(m_settings.bufferCount, 1);
+
+	if (!m_file.open(path, MappedFile::Mode::Write, m_settings.chunkSize)) return false;
+	m_writeOffset = sizeof(FileHeader);
+	m_index.clear();
+	m_translationalEntities.clear();
+	m_rotationalEntities.clear();
+	m_framesSinceKeyframe = 0;
+
+	m_buffers.assign(m_settings.bufferCount, FrameBuffer());
+	for (auto& frame : m_buffers) {
+		frame.translationalEntities.reserve(m_settings.reservedBodyCount);
+		frame.rotationalEntities.reserve(m_settings.reservedBodyCount);
+		frame.positions.reserve(m_settings.reservedBodyCount);
+		frame.rotations.reserve(m_settings.reservedBodyCount);
+	}
+	m_freeBuffers.reset(m_settings.bufferCount);
+	m_filledBuffers.reset(m_settings.bufferCount);
+	for (std::uint32_t i = 0; i < m_settings.bufferCount; i++) m_freeBuffers.push(i);
+
+	m_stepCounter = 0;
+	m_recordedFrames = 0;
+	m_droppedFrames = 0;
+
+	m_recording = true;
+	m_writer = std::thread(&TrajectoryRecorder::writeFrames, this);
+	return true;
+}
+
+void TrajectoryRecorder::stop()
+{
+	if (!m_writer.joinable()) return;
+
+	// The writer drains the queue before it finishes the file
+	m_recording = false;
+	m_writer.join();
+}
+
+bool TrajectoryRecorder::isRecording() const
+{
+	return m_recording;
+}
+
+void TrajectoryRecorder::onTimestep(const BodyStateStore& store, double time)
+{
+	if (!m_recording.load(std::memory_order_relaxed)) return;
+	if (m_stepCounter++ % m_settings.stepInterval != 0) return;
+
+	std::uint32_t bufferIndex;
+	if (!m_freeBuffers.pop(bufferIndex)) {
+		m_droppedFrames++;
+		return;
+	}
+
+	// The buffers keep their capacity, so this only allocates when the number of bodies grows
+	auto& frame = m_buffers[bufferIndex];
+	frame.time = time;
+	frame.translationalEntities.assign(store.translational.entities.begin(), store.translational.entities.end());
+	frame.rotationalEntities.assign(store.rotational.entities.begin(), store.rotational.entities.end());
+	frame.positions.assign(store.translational.position.begin(), store.translational.position.end());
+	frame.rotations.assign(store.rotational.rotation.begin(), store.rotational.rotation.end());
+
+	m_filledBuffers.push(bufferIndex);
+}
+
+std::size_t TrajectoryRecorder::recordedFrameCount() const
+{
+	return m_recordedFrames;
+}
+
+std::size_t TrajectoryRecorder::droppedFrameCount() const
+{
+	return m_droppedFrames;
+}
+
+void TrajectoryRecorder::writeFrames()
+{
+	for (;;) {
+		// Frames pushed before the recording was stopped are visible after the flag was read
+		const bool recording = m_recording.load(std::memory_order_acquire);
+
+		bool wroteFrame = false;
+		std::uint32_t bufferIndex;
+		while (m_filledBuffers.pop(bufferIndex)) {
+			writeFrame(m_buffers[bufferIndex]);
+			m_freeBuffers.push(bufferIndex);
+			wroteFrame = true;
+		}
+
+		if (!recording) break;
+		if (!wroteFrame) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	finish();
+}
+
+void TrajectoryRecorder::writeFrame(const FrameBuffer& frame)
+{
+	const std::size_t translationalCount = frame.positions.size();
+	const std::size_t rotationalCount = frame.rotations.size();
+
+	m_positions.resize(3*translationalCount);
+	for (std::size_t i = 0; i < translationalCount; i++) {
+		for (int c = 0; c < 3; c++) m_positions[3*i + c] = quantizePosition(frame.positions[i][c], m_settings.positionStep);
+	}
+
+	// q and -q are the same rotation, a non-negative w keeps the components continuous for the deltas
+	m_rotations.resize(4*rotationalCount);
+	for (std::size_t i = 0; i < rotationalCount; i++) {
+		const auto& q = frame.rotations[i];
+		const double sign = (q.w() < 0.0) ? -1.0 : 1.0;
+		m_rotations[4*i + 0] = quantizeRotation(sign*q.x());
+		m_rotations[4*i + 1] = quantizeRotation(sign*q.y());
+		m_rotations[4*i + 2] = quantizeRotation(sign*q.z());
+		m_rotations[4*i + 3] = quantizeRotation(sign*q.w());
+	}
+
+	// Deltas require the same bodies in the same order as the previous frame
+	const bool sameBodies = frame.translationalEntities == m_translationalEntities && frame.rotationalEntities == m_rotationalEntities;
+	const bool keyframe = m_index.empty() || !sameBodies || m_framesSinceKeyframe + 1 >= m_settings.keyframeInterval;
+
+	const std::size_t maxPayloadSize = keyframe
+		? (translationalCount + rotationalCount)*sizeof(EntityType) + m_positions.size()*sizeof(std::int32_t) + m_rotations.size()*sizeof(std::int16_t)
+		: m_positions.size()*maxPositionDeltaSize + m_rotations.size()*maxRotationDeltaSize;
+	if (!reserve(sizeof(FrameHeader) + maxPayloadSize)) {
+		m_droppedFrames++;
+		return;
+	}
+
+	char* payload = m_file.data() + m_writeOffset + sizeof(FrameHeader);
+	char* cursor = payload;
+	if (keyframe) {
+		cursor = writeArray(cursor, frame.translationalEntities);
+		cursor = writeArray(cursor, frame.rotationalEntities);
+		cursor = writeArray(cursor, m_positions);
+		cursor = writeArray(cursor, m_rotations);
+	} else {
+		cursor = writeDeltas(cursor, m_positions, m_previousPositions);
+		cursor = writeDeltas(cursor, m_rotations, m_previousRotations);
+	}
+
+	FrameHeader header;
+	header.time = frame.time;
+	header.translationalCount = static_cast<std::uint32_t>(translationalCount);
+	header.rotationalCount = static_cast<std::uint32_t>(rotationalCount);
+	header.payloadSize = static_cast<std::uint32_t>(cursor - payload);
+	header.keyframe = keyframe ? 1 : 0;
+	std::memcpy(m_file.data() + m_writeOffset, &header, sizeof(FrameHeader));
+
+	m_index.push_back({ m_writeOffset, frame.time, header.keyframe });
+	m_writeOffset += sizeof(FrameHeader) + header.payloadSize;
+
+	if (keyframe) {
+		m_translationalEntities = frame.translationalEntities;
+		m_rotationalEntities = frame.rotationalEntities;
+		m_framesSinceKeyframe = 0;
+	} else {
+		m_framesSinceKeyframe++;
+	}
+	m_previousPositions.swap(m_positions);
+	m_previousRotations.swap(m_rotations);
+
+	m_recordedFrames++;
+}
+
+bool TrajectoryRecorder::reserve(std::size_t byteCount)
+{
+	const std::size_t required = m_writeOffset + byteCount;
+	if (required <= m_file.size()) return true;
+
+	const std::size_t chunks = (required - m_file.size() + m_settings.chunkSize - 1) / m_settings.chunkSize;
+	return m_file.resize(m_file.size() + chunks*m_settings.chunkSize);
+}
+
+void TrajectoryRecorder::finish()
+{
+	if (!m_file.isOpen()) return;
+
+	// The index is aligned, so that the reader can access it directly in the mapping
+	const std::size_t indexOffset = (m_writeOffset + alignof(IndexEntry) - 1) / alignof(IndexEntry)*alignof(IndexEntry);
+	const std::size_t indexSize = m_index.size()*sizeof(IndexEntry);
+
+	FileHeader header;
+	std::memcpy(header.magic, magic, sizeof(header.magic));
+	header.version = version;
+	header.positionStep = m_settings.positionStep;
+	header.frameCount = 0;
+	header.indexOffset = 0;
+
+	m_writeOffset = indexOffset;
+	if (reserve(indexSize)) {
+		std::memcpy(m_file.data() + indexOffset, m_index.data(), indexSize);
+		header.frameCount = m_index.size();
+		header.indexOffset = indexOffset;
+		m_writeOffset += indexSize;
+	}
+
+	std::memcpy(m_file.data(), &header, sizeof(FileHeader));
+	m_file.close(m_writeOffset);
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+	close();
+	if (!m_file.open(path, MappedFile::Mode::Read)) return false;
+
+	const bool valid = [&]() {
+		if (m_file.size() < sizeof(FileHeader)) return false;
+		std::memcpy(&m_header, m_file.data(), sizeof(FileHeader));
+		if (std::memcmp(m_header.magic, magic, sizeof(m_header.magic)) != 0 || m_header.version != version) return false;
+
+		// Files of recordings that were not stopped have no index
+		if (m_header.indexOffset < sizeof(FileHeader) || m_header.indexOffset % alignof(IndexEntry) != 0) return false;
+		return m_header.indexOffset + m_header.frameCount*sizeof(IndexEntry) <= m_file.size();
+	}();
+
+	if (!valid) {
+		close();
+		return false;
+	}
+
+	m_index = reinterpret_cast<const IndexEntry*>(m_file.data() + m_header.indexOffset);
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	m_file.close();
+	m_header = {};
+	m_index = nullptr;
+	m_decodedFrame = invalidFrame;
+}
+
+bool TrajectoryReader::isOpen() const
+{
+	return m_index != nullptr;
+}
+
+std::size_t TrajectoryReader::frameCount() const
+{
+	return static_cast<std::size_t>(m_header.frameCount);
+}
+
+double TrajectoryReader::frameTime(std::size_t frame) const
+{
+	return m_index[frame].time;
+}
+
+double TrajectoryReader::positionStep() const
+{
+	return m_header.positionStep;
+}
+
+bool TrajectoryReader::readFrame(std::size_t frame,
+								 std::vector<EntityType>& translationalEntities, std::vector<Eigen::Vector3d>& positions,
+								 std::vector<EntityType>& rotationalEntities, BodyStateStore::aligned_vector<Eigen::Quaterniond>& rotations)
+{
+	if (frame >= frameCount() || !decodeFrame(frame)) return false;
+
+	translationalEntities = m_translationalEntities;
+	positions.resize(m_translationalEntities.size());
+	for (std::size_t i = 0; i < positions.size(); i++) {
+		positions[i] = Eigen::Vector3d(m_positions[3*i], m_positions[3*i + 1], m_positions[3*i + 2])*m_header.positionStep;
+	}
+
+	rotationalEntities = m_rotationalEntities;
+	rotations.resize(m_rotationalEntities.size());
+	for (std::size_t i = 0; i < rotations.size(); i++) {
+		const std::int16_t* q = &m_rotations[4*i];
+		rotations[i] = Eigen::Quaterniond(q[3], q[0], q[1], q[2]).normalized();
+	}
+
+	return true;
+}
+
+bool TrajectoryReader::decodeFrame(std::size_t frame)
+{
+	if (frame == m_decodedFrame) return true;
+
+	std::size_t first = frame;
+	while (!m_index[first].keyframe) {
+		if (first == 0) return false;
+		first--;
+	}
+
+	// Continue from the decoded frame if it lies between the keyframe and the requested frame
+	if (m_decodedFrame != invalidFrame && m_decodedFrame >= first && m_decodedFrame < frame) first = m_decodedFrame + 1;
+	m_decodedFrame = invalidFrame;
+
+	for (std::size_t i = first; i <= frame; i++) {
+		const std::uint64_t offset = m_index[i].offset;
+		if (offset < sizeof(FileHeader) || offset + sizeof(FrameHeader) > m_header.indexOffset) return false;
+
+		FrameHeader header;
+		std::memcpy(&header, m_file.data() + offset, sizeof(FrameHeader));
+		const char* cursor = m_file.data() + offset + sizeof(FrameHeader);
+		const char* end = cursor + header.payloadSize;
+		if (offset + sizeof(FrameHeader) + header.payloadSize > m_header.indexOffset) return false;
+
+		if (header.keyframe) {
+			m_translationalEntities.resize(header.translationalCount);
+			m_rotationalEntities.resize(header.rotationalCount);
+			m_positions.resize(3*std::size_t(header.translationalCount));
+			m_rotations.resize(4*std::size_t(header.rotationalCount));
+
+			cursor = readArray(cursor, end, m_translationalEntities);
+			if (cursor) cursor = readArray(cursor, end, m_rotationalEntities);
+			if (cursor) cursor = readArray(cursor, end, m_positions);
+			if (cursor) cursor = readArray(cursor, end, m_rotations);
+		} else {
+			if (header.translationalCount != m_translationalEntities.size() || header.rotationalCount != m_rotationalEntities.size()) return false;
+
+			cursor = readDeltas(cursor, end, m_positions);
+			if (cursor) cursor = readDeltas(cursor, end, m_rotations);
+		}
+		if (!cursor) return false;
+	}
+
+	m_decodedFrame = frame;
+	return true;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include "BodyStateStore.h"
+#include "MappedFile.h"
+#include "SpscQueue.h"
+
+//! Layout of the trajectory files written by TrajectoryRecorder and read by TrajectoryReader.
+/*
+ * A trajectory file starts with a FileHeader and is followed by the frames, each consisting of a
+ * FrameHeader and its payload, and an index with one IndexEntry per frame at the end. Positions are
+ * quantized to multiples of 'positionStep', the components of the rotations (with non-negative w) to
+ * 16 bit fixed point numbers.
+ *
+ * The payload of a keyframe contains the entities of the translational and rotational bodies followed by
+ * the raw quantized positions and rotations. The payload of every other frame contains the differences of
+ * the quantized values to the previous frame as zigzag encoded varints, so bodies at rest take a single
+ * byte per component. A frame is decoded starting at the closest preceding keyframe.
+ */
+namespace TrajectoryFormat
+{
+	const char magic[4] = { 'P', 'T', 'R', 'J' };
+	constexpr std::uint32_t version = 1;
+
+	struct FileHeader
+	{
+		char magic[4];
+		std::uint32_t version;
+		double positionStep;
+		std::uint64_t frameCount;
+		std::uint64_t indexOffset;
+	};
+
+	struct FrameHeader
+	{
+		double time;
+		std::uint32_t translationalCount;
+		std::uint32_t rotationalCount;
+		std::uint32_t payloadSize;
+		std::uint32_t keyframe;
+	};
+
+	struct IndexEntry
+	{
+		std::uint64_t offset;
+		double time;
+		std::uint64_t keyframe;
+	};
+}
+
+//! Records the positions and rotations of all bodies of a BodyStateStore into a memory-mapped trajectory file.
+/*
+ * The simulation thread only copies the state into one of a fixed number of preallocated frame buffers
+ * and hands it over to a writer thread through a lock-free queue, the quantization, encoding and all file
+ * operations happen on the writer thread. If the writer falls behind and no buffer is free, the frame is
+ * dropped instead of blocking the timestep. The file is grown in chunks of 'chunkSize' bytes and truncated
+ * to its actual size by stop().
+ */
+class TrajectoryRecorder
+{
+public:
+	struct Settings
+	{
+		//! A frame is recorded every 'stepInterval' timesteps.
+		std::size_t stepInterval = 1;
+		//! Every 'keyframeInterval'-th frame is stored without delta encoding, bounds the cost of random access.
+		std::size_t keyframeInterval = 60;
+		//! Resolution of the quantized positions.
+		double positionStep = 1e-4;
+		//! Number of bytes the file is grown by when it is full.
+		std::size_t chunkSize = 64 << 20;
+		//! Number of frames that can be in flight between the simulation and the writer thread.
+		std::size_t bufferCount = 8;
+		//! Number of bodies the frame buffers are preallocated for, recording more bodies allocates in the first frames.
+		std::size_t reservedBodyCount = 0;
+	};
+
+	TrajectoryRecorder() = default;
+	~TrajectoryRecorder();
+
+	TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+	TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+	//! Creates the file and starts the writer thread, returns false if the file could not be created.
+	bool start(const std::string& path, const Settings& settings);
+	//! Writes all pending frames and the index, closes the file and joins the writer thread.
+	void stop();
+	bool isRecording() const;
+
+	//! Hands the state over to the writer thread every 'stepInterval' calls, never blocks. Must not be called concurrently to start() or stop().
+	void onTimestep(const BodyStateStore& store, double time);
+
+	//! Returns the number of frames written to the file so far.
+	std::size_t recordedFrameCount() const;
+	//! Returns the number of frames that were dropped because the writer thread fell behind.
+	std::size_t droppedFrameCount() const;
+
+private:
+	struct FrameBuffer
+	{
+		double time = 0.0;
+		std::vector<EntityType> translationalEntities;
+		std::vector<EntityType> rotationalEntities;
+		std::vector<Eigen::Vector3d> positions;
+		BodyStateStore::aligned_vector<Eigen::Quaterniond> rotations;
+	};
+
+	Settings m_settings;
+	MappedFile m_file;
+	std::thread m_writer;
+	std::atomic<bool> m_recording{false};
+
+	std::vector<FrameBuffer> m_buffers;
+	//! Indices of the buffers that can be filled by the simulation thread.
+	SpscQueue<std::uint32_t> m_freeBuffers;
+	//! Indices of the filled buffers in the order of the timesteps.
+	SpscQueue<std::uint32_t> m_filledBuffers;
+
+	std::size_t m_stepCounter = 0;
+	std::atomic<std::size_t> m_recordedFrames{0};
+	std::atomic<std::size_t> m_droppedFrames{0};
+
+	// State of the writer thread
+	std::size_t m_writeOffset = 0;
+	std::size_t m_framesSinceKeyframe = 0;
+	std::vector<TrajectoryFormat::IndexEntry> m_index;
+	std::vector<EntityType> m_translationalEntities;
+	std::vector<EntityType> m_rotationalEntities;
+	std::vector<std::int32_t> m_positions;
+	std::vector<std::int16_t> m_rotations;
+	std::vector<std::int32_t> m_previousPositions;
+	std::vector<std::int16_t> m_previousRotations;
+
+	void writeFrames();
+	void writeFrame(const FrameBuffer& frame);
+	bool reserve(std::size_t byteCount);
+	void finish();
+};
+
+//! Random access to the frames of a trajectory file written by TrajectoryRecorder.
+/*
+ * Decoding a frame starts at the closest preceding keyframe or at the last decoded frame if it is closer,
+ * so sequential playback decodes every frame only once.
+ */
+class TrajectoryReader
+{
+public:
+	//! Maps the file and validates its header and index, returns false if it is not a complete trajectory file.
+	bool open(const std::string& path);
+	void close();
+	bool isOpen() const;
+
+	std::size_t frameCount() const;
+	double frameTime(std::size_t frame) const;
+	//! Returns the resolution of the quantized positions.
+	double positionStep() const;
+
+	//! Decodes the state of a frame, returns false if the frame index is out of range.
+	/*
+	 * The positions belong to the entities of the translational bodies, the rotations to the entities of
+	 * the rotational bodies of the store at the time of recording.
+	 */
+	bool readFrame(std::size_t frame,
+				   std::vector<EntityType>& translationalEntities, std::vector<Eigen::Vector3d>& positions,
+				   std::vector<EntityType>& rotationalEntities, BodyStateStore::aligned_vector<Eigen::Quaterniond>& rotations);
+
+private:
+	static constexpr std::size_t invalidFrame = static_cast<std::size_t>(-1);
+
+	MappedFile m_file;
+	TrajectoryFormat::FileHeader m_header = {};
+	const TrajectoryFormat::IndexEntry* m_index = nullptr;
+
+	//! Index of the frame stored in the decoding state, invalid if none.
+	std::size_t m_decodedFrame = invalidFrame;
+	std::vector<EntityType> m_translationalEntities;
+	std::vector<EntityType> m_rotationalEntities;
+	std::vector<std::int32_t> m_positions;
+	std::vector<std::int16_t> m_rotations;
+
+	bool decodeFrame(std::size_t frame);
+};
@@ -0,0 +1,112 @@
+#include "WorkerPool.h"
+
+#include "AllocationTracker.h"
+#include "Trace.h"
+
+thread_local bool WorkerPool::t_insideTask = false;
+
+WorkerPool::WorkerPool(std::size_t threadCount)
+	: m_generation(0)
+	, m_finishedWorkers(0)
+	, m_shutdown(false)
+	, m_jobContext(nullptr)
+	, m_jobInvoke(nullptr)
+	, m_jobAllocationScope(nullptr)
+	, m_taskCount(0)
+	, m_nextTask(0)
+{
+	setThreadCount(threadCount);
+}
+
+WorkerPool::~WorkerPool()
+{
+	setThreadCount(1);
+}
+
+void WorkerPool::setThreadCount(std::size_t threadCount)
+{
+	std::lock_guard<std::mutex> runLock(m_runMutex);
+
+	// Stop and join all current workers
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_shutdown = true;
+	}
+	m_wakeCondition.notify_all();
+	for (auto& worker : m_workers) worker.join();
+	m_workers.clear();
+
+	// The calling thread is counted as one of the threads
+	m_shutdown = false;
+	for (std::size_t i = 1; i < threadCount; i++) {
+		m_workers.emplace_back(&WorkerPool::workerLoop, this, m_generation);
+	}
+}
+
+std::size_t WorkerPool::threadCount() const
+{
+	return m_workers.size() + 1;
+}
+
+void WorkerPool::execute(std::size_t taskCount, void* context, InvokeFunction invoke)
+{
+	std::lock_guard<std::mutex> runLock(m_runMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobContext = context;
+		m_jobInvoke = invoke;
+		m_jobAllocationScope = AllocationScope::current();
+		m_taskCount = taskCount;
+		m_nextTask.store(0);
+		m_finishedWorkers = 0;
+		m_generation++;
+	}
+	m_wakeCondition.notify_all();
+
+	// The calling thread participates in the execution
+	t_insideTask = true;
+	executeTasks();
+	t_insideTask = false;
+
+	// Wait until every worker has seen the job and left it, so no worker can observe the next job with stale state
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_finishedWorkers == m_workers.size(); });
+}
+
+void WorkerPool::executeTasks()
+{
+	TRACE_ZONE("WorkerPool::executeTasks");
+	AllocationScope::Binding allocationScope(m_jobAllocationScope);
+
+	std::size_t task;
+	while ((task = m_nextTask.fetch_add(1)) < m_taskCount) {
+		m_jobInvoke(m_jobContext, task);
+	}
+}
+
+void WorkerPool::workerLoop(std::size_t seenGeneration)
+{
+	t_insideTask = true;
+#ifdef PHYANI_TRACING
+	Trace::setThreadName("Worker");
+#endif
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&]() { return m_shutdown || m_generation != seenGeneration; });
+			if (m_shutdown) return;
+
+			seenGeneration = m_generation;
+		}
+
+		executeTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_finishedWorkers++;
+		}
+		m_doneCondition.notify_all();
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <initializer_list>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class AllocationScope;
+
+//! Persistent pool of worker threads used to execute independent tasks in parallel.
+/*
+ * The thread calling run() participates in the execution of the tasks, i.e. a pool with a thread count
+ * of one executes all tasks serially in the calling thread without any synchronization. Nested calls of
+ * run() from inside of a task are executed serially by the calling worker. Jobs are type erased without
+ * allocations, so submitting work in the step loop does not touch the heap. Tasks must not throw.
+ */
+class WorkerPool
+{
+public:
+	//! Creates a pool with the specified total number of threads (including the calling thread).
+	explicit WorkerPool(std::size_t threadCount = 1);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	//! Changes the total number of threads, joins and respawns the worker threads. Must not be called concurrently to run().
+	void setThreadCount(std::size_t threadCount);
+	//! Returns the total number of threads participating in a run() call.
+	std::size_t threadCount() const;
+
+	//! Executes 'task(taskIndex)' for every index in [0, taskCount) and blocks until all tasks are done.
+	template <typename TaskT>
+	void run(std::size_t taskCount, TaskT&& task)
+	{
+		if (taskCount == 0) return;
+
+		// Execute serially if there are no workers, only a single task or if called from inside of a task
+		if (m_workers.empty() || taskCount == 1 || t_insideTask) {
+			for (std::size_t i = 0; i < taskCount; i++) task(i);
+			return;
+		}
+
+		using FunctionT = std::remove_reference_t<TaskT>;
+		execute(taskCount, const_cast<void*>(static_cast<const void*>(&task)), [](void* context, std::size_t i) {
+			(*static_cast<FunctionT*>(context))(i);
+		});
+	}
+
+	//! Splits [begin, end) into chunks of 'grainSize' indices and calls 'body(chunkBegin, chunkEnd)' for each chunk in parallel.
+	/*
+	 * If element types are specified, the grain size is rounded up so that every chunk covers a whole number
+	 * of cache lines of arrays of each of these types. The chunk borders then coincide with cache line borders
+	 * for arrays whose first element starts a cache line, e.g. arrays using the CacheAlignedAllocator. For other
+	 * arrays adjacent chunks may share the cache lines at their borders. A grain size of zero selects a default
+	 * grain size based on the number of threads.
+	 */
+	template <typename... ElementTs, typename BodyT>
+	void parallelFor(std::size_t begin, std::size_t end, std::size_t grainSize, BodyT&& body)
+	{
+		if (end <= begin) return;
+
+		if (grainSize == 0) grainSize = defaultGrainSize(end - begin);
+		grainSize = cacheAlignedGrainSize<ElementTs...>(grainSize);
+		const std::size_t chunkCount = (end - begin + grainSize - 1) / grainSize;
+
+		run(chunkCount, [&](std::size_t chunk) {
+			const std::size_t chunkBegin = begin + chunk*grainSize;
+			body(chunkBegin, std::min(chunkBegin + grainSize, end));
+		});
+	}
+
+	//! Returns a grain size that results in a few chunks per thread for the specified number of elements.
+	std::size_t defaultGrainSize(std::size_t elementCount) const
+	{
+		return std::max<std::size_t>(elementCount / (4*threadCount()), minimumGrainSize);
+	}
+
+	//! Rounds the grain size up to a multiple of the number of elements that fill whole cache lines for all element types.
+	template <typename... ElementTs>
+	static std::size_t cacheAlignedGrainSize(std::size_t grainSize)
+	{
+		std::size_t multiple = 1;
+		for (std::size_t elementSize : { std::size_t(1), sizeof(ElementTs)... }) {
+			// Number of elements after which the element borders coincide with cache line borders
+			const std::size_t elementsPerLine = cacheLineSize / gcd(cacheLineSize, elementSize);
+			multiple = multiple / gcd(multiple, elementsPerLine) * elementsPerLine;
+		}
+
+		grainSize = std::max<std::size_t>(grainSize, 1);
+		return ((grainSize + multiple - 1) / multiple) * multiple;
+	}
+
+	//! Size of a cache line in bytes that is assumed for the chunking.
+	static constexpr std::size_t cacheLineSize = 64;
+	//! Lower bound for default grain sizes, smaller chunks are dominated by scheduling overhead.
+	static constexpr std::size_t minimumGrainSize = 256;
+
+private:
+	using InvokeFunction = void(*)(void*, std::size_t);
+
+	static constexpr std::size_t gcd(std::size_t a, std::size_t b)
+	{
+		return (b == 0) ? a : gcd(b, a % b);
+	}
+
+	//! Publishes the job to the workers, participates in its execution and waits for completion.
+	void execute(std::size_t taskCount, void* context, InvokeFunction invoke);
+	//! Executes tasks of the current job until no tasks are left.
+	void executeTasks();
+	//! Main function of the worker threads, starts waiting for the generation following 'seenGeneration'.
+	void workerLoop(std::size_t seenGeneration);
+
+	//! Flag set in threads while they are executing a task, used to serialize nested parallelism.
+	static thread_local bool t_insideTask;
+
+	std::vector<std::thread> m_workers;
+
+	//! Serializes concurrent run() calls from different threads.
+	std::mutex m_runMutex;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::condition_variable m_doneCondition;
+
+	std::size_t m_generation;
+	std::size_t m_finishedWorkers;
+	bool m_shutdown;
+
+	void* m_jobContext;
+	InvokeFunction m_jobInvoke;
+	//! Allocation scope of the thread that started the job, the workers attribute their allocations to it.
+	AllocationScope* m_jobAllocationScope;
+	std::size_t m_taskCount;
+	std::atomic<std::size_t> m_nextTask;
+};
+
+//! Allocator that starts arrays at a cache line border, so that the chunks of WorkerPool::parallelFor do not share cache lines.
+template <typename T>
+struct CacheAlignedAllocator
+{
+	using value_type = T;
+
+	CacheAlignedAllocator() = default;
+	template <typename U>
+	CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+	T* allocate(std::size_t count)
+	{
+		return static_cast<T*>(::operator new(count*sizeof(T), std::align_val_t(alignment)));
+	}
+
+	void deallocate(T* pointer, std::size_t)
+	{
+		::operator delete(pointer, std::align_val_t(alignment));
+	}
+
+	template <typename U>
+	bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+
+	//! Cache line size, raised to the alignment of the type for over-aligned types.
+	static constexpr std::size_t alignment = std::max(WorkerPool::cacheLineSize, alignof(T));
+};
@@ -0,0 +1,60 @@
+#include "BenchmarkScene.h"
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include "EntityFactory.h"
+
+std::string BenchmarkCase::name() const
+{
+	std::ostringstream stream;
+	stream << "computeTimestep/bodies:" << bodyCount << "/springs:" << springsPerBody
+		   << "/particles:" << particleFraction << "/threads:" << threadCount;
+	return stream.str();
+}
+
+std::size_t BenchmarkScene::build(EntityComponentSystem& ecs, const BenchmarkCase& benchmarkCase)
+{
+	const double spacing = 1.0;
+	const double edgeLength = 0.4;
+	const double mass = 1.0;
+
+	// Smallest cubic grid holding all bodies, filled in x, y, z order
+	const std::size_t n = benchmarkCase.bodyCount;
+	std::size_t side = static_cast<std::size_t>(std::ceil(std::cbrt(static_cast<double>(n))));
+	while (side*side*side < n) side++;
+	const std::size_t stride[3] = { 1, side, side*side };
+
+	std::vector<EntityType> bodies(n);
+	std::vector<bool> isParticle(n);
+	for (std::size_t i = 0; i < n; i++) {
+		const Eigen::Vector3d position = spacing*Eigen::Vector3d(double(i % side), double((i / side) % side), double(i / (side*side)));
+
+		// Particles are spread evenly over the grid
+		const double f = benchmarkCase.particleFraction;
+		isParticle[i] = std::floor((i + 1)*f) > std::floor(i*f);
+		bodies[i] = isParticle[i] ? EntityFactory::createParticle(ecs, mass, position)
+								  : EntityFactory::createCuboid(ecs, mass, Eigen::Vector3d(edgeLength, edgeLength, edgeLength), position);
+	}
+
+	// Springs to the next body along the grid axes, attached off center to cuboids so that they also exert torques
+	const Joint::DampedSpring spring{ spacing, 50.0, 0.5 };
+	const Eigen::Vector3d offset(0.1, 0.1, 0.1);
+	std::size_t springCount = 0;
+	for (std::size_t i = 0; i < n; i++) {
+		const std::size_t coordinates[3] = { i % side, (i / side) % side, i / (side*side) };
+		for (std::size_t axis = 0; axis < benchmarkCase.springsPerBody && axis < 3; axis++) {
+			const std::size_t neighbour = i + stride[axis];
+			if (coordinates[axis] + 1 >= side || neighbour >= n) continue;
+
+			EntityFactory::createSpring(ecs,
+										bodies[i], isParticle[i] ? Eigen::Vector3d::Zero() : offset,
+										bodies[neighbour], isParticle[neighbour] ? Eigen::Vector3d::Zero() : offset,
+										spring);
+			springCount++;
+		}
+	}
+
+	return springCount;
+}
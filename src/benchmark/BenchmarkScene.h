@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "EntityComponentSystem.h"
+
+//! Parameters of a single scene of the scaling benchmark.
+struct BenchmarkCase
+{
+	//! Total number of particles and cuboids.
+	std::size_t bodyCount = 1000;
+	//! Number of springs per body, connecting it to its neighbours along the first 'springsPerBody' grid axes (0 to 3).
+	std::size_t springsPerBody = 1;
+	//! Fraction of the bodies that are particles (translational only), the others are cuboids.
+	double particleFraction = 0.0;
+	//! Total number of threads of the worker pool.
+	std::size_t threadCount = 1;
+
+	//! Returns a name in the style of parameterized benchmarks, e.g. "computeTimestep/bodies:1000/springs:1/particles:0.5/threads:4".
+	std::string name() const;
+};
+
+//! Deterministic scenes for the scaling benchmark, built through the EntityFactory.
+/*
+ * The bodies are placed on a cubic grid with a spacing larger than their size, so no contacts are created
+ * and the step time is dominated by the joint forces, the integration and the collision broad-phase. The
+ * scene does not depend on any random numbers, so every run simulates exactly the same state.
+ */
+class BenchmarkScene
+{
+public:
+	//! Creates the bodies and springs of the case, returns the number of created springs.
+	static std::size_t build(EntityComponentSystem& ecs, const BenchmarkCase& benchmarkCase);
+};
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EntityComponentSystem.h"
+#include "AnimationSystem.h"
+
+#include "BenchmarkScene.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	//! Options of the sweep, every combination of the listed values is one benchmark case.
+	struct Options
+	{
+		std::vector<std::size_t> bodyCounts = { 100, 1000, 10000, 100000, 1000000 };
+		std::vector<std::size_t> springsPerBody = { 0, 3 };
+		std::vector<double> particleFractions = { 0.0, 0.5, 1.0 };
+		std::vector<std::size_t> threadCounts;
+
+		double dt = 0.005;
+		std::size_t warmupSteps = 3;
+		//! Every case is repeated until both the minimum time and the minimum number of steps are reached.
+		double minTime = 0.5;
+		std::size_t minSteps = 10;
+		std::size_t maxSteps = 100000;
+
+		std::string output;
+	};
+
+	struct Result
+	{
+		BenchmarkCase benchmarkCase;
+		std::size_t springCount = 0;
+		std::size_t stepCount = 0;
+		double setupTime = 0.0;
+		double realTime = 0.0;
+		double cpuTime = 0.0;
+		//! Sorted durations of the individual steps.
+		std::vector<double> stepTimes;
+	};
+
+	template <typename T>
+	bool parseList(const std::string& text, std::vector<T>& values)
+	{
+		values.clear();
+		std::istringstream stream(text);
+		std::string item;
+		while (std::getline(stream, item, ',')) {
+			std::istringstream itemStream(item);
+			T value;
+			if (!(itemStream >> value)) return false;
+			values.push_back(value);
+		}
+		return !values.empty();
+	}
+
+	template <typename T>
+	bool parseValue(const std::string& text, T& value)
+	{
+		std::istringstream stream(text);
+		return static_cast<bool>(stream >> value);
+	}
+
+	bool parseOptions(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			const std::string argument = argv[i];
+			const auto separator = argument.find('=');
+			if (argument.compare(0, 2, "--") != 0 || separator == std::string::npos) return false;
+
+			const std::string key = argument.substr(2, separator - 2);
+			const std::string value = argument.substr(separator + 1);
+			bool valid = false;
+			if (key == "bodies") valid = parseList(value, options.bodyCounts);
+			else if (key == "springs") valid = parseList(value, options.springsPerBody);
+			else if (key == "particles") valid = parseList(value, options.particleFractions);
+			else if (key == "threads") valid = parseList(value, options.threadCounts);
+			else if (key == "dt") valid = parseValue(value, options.dt);
+			else if (key == "warmup") valid = parseValue(value, options.warmupSteps);
+			else if (key == "min-time") valid = parseValue(value, options.minTime);
+			else if (key == "min-steps") valid = parseValue(value, options.minSteps);
+			else if (key == "max-steps") valid = parseValue(value, options.maxSteps);
+			else if (key == "out") { options.output = value; valid = true; }
+			if (!valid) return false;
+		}
+
+		// By default a single thread and all hardware threads are compared
+		if (options.threadCounts.empty()) {
+			const std::size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+			options.threadCounts = { 1 };
+			if (hardwareThreads > 1) options.threadCounts.push_back(hardwareThreads);
+		}
+		options.maxSteps = std::max(options.maxSteps, options.minSteps);
+		return true;
+	}
+
+	double processCpuTime()
+	{
+		return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+	}
+
+	Result run(const BenchmarkCase& benchmarkCase, const Options& options)
+	{
+		Result result;
+		result.benchmarkCase = benchmarkCase;
+
+		EntityComponentSystem ecs;
+		ecs.workerPool().setThreadCount(benchmarkCase.threadCount);
+		AnimationSystem animationSystem(ecs);
+		animationSystem.setStateStorage(AnimationSystem::StateStorage::StructureOfArrays);
+
+		const auto setupStart = Clock::now();
+		result.springCount = BenchmarkScene::build(ecs, benchmarkCase);
+		animationSystem.initialize();
+		result.setupTime = std::chrono::duration<double>(Clock::now() - setupStart).count();
+
+		// The first steps allocate the scratch buffers of the integrator, broad-phase and solver
+		for (std::size_t i = 0; i < options.warmupSteps; i++) animationSystem.computeTimestep(options.dt);
+
+		result.stepTimes.reserve(options.maxSteps);
+		const double cpuStart = processCpuTime();
+		const auto runStart = Clock::now();
+		auto stepStart = runStart;
+		while (result.stepTimes.size() < options.maxSteps) {
+			animationSystem.computeTimestep(options.dt);
+
+			const auto stepEnd = Clock::now();
+			result.stepTimes.push_back(std::chrono::duration<double>(stepEnd - stepStart).count());
+			stepStart = stepEnd;
+
+			const double elapsed = std::chrono::duration<double>(stepEnd - runStart).count();
+			if (elapsed >= options.minTime && result.stepTimes.size() >= options.minSteps) break;
+		}
+		result.realTime = std::chrono::duration<double>(Clock::now() - runStart).count();
+		result.cpuTime = processCpuTime() - cpuStart;
+		result.stepCount = result.stepTimes.size();
+
+		std::sort(result.stepTimes.begin(), result.stepTimes.end());
+		ecs.reset();
+		return result;
+	}
+
+	double quantile(const std::vector<double>& sortedValues, double q)
+	{
+		if (sortedValues.empty()) return 0.0;
+		return sortedValues[static_cast<std::size_t>(q*(sortedValues.size() - 1) + 0.5)];
+	}
+
+	//! Writes the results in the JSON layout of Google Benchmark, the sweep parameters are written as counters.
+	void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results)
+	{
+		const std::time_t now = std::time(nullptr);
+		char date[64];
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		out << "{\n";
+		out << "  \"context\": {\n";
+		out << "    \"date\": \"" << date << "\",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\",\n";
+#else
+		out << "    \"library_build_type\": \"debug\",\n";
+#endif
+		out << "    \"dt\": " << options.dt << ",\n";
+		out << "    \"warmup_steps\": " << options.warmupSteps << ",\n";
+		out << "    \"min_time\": " << options.minTime << "\n";
+		out << "  },\n";
+		out << "  \"benchmarks\": [";
+
+		for (std::size_t i = 0; i < results.size(); i++) {
+			const auto& r = results[i];
+			const auto& c = r.benchmarkCase;
+			const double stepNs = 1e9*r.realTime / r.stepCount;
+			const std::size_t particleCount = static_cast<std::size_t>(c.bodyCount*c.particleFraction);
+
+			out << (i == 0 ? "\n" : ",\n");
+			out << "    {\n";
+			out << "      \"name\": \"" << c.name() << "\",\n";
+			out << "      \"run_name\": \"" << c.name() << "\",\n";
+			out << "      \"run_type\": \"iteration\",\n";
+			out << "      \"iterations\": " << r.stepCount << ",\n";
+			out << "      \"real_time\": " << stepNs << ",\n";
+			out << "      \"cpu_time\": " << 1e9*r.cpuTime / r.stepCount << ",\n";
+			out << "      \"time_unit\": \"ns\",\n";
+			out << "      \"ns_per_body_step\": " << stepNs / c.bodyCount << ",\n";
+			out << "      \"step_min_ns\": " << 1e9*r.stepTimes.front() << ",\n";
+			out << "      \"step_p50_ns\": " << 1e9*quantile(r.stepTimes, 0.5) << ",\n";
+			out << "      \"step_p99_ns\": " << 1e9*quantile(r.stepTimes, 0.99) << ",\n";
+			out << "      \"step_max_ns\": " << 1e9*r.stepTimes.back() << ",\n";
+			out << "      \"setup_time_ns\": " << 1e9*r.setupTime << ",\n";
+			out << "      \"bodies\": " << c.bodyCount << ",\n";
+			out << "      \"particles\": " << particleCount << ",\n";
+			out << "      \"cuboids\": " << c.bodyCount - particleCount << ",\n";
+			out << "      \"springs\": " << r.springCount << ",\n";
+			out << "      \"threads\": " << c.threadCount << "\n";
+			out << "    }";
+		}
+
+		out << "\n  ]\n";
+		out << "}\n";
+	}
+}
+
+//! Measures the throughput of AnimationSystem::computeTimestep for a sweep of scene sizes and thread counts.
+/*
+ * Usage: phyani_benchmark [--bodies=100,1000] [--springs=0,3] [--particles=0,0.5,1] [--threads=1,8]
+ *                         [--dt=0.005] [--warmup=3] [--min-time=0.5] [--min-steps=10] [--max-steps=100000] [--out=results.json]
+ * The results are written as JSON to the output file or to stdout, the progress is reported on stderr.
+ */
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [--bodies=N,...] [--springs=N,...] [--particles=F,...] [--threads=N,...]"
+				  << " [--dt=S] [--warmup=N] [--min-time=S] [--min-steps=N] [--max-steps=N] [--out=FILE]" << "\n";
+		return 2;
+	}
+
+	std::vector<Result> results;
+	for (const auto bodyCount : options.bodyCounts) {
+		for (const auto springsPerBody : options.springsPerBody) {
+			for (const auto particleFraction : options.particleFractions) {
+				for (const auto threadCount : options.threadCounts) {
+					BenchmarkCase benchmarkCase;
+					benchmarkCase.bodyCount = bodyCount;
+					benchmarkCase.springsPerBody = springsPerBody;
+					benchmarkCase.particleFraction = std::min(std::max(particleFraction, 0.0), 1.0);
+					benchmarkCase.threadCount = std::max<std::size_t>(threadCount, 1);
+
+					results.push_back(run(benchmarkCase, options));
+
+					const auto& r = results.back();
+					std::cerr << "(benchmark) " << benchmarkCase.name() << ": "
+							  << 1e9*r.realTime / r.stepCount / bodyCount << " ns per body step, "
+							  << r.stepCount << " steps" << "\n";
+				}
+			}
+		}
+	}
+
+	if (options.output.empty()) {
+		writeJson(std::cout, options, results);
+	} else {
+		std::ofstream file(options.output);
+		writeJson(file, options, results);
+		if (!file) {
+			std::cerr << "(benchmark) Cannot write '" << options.output << "'" << "\n";
+			return 1;
+		}
+	}
+
+	return 0;
+}
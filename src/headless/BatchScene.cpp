@@ -0,0 +1,181 @@
+#include "BatchScene.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "EntityFactory.h"
+
+namespace
+{
+	std::string trim(const std::string& text)
+	{
+		const auto first = text.find_first_not_of(" \t\r");
+		if (first == std::string::npos) return std::string();
+		const auto last = text.find_last_not_of(" \t\r");
+		return text.substr(first, last - first + 1);
+	}
+
+	//! Reads exactly the specified values from the text, returns false on malformed or surplus input.
+	template <typename... ValueTs>
+	bool readValues(const std::string& text, ValueTs&... values)
+	{
+		std::istringstream stream(text);
+		(stream >> ... >> values);
+		return !stream.fail() && (stream >> std::ws).eof();
+	}
+
+	bool readBool(const std::string& text, bool& value)
+	{
+		if (text == "true" || text == "1") value = true;
+		else if (text == "false" || text == "0") value = false;
+		else return false;
+		return true;
+	}
+
+	bool readIntegrationScheme(const std::string& text, IntegrationScheme& scheme)
+	{
+		if (text == "symplectic_euler") scheme = IntegrationScheme::SymplecticEuler;
+		else if (text == "velocity_verlet") scheme = IntegrationScheme::VelocityVerlet;
+		else if (text == "runge_kutta4") scheme = IntegrationScheme::RungeKutta4;
+		else if (text == "implicit_euler") scheme = IntegrationScheme::ImplicitEuler;
+		else return false;
+		return true;
+	}
+
+	bool readStateStorage(const std::string& text, AnimationSystem::StateStorage& storage)
+	{
+		if (text == "registry") storage = AnimationSystem::StateStorage::Registry;
+		else if (text == "soa") storage = AnimationSystem::StateStorage::StructureOfArrays;
+		else return false;
+		return true;
+	}
+}
+
+bool BatchScene::loadParameters(const std::string& path, BatchParameters& parameters, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file) {
+		error = "Cannot open parameter file '" + path + "'";
+		return false;
+	}
+
+	std::string line;
+	for (std::size_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+		line = trim(line);
+		if (line.empty() || line[0] == '#') continue;
+
+		if (!parseAssignment(line, parameters, error)) {
+			error = path + ":" + std::to_string(lineNumber) + ": " + error;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool BatchScene::parseAssignment(const std::string& assignment, BatchParameters& parameters, std::string& error)
+{
+	const auto separator = assignment.find('=');
+	if (separator == std::string::npos) {
+		error = "Expected 'key = value' instead of '" + assignment + "'";
+		return false;
+	}
+
+	const std::string key = trim(assignment.substr(0, separator));
+	const std::string value = trim(assignment.substr(separator + 1));
+	auto& p = parameters;
+
+	bool valid = false;
+	if (key == "lattice_size") valid = readValues(value, p.latticeSize[0], p.latticeSize[1], p.latticeSize[2]);
+	else if (key == "spacing") valid = readValues(value, p.spacing);
+	else if (key == "cube_mass") valid = readValues(value, p.cubeMass);
+	else if (key == "cube_edge_length") valid = readValues(value, p.cubeEdgeLength);
+	else if (key == "spring_elasticity") valid = readValues(value, p.springElasticity);
+	else if (key == "spring_damping") valid = readValues(value, p.springDamping);
+	else if (key == "anchor_top_layer") valid = readBool(value, p.anchorTopLayer);
+	else if (key == "stack_height") valid = readValues(value, p.stackHeight);
+	else if (key == "step_count") valid = readValues(value, p.stepCount);
+	else if (key == "dt") valid = readValues(value, p.dt) && p.dt > 0.0;
+	else if (key == "integration_scheme") valid = readIntegrationScheme(value, p.integrationScheme);
+	else if (key == "substep_count") valid = readValues(value, p.substepCount) && p.substepCount > 0;
+	else if (key == "thread_count") valid = readValues(value, p.threadCount);
+	else if (key == "state_storage") valid = readStateStorage(value, p.stateStorage);
+	else if (key == "parallel_joint_forces") valid = readBool(value, p.parallelJointForces);
+	else if (key == "require_zero_allocations") valid = readBool(value, p.requireZeroAllocations);
+	else if (key == "allocation_warmup_steps") valid = readValues(value, p.allocationWarmupSteps);
+	else if (key == "require_sleeping_after") valid = readValues(value, p.requireSleepingAfter) && p.requireSleepingAfter >= 0.0;
+	else if (key == "verify_thread_count") valid = readValues(value, p.verifyThreadCount);
+	else if (key == "verify_serial_joint_forces") valid = readBool(value, p.verifySerialJointForces);
+	else if (key == "verify_rotation_kernels") valid = readBool(value, p.verifyRotationKernels);
+	else if (key == "state_output") { p.stateOutput = value; valid = true; }
+	else if (key == "snapshot_output") { p.snapshotOutput = value; valid = true; }
+	else if (key == "trajectory_output") { p.trajectoryOutput = value; valid = true; }
+	else if (key == "trace_output") { p.traceOutput = value; valid = true; }
+	else if (key == "trajectory_step_interval") valid = readValues(value, p.trajectoryStepInterval) && p.trajectoryStepInterval > 0;
+	else {
+		error = "Unknown parameter '" + key + "'";
+		return false;
+	}
+
+	if (!valid) error = "Invalid value '" + value + "' for parameter '" + key + "'";
+	return valid;
+}
+
+void BatchScene::build(EntityComponentSystem& ecs, const BatchParameters& parameters)
+{
+	if (parameters.stackHeight > 0) {
+		buildStack(ecs, parameters);
+		return;
+	}
+
+	const auto& size = parameters.latticeSize;
+	const auto index = [&](std::size_t x, std::size_t y, std::size_t z) { return (z*size[1] + y)*size[0] + x; };
+
+	// The lattice is centered horizontally and hangs below the origin
+	const Eigen::Vector3d origin(-0.5*parameters.spacing*(size[0] - 1), 0.0, -0.5*parameters.spacing*(size[2] - 1));
+
+	std::vector<EntityType> cubes(size[0]*size[1]*size[2]);
+	for (std::size_t z = 0; z < size[2]; z++) {
+		for (std::size_t y = 0; y < size[1]; y++) {
+			for (std::size_t x = 0; x < size[0]; x++) {
+				const bool anchored = parameters.anchorTopLayer && y == 0;
+				const Eigen::Vector3d center = origin + parameters.spacing*Eigen::Vector3d(double(x), -double(y), double(z));
+				cubes[index(x, y, z)] = EntityFactory::createCube(ecs, anchored ? 0.0 : parameters.cubeMass, parameters.cubeEdgeLength, center);
+			}
+		}
+	}
+
+	// Springs are attached to the faces of the cubes pointing to the respective neighbour
+	const Joint::DampedSpring spring{ parameters.spacing - parameters.cubeEdgeLength, parameters.springElasticity, parameters.springDamping };
+	const double halfEdge = 0.5*parameters.cubeEdgeLength;
+	for (std::size_t z = 0; z < size[2]; z++) {
+		for (std::size_t y = 0; y < size[1]; y++) {
+			for (std::size_t x = 0; x < size[0]; x++) {
+				const auto cube = cubes[index(x, y, z)];
+				if (x + 1 < size[0]) {
+					EntityFactory::createSpring(ecs, cube, Eigen::Vector3d(halfEdge, 0, 0), cubes[index(x + 1, y, z)], Eigen::Vector3d(-halfEdge, 0, 0), spring);
+				}
+				if (y + 1 < size[1]) {
+					EntityFactory::createSpring(ecs, cube, Eigen::Vector3d(0, -halfEdge, 0), cubes[index(x, y + 1, z)], Eigen::Vector3d(0, halfEdge, 0), spring);
+				}
+				if (z + 1 < size[2]) {
+					EntityFactory::createSpring(ecs, cube, Eigen::Vector3d(0, 0, halfEdge), cubes[index(x, y, z + 1)], Eigen::Vector3d(0, 0, -halfEdge), spring);
+				}
+			}
+		}
+	}
+}
+
+void BatchScene::buildStack(EntityComponentSystem& ecs, const BatchParameters& parameters)
+{
+	// The top face of the ground is at y = 0, the cubes start slightly apart and settle onto each other
+	const double edge = parameters.cubeEdgeLength;
+	const double gap = 0.01*edge;
+	EntityFactory::createCuboid(ecs, 0.0, Eigen::Vector3d(10*edge, edge, 10*edge), Eigen::Vector3d(0, -0.5*edge, 0));
+	for (std::size_t i = 0; i < parameters.stackHeight; i++) {
+		const Eigen::Vector3d center(0, (i + 0.5)*edge + (i + 1)*gap, 0);
+		EntityFactory::createCube(ecs, parameters.cubeMass, edge, center);
+	}
+}
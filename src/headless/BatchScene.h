@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+#include "EntityComponentSystem.h"
+#include "AnimationSystem.h"
+
+//! Parameters of a headless batch simulation run.
+struct BatchParameters
+{
+	// Scene: lattice of cuboids connected to their axis neighbours by damped springs
+	std::array<std::size_t, 3> latticeSize = {{ 8, 8, 8 }};
+	double spacing = 1.5;
+	double cubeMass = 1.0;
+	double cubeEdgeLength = 1.0;
+	double springElasticity = 200.0;
+	double springDamping = 2.0;
+	//! The top layer of the lattice is static (massless), so that the lattice hangs from it.
+	bool anchorTopLayer = true;
+	//! Replaces the lattice by a stack of this many cubes resting on a static ground, zero selects the lattice.
+	std::size_t stackHeight = 0;
+
+	// Simulation
+	std::size_t stepCount = 1000;
+	double dt = 1.0 / 120.0;
+	IntegrationScheme integrationScheme = IntegrationScheme::SymplecticEuler;
+	std::size_t substepCount = 1;
+	//! Total number of threads of the worker pool, zero selects the number of hardware threads.
+	std::size_t threadCount = 0;
+	AnimationSystem::StateStorage stateStorage = AnimationSystem::StateStorage::StructureOfArrays;
+	//! Accumulates the joint forces in parallel, see AnimationSystem::setParallelJointForces().
+	bool parallelJointForces = true;
+
+	// Allocation check, requires a build with PHYANI_ALLOCATION_TRACKING (see AllocationTracker)
+	//! Fails the run if any step after the warm-up steps allocates memory.
+	bool requireZeroAllocations = false;
+	//! Number of initial steps that may allocate, e.g. to grow buffers to their steady-state size.
+	std::size_t allocationWarmupSteps = 10;
+
+	// Sleeping check
+	//! Fails the run if any island is awake after this simulated time in seconds, zero disables the check.
+	double requireSleepingAfter = 0.0;
+
+	// Determinism check
+	//! Repeats the run with this total number of threads and fails if the final states are not bit-identical, zero disables the check.
+	std::size_t verifyThreadCount = 0;
+	//! Repeats the run with serial accumulation of the joint forces and fails if the final states are not bit-identical.
+	bool verifySerialJointForces = false;
+	//! Compares the rotation kernels of all supported instruction sets with each other and with Eigen, see RotationKernelCheck.
+	bool verifyRotationKernels = false;
+
+	// Output, empty paths disable the respective output
+	//! Text file with the final position and velocity of every body.
+	std::string stateOutput;
+	//! Binary snapshot of the final state, see Snapshot.
+	std::string snapshotOutput;
+	//! Trajectory file of the run, see TrajectoryRecorder.
+	std::string trajectoryOutput;
+	std::size_t trajectoryStepInterval = 1;
+	//! Chrome trace JSON of the zones of all threads, enables tracing for the run, see Trace.
+	std::string traceOutput;
+};
+
+//! Reads the parameters of batch runs and creates their scenes.
+/*
+ * Parameter files contain one 'key = value' assignment per line, empty lines and lines starting with '#'
+ * are ignored. The keys correspond to the members of BatchParameters in snake case, e.g.
+ * 'lattice_size = 8 8 8' or 'integration_scheme = velocity_verlet'.
+ */
+class BatchScene
+{
+public:
+	//! Applies all assignments of the file, returns false and sets 'error' if the file cannot be read or contains an invalid assignment.
+	static bool loadParameters(const std::string& path, BatchParameters& parameters, std::string& error);
+	//! Applies a single 'key = value' assignment, returns false and sets 'error' on unknown keys or malformed values.
+	static bool parseAssignment(const std::string& assignment, BatchParameters& parameters, std::string& error);
+
+	//! Creates the entities of the scene in the registry.
+	static void build(EntityComponentSystem& ecs, const BatchParameters& parameters);
+
+private:
+	static void buildStack(EntityComponentSystem& ecs, const BatchParameters& parameters);
+};
@@ -0,0 +1,190 @@
+#include "RotationKernelCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+	using InstructionSet = RotationKernels::InstructionSet;
+
+	//! Inputs of the kernels, the kernels work in place, so the arrays are copied for every instruction set.
+	struct Bodies
+	{
+		double dt = 1.0 / 120.0;
+		std::vector<Eigen::Vector3d> angularVelocity;
+		std::vector<std::uint8_t> sleeping;
+		std::vector<Eigen::Quaterniond> rotation;
+		std::vector<Eigen::Vector3d> principalInertia;
+	};
+
+	//! Results of the kernels in the order of a timestep, every kernel uses the results of the previous one.
+	struct Results
+	{
+		std::vector<Eigen::Quaterniond> integratedRotation;
+		std::vector<Eigen::Quaterniond> normalizedRotation;
+		std::vector<Eigen::Matrix3d> rotationMatrix;
+		std::vector<Eigen::Matrix3d> inertiaMatrix;
+		std::vector<Eigen::Matrix3d> inverseInertiaMatrix;
+	};
+
+	Bodies createBodies(std::size_t count)
+	{
+		std::mt19937_64 random(42);
+		std::uniform_real_distribution<double> unit(-1.0, 1.0);
+		std::uniform_real_distribution<double> scale(0.5, 2.0);
+		std::uniform_real_distribution<double> logInertia(std::log(0.01), std::log(100.0));
+		std::uniform_int_distribution<int> percent(0, 99);
+
+		Bodies bodies;
+		for (std::size_t i = 0; i < count; i++) {
+			bodies.angularVelocity.push_back(20.0*Eigen::Vector3d(unit(random), unit(random), unit(random)));
+			bodies.sleeping.push_back(percent(random) < 10 ? 1 : 0);
+
+			// Unnormalized quaternions as after an integration step
+			const double s = scale(random);
+			bodies.rotation.emplace_back(s*unit(random), s*unit(random), s*unit(random), s*unit(random));
+
+			// Anisotropic inertias, some bodies have no inertia and keep their matrices
+			const bool massless = percent(random) < 10;
+			bodies.principalInertia.push_back(massless ? Eigen::Vector3d::Zero().eval()
+				: Eigen::Vector3d(std::exp(logInertia(random)), std::exp(logInertia(random)), std::exp(logInertia(random))));
+		}
+		return bodies;
+	}
+
+	Results runKernels(const Bodies& bodies)
+	{
+		const std::size_t count = bodies.rotation.size();
+
+		Results results;
+		results.integratedRotation = bodies.rotation;
+		RotationKernels::integrateRotations(count, bodies.dt, bodies.angularVelocity.data(), bodies.sleeping.data(),
+											results.integratedRotation.data());
+
+		results.normalizedRotation = results.integratedRotation;
+		results.rotationMatrix.assign(count, Eigen::Matrix3d::Zero());
+		RotationKernels::updateRotationMatrices(count, results.normalizedRotation.data(), results.rotationMatrix.data());
+
+		results.inertiaMatrix.assign(count, Eigen::Matrix3d::Zero());
+		results.inverseInertiaMatrix.assign(count, Eigen::Matrix3d::Zero());
+		RotationKernels::updateInertiaMatrices(count, bodies.principalInertia.data(), results.rotationMatrix.data(),
+											   results.inertiaMatrix.data(), results.inverseInertiaMatrix.data());
+		return results;
+	}
+
+	template <typename T>
+	bool bitIdentical(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0;
+	}
+
+	bool bitIdentical(const Results& a, const Results& b)
+	{
+		return bitIdentical(a.integratedRotation, b.integratedRotation) && bitIdentical(a.normalizedRotation, b.normalizedRotation)
+			&& bitIdentical(a.rotationMatrix, b.rotationMatrix) && bitIdentical(a.inertiaMatrix, b.inertiaMatrix)
+			&& bitIdentical(a.inverseInertiaMatrix, b.inverseInertiaMatrix);
+	}
+
+	//! Returns the largest absolute difference of the coefficients relative to the largest coefficient of the reference.
+	template <typename DerivedT>
+	double deviation(const Eigen::MatrixBase<DerivedT>& value, const Eigen::MatrixBase<DerivedT>& reference)
+	{
+		const double scale = reference.cwiseAbs().maxCoeff();
+		const double difference = (value - reference).cwiseAbs().maxCoeff();
+		return (scale > 0.0) ? difference / scale : difference;
+	}
+
+	//! Compares the results of the kernels with the Eigen expressions evaluated on the same inputs.
+	void compareWithEigen(const Bodies& bodies, const Results& results, RotationKernelCheck::Result& result)
+	{
+		for (std::size_t i = 0; i < bodies.rotation.size(); i++) {
+			// Quaternion integration q += dt*0.5*(0, w)*q
+			const auto& q = bodies.rotation[i];
+			Eigen::Quaterniond integrated = q;
+			if (!bodies.sleeping[i]) {
+				const Eigen::Vector3d h = 0.5*bodies.angularVelocity[i];
+				const Eigen::Quaterniond change = Eigen::Quaterniond(0, h.x(), h.y(), h.z())*q;
+				integrated = Eigen::Quaterniond(q.w() + bodies.dt*change.w(), q.x() + bodies.dt*change.x(),
+												q.y() + bodies.dt*change.y(), q.z() + bodies.dt*change.z());
+			}
+			result.integratedRotationDeviation = std::max(result.integratedRotationDeviation,
+				deviation(results.integratedRotation[i].coeffs(), integrated.coeffs()));
+
+			// Normalization and rotation matrix of the integrated quaternion of the kernel
+			const Eigen::Quaterniond normalized = results.integratedRotation[i].normalized();
+			result.normalizedRotationDeviation = std::max(result.normalizedRotationDeviation,
+				deviation(results.normalizedRotation[i].coeffs(), normalized.coeffs()));
+			const Eigen::Matrix3d rotationMatrix = results.normalizedRotation[i].matrix();
+			result.rotationMatrixDeviation = std::max(result.rotationMatrixDeviation,
+				deviation(results.rotationMatrix[i], rotationMatrix));
+
+			// Inertia matrices of the rotation matrix of the kernel, bodies without inertia are not written
+			const auto& inertia = bodies.principalInertia[i];
+			const auto& r = results.rotationMatrix[i];
+			Eigen::Matrix3d inertiaMatrix = Eigen::Matrix3d::Zero();
+			Eigen::Matrix3d inverseInertiaMatrix = Eigen::Matrix3d::Zero();
+			if (inertia.sum() > 0) {
+				inertiaMatrix = (r*inertia.asDiagonal())*r.transpose();
+				inverseInertiaMatrix = (r*inertia.cwiseInverse().asDiagonal())*r.transpose();
+			}
+			result.inertiaMatrixDeviation = std::max({ result.inertiaMatrixDeviation,
+				deviation(results.inertiaMatrix[i], inertiaMatrix), deviation(results.inverseInertiaMatrix[i], inverseInertiaMatrix) });
+		}
+	}
+
+	const char* parameterName(InstructionSet instructionSet)
+	{
+		switch (instructionSet) {
+		case InstructionSet::Scalar: return "scalar";
+		case InstructionSet::Sse2: return "sse2";
+		case InstructionSet::Avx2: return "avx2";
+		case InstructionSet::Avx512: return "avx512";
+		}
+		return "unknown";
+	}
+}
+
+double RotationKernelCheck::Result::maxDeviation() const
+{
+	return std::max({ integratedRotationDeviation, normalizedRotationDeviation, rotationMatrixDeviation, inertiaMatrixDeviation });
+}
+
+bool RotationKernelCheck::Result::passed() const
+{
+	return identical && maxDeviation() <= tolerance;
+}
+
+RotationKernelCheck::Result RotationKernelCheck::run(std::size_t bodyCount, std::ostream& log)
+{
+	const auto previousInstructionSet = RotationKernels::instructionSet();
+	const Bodies bodies = createBodies(bodyCount);
+
+	Result result;
+	Results scalarResults;
+	for (auto instructionSet : { InstructionSet::Scalar, InstructionSet::Sse2, InstructionSet::Avx2, InstructionSet::Avx512 }) {
+		// Unsupported instruction sets fall back to the best supported one
+		RotationKernels::setInstructionSet(instructionSet);
+		if (RotationKernels::instructionSet() != instructionSet) {
+			log << "rotation_kernels_" << parameterName(instructionSet) << ": unsupported" << "\n";
+			continue;
+		}
+
+		const Results results = runKernels(bodies);
+		result.instructionSetCount++;
+		if (instructionSet == InstructionSet::Scalar) {
+			compareWithEigen(bodies, results, result);
+			scalarResults = results;
+			log << "rotation_kernels_" << parameterName(instructionSet) << ": reference" << "\n";
+		} else {
+			const bool identical = bitIdentical(results, scalarResults);
+			result.identical &= identical;
+			log << "rotation_kernels_" << parameterName(instructionSet) << ": " << (identical ? "identical" : "different") << "\n";
+		}
+	}
+
+	RotationKernels::setInstructionSet(previousInstructionSet);
+	return result;
+}
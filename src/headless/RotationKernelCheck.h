@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+
+#include "RotationKernels.h"
+
+//! Compares the RotationKernels of all supported instruction sets with each other and with the Eigen expressions they replace.
+/*
+ * Every kernel is run with every instruction set that is compiled in and supported by the CPU on the same
+ * random bodies (unnormalized quaternions, anisotropic principal inertias, sleeping and massless bodies).
+ * The results of all instruction sets have to be bit-identical to the scalar variant. The deviation from
+ * the per body Eigen expressions is measured relative to the largest coefficient of the respective
+ * quaternion or matrix and has to stay below 'tolerance'.
+ */
+class RotationKernelCheck
+{
+public:
+	//! Bound of the deviation from the Eigen expressions relative to the largest coefficient, about 4.5 ulp of the coefficient.
+	static constexpr double tolerance = 1e-15;
+
+	struct Result
+	{
+		//! Number of instruction sets that were compared, including the scalar variant.
+		std::size_t instructionSetCount = 0;
+		//! Set if all instruction sets produced results that are bit-identical to the scalar variant.
+		bool identical = true;
+
+		//! Largest relative deviations from the Eigen expressions.
+		double integratedRotationDeviation = 0.0;
+		double normalizedRotationDeviation = 0.0;
+		double rotationMatrixDeviation = 0.0;
+		double inertiaMatrixDeviation = 0.0;
+
+		double maxDeviation() const;
+		bool passed() const;
+	};
+
+	//! Runs the comparison for the specified number of random bodies and writes one line per instruction set to 'log'.
+	/*
+	 * The instruction set selected before the check is restored afterwards.
+	 */
+	static Result run(std::size_t bodyCount, std::ostream& log);
+};
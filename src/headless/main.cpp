@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EntityComponentSystem.h"
+#include "AllocationTracker.h"
+#include "AnimationSystem.h"
+#include "Trace.h"
+#include "Trajectory.h"
+
+#include "BatchScene.h"
+#include "RotationKernelCheck.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	double secondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Returns the value at the specified quantile of the sorted values.
+	double quantile(const std::vector<double>& sortedValues, double q)
+	{
+		if (sortedValues.empty()) return 0.0;
+		const auto index = static_cast<std::size_t>(q*(sortedValues.size() - 1) + 0.5);
+		return sortedValues[index];
+	}
+
+	//! Writes one line per body with its entity, position, rotation and velocities.
+	bool writeState(EntityComponentSystem& ecs, const std::string& path)
+	{
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file << std::setprecision(17);
+		file << "# entity px py pz qw qx qy qz vx vy vz wx wy wz\n";
+		for (auto entity : ecs.view<TranslationalAnimatedBody>()) {
+			const auto& translational = ecs.get<TranslationalAnimatedBody>(entity).state;
+
+			RotationalState rotational;
+			if (ecs.has<RotationalAnimatedBody>(entity)) rotational = ecs.get<RotationalAnimatedBody>(entity).state;
+
+			const auto& p = translational.position;
+			const auto& q = rotational.rotation;
+			const auto& v = translational.linearVelocity;
+			const auto& w = rotational.angularVelocity;
+			file << entity << " "
+				 << p[0] << " " << p[1] << " " << p[2] << " "
+				 << q.w() << " " << q.x() << " " << q.y() << " " << q.z() << " "
+				 << v[0] << " " << v[1] << " " << v[2] << " "
+				 << w[0] << " " << w[1] << " " << w[2] << "\n";
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	//! Appends the position, rotation and velocities of every body to 'state' in the order of writeState().
+	void collectState(const EntityComponentSystem& ecs, std::vector<double>& state)
+	{
+		for (auto entity : ecs.view<TranslationalAnimatedBody>()) {
+			const auto& translational = ecs.get<TranslationalAnimatedBody>(entity).state;
+
+			RotationalState rotational;
+			if (ecs.has<RotationalAnimatedBody>(entity)) rotational = ecs.get<RotationalAnimatedBody>(entity).state;
+
+			const auto& q = rotational.rotation;
+			state.insert(state.end(), translational.position.data(), translational.position.data() + 3);
+			state.insert(state.end(), { q.w(), q.x(), q.y(), q.z() });
+			state.insert(state.end(), translational.linearVelocity.data(), translational.linearVelocity.data() + 3);
+			state.insert(state.end(), rotational.angularVelocity.data(), rotational.angularVelocity.data() + 3);
+		}
+	}
+
+	//! Returns the total number of threads of the worker pool for the parameters.
+	std::size_t threadCountOf(const BatchParameters& parameters)
+	{
+		return parameters.threadCount > 0 ? parameters.threadCount : std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	void configure(AnimationSystem& animationSystem, const BatchParameters& parameters)
+	{
+		animationSystem.setIntegrationScheme(parameters.integrationScheme);
+		animationSystem.setSubstepCount(parameters.substepCount);
+		animationSystem.setStateStorage(parameters.stateStorage);
+		animationSystem.setParallelJointForces(parameters.parallelJointForces);
+	}
+
+	//! Simulates the scene of the parameters without any output and collects the final state.
+	void simulateReference(const BatchParameters& parameters, std::vector<double>& state)
+	{
+		EntityComponentSystem ecs;
+		ecs.workerPool().setThreadCount(threadCountOf(parameters));
+
+		AnimationSystem animationSystem(ecs);
+		configure(animationSystem, parameters);
+
+		BatchScene::build(ecs, parameters);
+		animationSystem.initialize();
+		for (std::size_t step = 0; step < parameters.stepCount; step++) animationSystem.computeTimestep(parameters.dt);
+
+		animationSystem.synchronizeRegistry();
+		collectState(ecs, state);
+		ecs.reset();
+	}
+
+	//! Returns whether the state is bit-identical to the final state of a run with the reference parameters.
+	bool matchesReference(const std::vector<double>& state, const BatchParameters& reference)
+	{
+		std::vector<double> referenceState;
+		simulateReference(reference, referenceState);
+		return state.size() == referenceState.size()
+			&& std::memcmp(state.data(), referenceState.data(), state.size()*sizeof(double)) == 0;
+	}
+
+	bool writeBinary(const std::string& path, const std::vector<char>& data)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		return static_cast<bool>(file);
+	}
+}
+
+//! Runs a batch simulation without any window or graphics context, see BatchScene for the parameter file.
+/*
+ * Usage: phyani_headless <parameter file> [key=value ...]
+ * Assignments on the command line override the values of the parameter file.
+ */
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <parameter file> [key=value ...]" << "\n";
+		return 2;
+	}
+
+	BatchParameters parameters;
+	std::string error;
+	bool valid = BatchScene::loadParameters(argv[1], parameters, error);
+	for (int i = 2; valid && i < argc; i++) valid = BatchScene::parseAssignment(argv[i], parameters, error);
+	if (!valid) {
+		std::cerr << "(headless) " << error << "\n";
+		return 2;
+	}
+
+	if (parameters.requireZeroAllocations && !AllocationTracker::isEnabled()) {
+		std::cerr << "(headless) The allocation check requires a build with PHYANI_ALLOCATION_TRACKING" << "\n";
+		return 2;
+	}
+
+	EntityComponentSystem ecs;
+	const std::size_t threadCount = threadCountOf(parameters);
+	ecs.workerPool().setThreadCount(threadCount);
+
+	AnimationSystem animationSystem(ecs);
+	configure(animationSystem, parameters);
+
+	const auto setupStart = Clock::now();
+	BatchScene::build(ecs, parameters);
+	animationSystem.initialize();
+	const double setupTime = secondsSince(setupStart);
+
+	TrajectoryRecorder recorder;
+	if (!parameters.trajectoryOutput.empty()) {
+		TrajectoryRecorder::Settings settings;
+		settings.stepInterval = parameters.trajectoryStepInterval;
+		// Batch runs step much faster than in real time, more frames in flight bridge the polling interval of the writer
+		settings.bufferCount = 256;
+		settings.reservedBodyCount = ecs.view<TranslationalAnimatedBody>().size();
+		if (!recorder.start(parameters.trajectoryOutput, settings)) {
+			std::cerr << "(headless) Cannot create trajectory file '" << parameters.trajectoryOutput << "'" << "\n";
+			return 1;
+		}
+		animationSystem.setTrajectoryRecorder(&recorder);
+	}
+
+	Trace::setThreadName("Simulation");
+	if (!parameters.traceOutput.empty()) Trace::setEnabled(true);
+
+	// The step times are stored in a preallocated buffer to keep the measurement free of allocations
+	std::vector<double> stepTimes(parameters.stepCount);
+	std::uint64_t steadyStateAllocations = 0;
+	std::size_t allocatingSteps = 0;
+	std::size_t firstAllocatingStep = 0;
+	std::size_t awakeSteps = 0;
+	const auto runStart = Clock::now();
+	for (std::size_t step = 0; step < parameters.stepCount; step++) {
+		// Counts the allocations of the step including those of the worker threads
+		AllocationScope stepAllocations;
+
+		const auto stepStart = Clock::now();
+		animationSystem.computeTimestep(parameters.dt);
+		stepTimes[step] = secondsSince(stepStart);
+
+		if (step >= parameters.allocationWarmupSteps && stepAllocations.allocations() > 0) {
+			if (allocatingSteps++ == 0) firstAllocatingStep = step;
+			steadyStateAllocations += stepAllocations.allocations();
+		}
+
+		// Once asleep, the islands must stay asleep, every step with an awake island after the deadline counts
+		const auto& sleepController = animationSystem.sleepController();
+		if (parameters.requireSleepingAfter > 0.0 && animationSystem.time() >= parameters.requireSleepingAfter
+			&& sleepController.sleepingIslandCount() < sleepController.islandCount()) {
+			awakeSteps++;
+		}
+	}
+	const double runTime = secondsSince(runStart);
+
+	animationSystem.setTrajectoryRecorder(nullptr);
+	recorder.stop();
+	Trace::setEnabled(false);
+
+	std::sort(stepTimes.begin(), stepTimes.end());
+	double stepTimeSum = 0.0;
+	for (const double t : stepTimes) stepTimeSum += t;
+
+	std::cout << "bodies: " << ecs.view<TranslationalAnimatedBody>().size() << "\n";
+	std::cout << "joints: " << ecs.view<Joint>().size() << "\n";
+	std::cout << "threads: " << threadCount << "\n";
+	std::cout << "steps: " << parameters.stepCount << "\n";
+	std::cout << "simulated_time_s: " << animationSystem.time() << "\n";
+	std::cout << "setup_time_s: " << setupTime << "\n";
+	std::cout << "run_time_s: " << runTime << "\n";
+	std::cout << "steps_per_s: " << (runTime > 0.0 ? parameters.stepCount / runTime : 0.0) << "\n";
+	if (!stepTimes.empty()) {
+		std::cout << "step_mean_ms: " << 1e3*stepTimeSum / stepTimes.size() << "\n";
+		std::cout << "step_min_ms: " << 1e3*stepTimes.front() << "\n";
+		std::cout << "step_p50_ms: " << 1e3*quantile(stepTimes, 0.5) << "\n";
+		std::cout << "step_p99_ms: " << 1e3*quantile(stepTimes, 0.99) << "\n";
+		std::cout << "step_max_ms: " << 1e3*stepTimes.back() << "\n";
+	}
+	if (AllocationTracker::isEnabled()) {
+		std::cout << "steady_state_allocations: " << steadyStateAllocations << "\n";
+		std::cout << "allocating_steps: " << allocatingSteps << "\n";
+	}
+	if (parameters.requireSleepingAfter > 0.0) {
+		std::cout << "sleeping_islands: " << animationSystem.sleepController().sleepingIslandCount()
+				  << " of " << animationSystem.sleepController().islandCount() << "\n";
+		std::cout << "awake_steps: " << awakeSteps << "\n";
+	}
+	if (!parameters.trajectoryOutput.empty()) {
+		std::cout << "trajectory_frames: " << recorder.recordedFrameCount() << "\n";
+		std::cout << "trajectory_dropped_frames: " << recorder.droppedFrameCount() << "\n";
+	}
+
+	int result = 0;
+	if (parameters.requireZeroAllocations && allocatingSteps > 0) {
+		std::cerr << "(headless) " << allocatingSteps << " steps after the warm-up allocated memory, the first was step " << firstAllocatingStep << "\n";
+		AllocationTracker::writeReport(std::cerr);
+		result = 3;
+	}
+	if (parameters.requireSleepingAfter > 0.0 && (awakeSteps > 0 || animationSystem.time() < parameters.requireSleepingAfter)) {
+		std::cerr << "(headless) " << awakeSteps << " steps after " << parameters.requireSleepingAfter << " s had awake islands" << "\n";
+		result = 5;
+	}
+	const bool verify = parameters.verifyThreadCount > 0 || parameters.verifySerialJointForces;
+	if (!parameters.stateOutput.empty() || !parameters.snapshotOutput.empty() || verify) {
+		// The registry is not up to date in SoA mode
+		animationSystem.synchronizeRegistry();
+
+		if (!parameters.stateOutput.empty() && !writeState(ecs, parameters.stateOutput)) {
+			std::cerr << "(headless) Cannot write state file '" << parameters.stateOutput << "'" << "\n";
+			result = 1;
+		}
+
+		if (!parameters.snapshotOutput.empty()) {
+			std::vector<char> snapshot;
+			animationSystem.saveSnapshot(snapshot);
+			if (!writeBinary(parameters.snapshotOutput, snapshot)) {
+				std::cerr << "(headless) Cannot write snapshot file '" << parameters.snapshotOutput << "'" << "\n";
+				result = 1;
+			}
+		}
+	}
+
+	if (verify) {
+		// The results must neither depend on the number of threads nor on the accumulation of the joint forces,
+		// so the states are compared bit by bit
+		std::vector<double> state;
+		collectState(ecs, state);
+
+		if (parameters.verifyThreadCount > 0) {
+			BatchParameters reference = parameters;
+			reference.threadCount = parameters.verifyThreadCount;
+			const bool identical = matchesReference(state, reference);
+			std::cout << "thread_count_independent: " << (identical ? "true" : "false") << "\n";
+			if (!identical) {
+				std::cerr << "(headless) The final state differs from the run with " << parameters.verifyThreadCount << " threads" << "\n";
+				result = 4;
+			}
+		}
+
+		if (parameters.verifySerialJointForces) {
+			BatchParameters reference = parameters;
+			reference.parallelJointForces = false;
+			const bool identical = matchesReference(state, reference);
+			std::cout << "serial_joint_forces_identical: " << (identical ? "true" : "false") << "\n";
+			if (!identical) {
+				std::cerr << "(headless) The final state differs from the run with serial joint force accumulation" << "\n";
+				result = 4;
+			}
+		}
+	}
+
+	if (parameters.verifyRotationKernels) {
+		// All instruction sets have to be bit-identical and close to the Eigen expressions they replace
+		const auto check = RotationKernelCheck::run(100003, std::cout);
+		std::cout << "rotation_kernels_deviation_integration: " << check.integratedRotationDeviation << "\n";
+		std::cout << "rotation_kernels_deviation_normalization: " << check.normalizedRotationDeviation << "\n";
+		std::cout << "rotation_kernels_deviation_rotation_matrix: " << check.rotationMatrixDeviation << "\n";
+		std::cout << "rotation_kernels_deviation_inertia_matrix: " << check.inertiaMatrixDeviation << "\n";
+		if (!check.passed()) {
+			std::cerr << "(headless) The rotation kernels of the instruction sets differ or deviate by more than "
+					  << RotationKernelCheck::tolerance << " from Eigen" << "\n";
+			result = 6;
+		}
+	}
+
+	if (!parameters.traceOutput.empty() && !Trace::writeChromeTrace(parameters.traceOutput)) {
+		std::cerr << "(headless) Cannot write trace file '" << parameters.traceOutput << "'" << "\n";
+		result = 1;
+	}
+
+	ecs.reset();
+	return result;
+}
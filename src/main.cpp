@@ -1,4 +1,5 @@
 #include <iostream>
+#include <thread>
 
 #include "GlfwWindowManager.h"
 #include "GlfwRenderWindowWrapper.h"
@@ -6,6 +7,7 @@
 #include "Camera.h"
 
 #include "Simulation.h"
+#include "Trace.h"
 #include "EntityComponentSystem.h"
 
 #include "ImGuiScene.h"
@@ -18,6 +20,13 @@ int main()
 	std::cout.setf(std::ios::unitbuf);
 	std::cerr.setf(std::ios::unitbuf);
 
+#ifdef PHYANI_TRACING
+	Trace::setThreadName("Render");
+#endif
+
+	// Use all hardware threads for the parallel phases of the simulation
+	Simulation::getEntityComponentSystem().workerPool().setThreadCount(std::thread::hardware_concurrency());
+
 	try {
 		// Initialize GLFW
 		// Cleanup of OpenGL context and GLFW is performed when the scope of the manager is left.
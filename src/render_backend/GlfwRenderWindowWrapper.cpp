@@ -5,10 +5,12 @@
 
 #include <noname_tools/vector_tools.h>
 
+#include "AllocationTracker.h"
 #include "GlfwWindowManager.h"
 #include "RenderExceptions.h"
 #include "GlfwHelper.h"
 #include "MathHelper.h"
+#include "Trace.h"
 
 GlfwRenderWindowWrapper::GlfwRenderWindowWrapper(const ContextSettings& settings)
 	: m_continueRenderLoop(false)
@@ -164,6 +166,9 @@ Camera* GlfwRenderWindowWrapper::camera()
 
 void GlfwRenderWindowWrapper::render()
 {
+	TRACE_ZONE("GlfwRenderWindowWrapper::render");
+	ALLOCATION_SCOPE("GlfwRenderWindowWrapper::render");
+
 	glViewport(0, 0, m_camera.viewportSize().x, m_camera.viewportSize().y);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glPolygonMode(GL_FRONT_AND_BACK, m_drawMode);
@@ -171,6 +176,8 @@ void GlfwRenderWindowWrapper::render()
 	//! Render the current scenes
 	for (auto scene : m_scenes) scene->render();
 
+	// Blocks with vertical synchronization
+	TRACE_ZONE("glfwSwapBuffers");
 	glfwSwapBuffers(m_window);
 }
 
@@ -191,10 +191,8 @@ void GlfwWindowManager::processEvents()
 		}
 	} eventVisitor{ &processEvents };
 
-	while (processEvents && !m_eventQueue.empty()) {
-		// The event queue ensures thread safety
-		m_eventQueue.processOldestEvent(eventVisitor);
-	}
+	// The event queue ensures thread safety, processing stops when the queue is empty
+	while (processEvents && m_eventQueue.processOldestEvent(eventVisitor)) {}
 }
 
 std::future<void> GlfwWindowManager::stopEventLoop()
@@ -2,6 +2,8 @@
 
 #include <cassert>
 
+#include "Trace.h"
+
 Scene::Scene()
 	: m_initialized(false)
 	, m_camera(nullptr)
@@ -40,6 +42,7 @@ void Scene::cleanup()
 
 void Scene::render()
 {
+	TRACE_ZONE("Scene::render");
 	assert(m_initialized);
 	renderSceneContent();
 }
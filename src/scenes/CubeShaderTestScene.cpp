@@ -6,6 +6,7 @@
 
 #include "CommonOpenGl.h"
 #include "DrawableFactory.h"
+#include "Trace.h"
 
 void CubeShaderTestScene::initializeSceneContent()
 {
@@ -218,9 +219,12 @@ void CubeShaderTestScene::renderSceneContent()
 			glBindVertexArray(m_vao);
 
 		// Update the model matrix buffer
-		glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
-		glBufferData(GL_ARRAY_BUFFER, drawableData.instanceDataSize(), nullptr, GL_STREAM_DRAW);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, drawableData.instanceDataSize(), drawableData.instanceData());
+		{
+			TRACE_ZONE("CubeShaderTestScene::uploadInstanceData");
+			glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+			glBufferData(GL_ARRAY_BUFFER, drawableData.instanceDataSize(), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, drawableData.instanceDataSize(), drawableData.instanceData());
+		}
 
 		// Activate the shader if necessary
 		m_shaderProgram.useProgram();
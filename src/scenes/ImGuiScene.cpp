@@ -1,5 +1,6 @@
 ﻿#include "ImGuiScene.h"
 
+#include <cfloat>
 #include <iostream>
 #include <limits>
 
@@ -9,7 +10,9 @@
 #include "MathHelper.h"
 
 #include "Simulation.h"
+#include "AllocationTracker.h"
 #include "AnimationLoop.h"
+#include "Trace.h"
 
 ImGuiScene::ImGuiScene()
 {
@@ -85,6 +88,85 @@ void ImGuiScene::drawMainWindow()
 	ImGui::Text("Animation %.3e ms/timestep, dt=%.3e", timestepTime*1000, dt*1000);
 	ImGui::Spacing();
 
+	// Rolling percentiles of the phases of the last timesteps
+	if (ImGui::CollapsingHeader("Timestep statistics")) {
+		const auto statistics = Simulation::getAnimationLoop().timestepStatistics();
+		ImGui::Text("Last %zu timesteps, times in ms", statistics.sampleCount);
+
+		ImGui::Columns(6, "timestepStatistics");
+		for (const char* label : { "Phase", "Last", "p50", "p95", "p99", "Max" }) {
+			ImGui::Text("%s", label);
+			ImGui::NextColumn();
+		}
+		ImGui::Separator();
+
+		const auto row = [](const char* name, const TimestepStatistics::Percentiles& p) {
+			ImGui::Text("%s", name);
+			ImGui::NextColumn();
+			for (const double value : { p.last, p.p50, p.p95, p.p99, p.max }) {
+				ImGui::Text("%.3f", value*1000);
+				ImGui::NextColumn();
+			}
+		};
+		for (std::size_t phase = 0; phase < TimestepTimings::phaseCount; phase++) {
+			row(TimestepTimings::phaseName(static_cast<TimestepPhase>(phase)), statistics.phases[phase]);
+		}
+		ImGui::Separator();
+		row("Total", statistics.total);
+		row("Pacing jitter", Simulation::getAnimationLoop().pacingJitter());
+		ImGui::Columns(1);
+
+		// Delays of the step starts behind their deadlines since the last reset, on a log scale from 1 us
+		const auto& histogram = Simulation::getAnimationLoop().pacingJitterHistogram();
+		float counts[DurationHistogram::binCount];
+		for (std::size_t bin = 0; bin < DurationHistogram::binCount; bin++) counts[bin] = static_cast<float>(histogram.count(bin));
+		ImGui::PlotHistogram("Jitter histogram", counts, DurationHistogram::binCount, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+		if (ImGui::Button("Reset histogram")) Simulation::getAnimationLoop().resetPacingJitterHistogram();
+		ImGui::SameLine();
+		if (ImGui::Button("Write jitter_histogram.csv")) {
+			if (histogram.writeCsv("jitter_histogram.csv")) std::cout << "(gui) Jitter histogram written to jitter_histogram.csv." << "\n";
+			else std::cerr << "(gui) Cannot write jitter_histogram.csv." << "\n";
+		}
+
+#ifdef PHYANI_TRACING
+		// Zones of all threads, e.g. for chrome://tracing or Perfetto
+		if (ImGui::Checkbox("Record trace", &m_options.tracing)) Trace::setEnabled(m_options.tracing);
+		ImGui::SameLine();
+		if (ImGui::Button("Write trace.json")) {
+			if (Trace::writeChromeTrace("trace.json")) std::cout << "(gui) Trace written to trace.json." << "\n";
+			else std::cerr << "(gui) Cannot write trace.json." << "\n";
+		}
+#endif
+	}
+
+#ifdef PHYANI_ALLOCATION_TRACKING
+	// Allocations of the instrumented sites, the step loop and posting events should not allocate at all
+	if (ImGui::CollapsingHeader("Allocations")) {
+		const auto global = AllocationTracker::globalCounters();
+		ImGui::Text("Total %llu allocations, %llu deallocations", static_cast<unsigned long long>(global.allocations), static_cast<unsigned long long>(global.deallocations));
+
+		ImGui::Columns(4, "allocationSites");
+		for (const char* label : { "Site", "Per call", "Max", "Last" }) {
+			ImGui::Text("%s", label);
+			ImGui::NextColumn();
+		}
+		ImGui::Separator();
+
+		for (auto site = AllocationTracker::firstSite(); site; site = site->next) {
+			const auto calls = site->calls.load(std::memory_order_relaxed);
+			ImGui::Text("%s", site->name);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f", calls > 0 ? double(site->allocations.load(std::memory_order_relaxed)) / calls : 0.0);
+			ImGui::NextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(site->maxAllocations.load(std::memory_order_relaxed)));
+			ImGui::NextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(site->lastAllocations.load(std::memory_order_relaxed)));
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+#endif
+
 	// Camera settings
 	if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
 		const auto rotation = m_camera->rotation();
@@ -110,7 +192,9 @@ void ImGuiScene::drawMainWindow()
 	if (ImGui::CollapsingHeader("Animation")) {
 		AnimationLoop& animationLoop = Simulation::getAnimationLoop();
 
-		//if (ImGui::Button("Reset scene")) Simulation::getAnimationScene().resetScene();
+		if (ImGui::Button("Reset scene")) animationLoop.restoreSnapshot();
+		ImGui::SameLine();
+		if (ImGui::Button("Save state")) animationLoop.saveSnapshot();
 
 		ImGui::Text("Automatic timestepping");
 		if (ImGui::Checkbox("Start/stop time", &m_options.automaticTimestepping)
@@ -118,11 +202,48 @@ void ImGuiScene::drawMainWindow()
 			animationLoop.toggleAutomaticTimestepping(m_options.timeStretch);
 		ImGui::SliderFloat("Time stretch factor",
 						   &m_options.timeStretch, 0.0f + std::numeric_limits<float>::epsilon(), 100, "%.5f", 10);
+		bool fixedTimestepChanged = ImGui::Checkbox("Fixed timestep", &m_options.fixedTimestep);
+		fixedTimestepChanged |= ImGui::SliderInt("Timestep rate (Hz)", &m_options.fixedTimestepRate, 10, 1000);
+		if (fixedTimestepChanged)
+			animationLoop.setFixedTimestep(m_options.fixedTimestep, 1.0 / m_options.fixedTimestepRate);
+		// The loop sleeps between its iterations unless it runs as fast as possible
+		bool pacingChanged = ImGui::Checkbox("As fast as possible", &m_options.unpacedLoop);
+		pacingChanged |= ImGui::SliderInt("Loop rate (Hz)", &m_options.loopRate, 10, 1000);
+		if (pacingChanged)
+			animationLoop.setPacing(m_options.unpacedLoop ? 0.0 : m_options.loopRate);
+
+		// Opt-in real-time scheduling of the simulation thread, usually requires privileges
+		const char* policies[] = { ThreadScheduling::policyName(ThreadScheduling::Policy::Default),
+								   ThreadScheduling::policyName(ThreadScheduling::Policy::RaisedPriority),
+								   ThreadScheduling::policyName(ThreadScheduling::Policy::Fifo) };
+		ImGui::Combo("Thread scheduling", &m_options.schedulingPolicy, policies, 3);
+		ImGui::SliderInt("Thread priority", &m_options.schedulingPriority, 1, 99);
+		ImGui::SliderInt("Pin to core", &m_options.schedulingCore, -1, 63);
+		ImGui::Checkbox("Lock memory", &m_options.lockMemory);
+		ImGui::SameLine();
+		if (ImGui::Button("Apply scheduling")) {
+			ThreadScheduling::Settings settings;
+			settings.policy = static_cast<ThreadScheduling::Policy>(m_options.schedulingPolicy);
+			settings.priority = m_options.schedulingPriority;
+			settings.core = m_options.schedulingCore;
+			settings.lockMemory = m_options.lockMemory;
+			animationLoop.setScheduling(settings);
+		}
 
 		ImGui::Text("Manual timestepping");
-		if (ImGui::Button("Increment timestep")) animationLoop.requestTimestep(m_options.timestep);
+		if (ImGui::Button("Increment timestep")) animationLoop.requestTimestepDetached(m_options.timestep);
 		ImGui::SliderFloat("Manual timestep size",
 						   &m_options.timestep, 0.0f + std::numeric_limits<float>::epsilon(), 100, "%.5f", 10);
+
+		ImGui::Text("Integration");
+		const char* schemes[] = { Integrator::schemeName(IntegrationScheme::SymplecticEuler),
+								  Integrator::schemeName(IntegrationScheme::VelocityVerlet),
+								  Integrator::schemeName(IntegrationScheme::RungeKutta4),
+								  Integrator::schemeName(IntegrationScheme::ImplicitEuler) };
+		bool integratorChanged = ImGui::Combo("Integration scheme", &m_options.integrationScheme, schemes, 4);
+		integratorChanged |= ImGui::SliderInt("Sub steps", &m_options.substepCount, 1, 32);
+		if (integratorChanged)
+			animationLoop.setIntegrator(static_cast<IntegrationScheme>(m_options.integrationScheme), m_options.substepCount);
 	}
 
 	ImGui::End();
@@ -25,6 +25,18 @@ private:
 		float timestep = 0.01f;
 		float timeStretch = 1.0f;
 		bool automaticTimestepping = false;
+		bool fixedTimestep = false;
+		int fixedTimestepRate = 120;
+		bool unpacedLoop = false;
+		int loopRate = 120;
+		int schedulingPolicy = 0;
+		int schedulingPriority = 10;
+		int schedulingCore = -1;
+		bool lockMemory = false;
+		bool tracing = false;
+
+		int integrationScheme = 0;
+		int substepCount = 1;
 
 		bool gizmoEnabled = false;
 		bool gizmoPreviouslyInUse = false;